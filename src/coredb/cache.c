@@ -0,0 +1,125 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cache.h"
+#include "tables/row.h"
+
+#include <lcthw/dbg.h>
+#include <stdlib.h>
+
+struct ModelCache *ModelCache_create()
+{
+    struct ModelCache *cache = calloc(1, sizeof(struct ModelCache));
+    check_mem(cache);
+    return cache;
+
+error:
+    return NULL;
+}
+
+void ModelCache_destroy(struct ModelCache *cache)
+{
+    if (cache == NULL) { return; }
+
+    ModelCache_clear(cache);
+    for (int kind = 0; kind < MAX_CACHE_KINDS; kind++) {
+        free(cache->models[kind]);
+    }
+    free(cache);
+}
+
+/**
+ * @brief Look up a loaded model. The pointer is borrowed: a caller that keeps
+ *        it must take its own reference.
+ *
+ * @param cache The cache
+ * @param kind  What sort of model
+ * @param id    The id of the record it was loaded from
+ * @return void* The model, or NULL if it is not loaded
+ */
+void *ModelCache_get(struct ModelCache *cache, enum CacheKind kind, unsigned int id)
+{
+    if (cache == NULL || kind >= MAX_CACHE_KINDS || id == 0 || id > ROW_MAX_ID) { return NULL; }
+    if (cache->models[kind] == NULL) { return NULL; }
+    return cache->models[kind][id];
+}
+
+/**
+ * @brief Remember a loaded model. The cache takes over one reference, which
+ *        it gives back through release when the model is evicted.
+ *
+ * @param cache   The cache
+ * @param kind    What sort of model
+ * @param id      The id of the record it was loaded from
+ * @param model   The model
+ * @param release Drops one reference to the model
+ * @return enum MorkResult
+ */
+enum MorkResult ModelCache_put(struct ModelCache *cache, enum CacheKind kind, unsigned int id, void *model, ModelCache_releaseFn release)
+{
+    if (cache == NULL) { return MORK_ERROR_DB_NULL; }
+    if (kind >= MAX_CACHE_KINDS || id == 0 || id > ROW_MAX_ID) { return MORK_ERROR_DB_INVALID_ID; }
+    if (model == NULL || release == NULL) { return MORK_ERROR_DB_INVALID_DATA; }
+
+    if (cache->models[kind] == NULL) {
+        cache->models[kind] = calloc(ROW_MAX_ID + 1, sizeof(void *));
+        if (cache->models[kind] == NULL) { return MORK_ERROR_DB; }
+    }
+
+    ModelCache_evict(cache, kind, id);
+    cache->models[kind][id] = model;
+    cache->release[kind] = release;
+    cache->count++;
+    return MORK_OK;
+}
+
+/**
+ * @brief Forget the model loaded from a record, e.g. because the record was
+ *        written. Anyone still holding the model keeps it; the next load
+ *        builds a fresh one.
+ *
+ * @param cache The cache
+ * @param kind  What sort of model
+ * @param id    The id of the record
+ */
+void ModelCache_evict(struct ModelCache *cache, enum CacheKind kind, unsigned int id)
+{
+    void *model = ModelCache_get(cache, kind, id);
+    if (model == NULL) { return; }
+
+    cache->models[kind][id] = NULL;
+    cache->count--;
+    cache->release[kind](model);
+}
+
+/**
+ * @brief Forget every loaded model.
+ *
+ * @param cache The cache
+ */
+void ModelCache_clear(struct ModelCache *cache)
+{
+    if (cache == NULL) { return; }
+
+    for (int kind = 0; kind < MAX_CACHE_KINDS && cache->count > 0; kind++) {
+        if (cache->models[kind] == NULL) { continue; }
+        for (unsigned int id = 1; id <= ROW_MAX_ID && cache->count > 0; id++) {
+            ModelCache_evict(cache, kind, id);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../utils/error.h"
+
+// An identity map from record id to the model loaded from it, so loading the
+// same item, location or character twice hands back the same object. The
+// cache holds one reference to each model and gives it back through the
+// release function it was stored with; models are dropped whenever their
+// record is written, and all of them when the database file changes.
+
+enum CacheKind {
+    CACHE_ITEMS = 0,
+    CACHE_LOCATIONS,
+    CACHE_CHARACTERS,
+    MAX_CACHE_KINDS
+};
+
+typedef void *(*ModelCache_retainFn)(void *model);
+typedef void (*ModelCache_releaseFn)(void *model);
+
+struct ModelCache {
+    void **models[MAX_CACHE_KINDS]; // By id, allocated on first use
+    ModelCache_releaseFn release[MAX_CACHE_KINDS];
+    unsigned int count;
+};
+
+struct ModelCache *ModelCache_create();
+void ModelCache_destroy(struct ModelCache *cache);
+
+void *ModelCache_get(struct ModelCache *cache, enum CacheKind kind, unsigned int id);
+enum MorkResult ModelCache_put(struct ModelCache *cache, enum CacheKind kind, unsigned int id, void *model, ModelCache_releaseFn release);
+void ModelCache_evict(struct ModelCache *cache, enum CacheKind kind, unsigned int id);
+void ModelCache_clear(struct ModelCache *cache);
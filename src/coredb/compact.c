@@ -0,0 +1,596 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "compact.h"
+#include "db.h"
+#include "lz.h"
+
+#include <lcthw/dbg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Little-endian primitives. Each returns 1 on success and 0 on failure so
+// a whole row can be chained with &&.
+
+static int put_u8(FILE *file, unsigned char value)
+{
+    return fputc(value, file) != EOF;
+}
+
+static int put_u16(FILE *file, unsigned int value)
+{
+    unsigned char buf[2] = { value & 0xFF, (value >> 8) & 0xFF };
+    return fwrite(buf, sizeof(buf), 1, file) == 1;
+}
+
+static int put_u32(FILE *file, unsigned long value)
+{
+    return put_u16(file, value & 0xFFFF) && put_u16(file, (value >> 16) & 0xFFFF);
+}
+
+static int put_u64(FILE *file, unsigned long long value)
+{
+    return put_u32(file, value & 0xFFFFFFFFUL) && put_u32(file, (value >> 32) & 0xFFFFFFFFUL);
+}
+
+static int put_str(FILE *file, const char *str, size_t max)
+{
+    size_t len = strnlen(str, max);
+    return put_u16(file, len) && (len == 0 || fwrite(str, len, 1, file) == 1);
+}
+
+static int put_ids(FILE *file, const unsigned short *ids, size_t max)
+{
+    size_t count = max;
+    while (count > 0 && ids[count - 1] == 0) { count--; }
+
+    if (!put_u16(file, count)) { return 0; }
+    for (size_t i = 0; i < count; i++) {
+        if (!put_u16(file, ids[i])) { return 0; }
+    }
+    return 1;
+}
+
+static int get_u8(FILE *file, unsigned char *value)
+{
+    int c = fgetc(file);
+    if (c == EOF) { return 0; }
+    *value = (unsigned char)c;
+    return 1;
+}
+
+static int get_u16(FILE *file, unsigned short *value)
+{
+    unsigned char buf[2];
+    if (fread(buf, sizeof(buf), 1, file) != 1) { return 0; }
+    *value = buf[0] | (buf[1] << 8);
+    return 1;
+}
+
+static int get_u32(FILE *file, unsigned long *value)
+{
+    unsigned short lo, hi;
+    if (!get_u16(file, &lo) || !get_u16(file, &hi)) { return 0; }
+    *value = lo | ((unsigned long)hi << 16);
+    return 1;
+}
+
+static int get_u64(FILE *file, unsigned long long *value)
+{
+    unsigned long lo, hi;
+    if (!get_u32(file, &lo) || !get_u32(file, &hi)) { return 0; }
+    *value = lo | ((unsigned long long)hi << 32);
+    return 1;
+}
+
+static int get_str(FILE *file, char *str, size_t max)
+{
+    unsigned short len;
+    if (!get_u16(file, &len) || len > max) { return 0; }
+    memset(str, 0, max);
+    return len == 0 || fread(str, len, 1, file) == 1;
+}
+
+static int get_ids(FILE *file, unsigned short *ids, size_t max, unsigned short *read)
+{
+    unsigned short count;
+    if (!get_u16(file, &count) || count > max) { return 0; }
+    memset(ids, 0, max * sizeof(unsigned short));
+    for (size_t i = 0; i < count; i++) {
+        if (!get_u16(file, &ids[i])) { return 0; }
+    }
+    if (read) { *read = count; }
+    return 1;
+}
+
+static int Compact_writeRow(FILE *file, enum Table table, void *row)
+{
+    switch (table) {
+        case CHARACTERS: {
+            struct CharacterRecord *rec = row;
+            return put_u8(file, rec->level) &&
+                   put_u64(file, rec->experience) &&
+                   put_u64(file, rec->health_and_mana) &&
+                   put_u64(file, rec->max_health_and_mana) &&
+                   put_u64(file, rec->stats) &&
+                   put_u8(file, rec->numStats) &&
+                   put_str(file, rec->name, MAX_NAME_LEN);
+        }
+        case DESCRIPTION: {
+            struct DescriptionRecord *rec = row;
+            return put_str(file, rec->description, MAX_DESCRIPTION) &&
+                   put_u32(file, (unsigned int)rec->next_id);
+        }
+        case DIALOG: {
+            struct DialogRecord *rec = row;
+            return put_str(file, rec->text, MAX_TEXT) &&
+                   put_u16(file, rec->next_id);
+        }
+        case GAMES: {
+            struct GameRecord *rec = row;
+            return put_u16(file, rec->owner_id) &&
+                   put_u16(file, rec->location_id);
+        }
+        case INVENTORY: {
+            struct InventoryRecord *rec = row;
+            return put_u16(file, rec->owner_id) &&
+                   put_ids(file, rec->item_ids, rec->item_count);
+        }
+        case ITEMS: {
+            struct ItemRecord *rec = row;
+            return put_str(file, rec->name, MAX_NAME) &&
+                   put_u16(file, rec->description_id);
+        }
+        case LOCATIONS: {
+            struct LocationRecord *rec = row;
+            return put_str(file, rec->name, MAX_NAME) &&
+                   put_u16(file, rec->descriptionID) &&
+                   put_ids(file, rec->exitIDs, MAX_EXITS) &&
+                   put_ids(file, rec->itemIDs, MAX_ITEMS) &&
+                   put_ids(file, rec->characterIDs, MAX_CHARACTERS);
+        }
+        default:
+            return 0;
+    }
+}
+
+static int Compact_readRow(FILE *file, enum Table table, void *row)
+{
+    switch (table) {
+        case CHARACTERS: {
+            struct CharacterRecord *rec = row;
+            unsigned long long experience, health_and_mana, max_health_and_mana;
+            if (!(get_u8(file, &rec->level) &&
+                  get_u64(file, &experience) &&
+                  get_u64(file, &health_and_mana) &&
+                  get_u64(file, &max_health_and_mana) &&
+                  get_u64(file, &rec->stats) &&
+                  get_u8(file, &rec->numStats) &&
+                  get_str(file, rec->name, MAX_NAME_LEN))) {
+                return 0;
+            }
+            rec->experience = experience;
+            rec->health_and_mana = health_and_mana;
+            rec->max_health_and_mana = max_health_and_mana;
+            return 1;
+        }
+        case DESCRIPTION: {
+            struct DescriptionRecord *rec = row;
+            unsigned long next_id;
+            if (!(get_str(file, rec->description, MAX_DESCRIPTION) && get_u32(file, &next_id))) {
+                return 0;
+            }
+            rec->next_id = (int)next_id;
+            return 1;
+        }
+        case DIALOG: {
+            struct DialogRecord *rec = row;
+            return get_str(file, rec->text, MAX_TEXT) &&
+                   get_u16(file, &rec->next_id);
+        }
+        case GAMES: {
+            struct GameRecord *rec = row;
+            return get_u16(file, &rec->owner_id) &&
+                   get_u16(file, &rec->location_id);
+        }
+        case INVENTORY: {
+            struct InventoryRecord *rec = row;
+            return get_u16(file, &rec->owner_id) &&
+                   get_ids(file, rec->item_ids, MAX_INVENTORY_ITEMS, &rec->item_count);
+        }
+        case ITEMS: {
+            struct ItemRecord *rec = row;
+            return get_str(file, rec->name, MAX_NAME) &&
+                   get_u16(file, &rec->description_id);
+        }
+        case LOCATIONS: {
+            struct LocationRecord *rec = row;
+            return get_str(file, rec->name, MAX_NAME) &&
+                   get_u16(file, &rec->descriptionID) &&
+                   get_ids(file, rec->exitIDs, MAX_EXITS, NULL) &&
+                   get_ids(file, rec->itemIDs, MAX_ITEMS, NULL) &&
+                   get_ids(file, rec->characterIDs, MAX_CHARACTERS, NULL);
+        }
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Check whether a file starts with the compact format's magic. The
+ *        file position is left at the start either way.
+ *
+ * @param file The file to check
+ * @return int 1 if the file is in the compact format, 0 otherwise
+ */
+int Compact_detect(FILE *file)
+{
+    char magic[COMPACT_MAGIC_LEN];
+    if (file == NULL || fseek(file, 0, SEEK_SET) != 0) { return 0; }
+
+    int found = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, COMPACT_MAGIC, COMPACT_MAGIC_LEN) == 0;
+    fseek(file, 0, SEEK_SET);
+    return found;
+}
+
+static int Compact_isText(enum Table table)
+{
+    return table == DESCRIPTION || table == DIALOG;
+}
+
+/**
+ * @brief Close a block of serialized rows and write it out, compressed if
+ *        that makes it any smaller. The block's buffer is freed either way.
+ */
+static int Compact_endBlock(FILE *file, FILE *block, char **raw, size_t *raw_len)
+{
+    int ok = fclose(block) == 0;
+    unsigned char *packed = ok ? malloc(Lz_bound(*raw_len)) : NULL;
+    ok = ok && packed != NULL;
+
+    const unsigned char *stored = (unsigned char *)*raw;
+    size_t stored_len = *raw_len;
+    size_t packed_len = 0;
+    if (ok && Lz_compress(stored, *raw_len, packed, Lz_bound(*raw_len), &packed_len) == MORK_OK && packed_len < *raw_len) {
+        stored = packed;
+        stored_len = packed_len;
+    }
+    ok = ok && put_u32(file, *raw_len) && put_u32(file, stored_len) && fwrite(stored, stored_len, 1, file) == 1;
+
+    free(packed);
+    free(*raw);
+    *raw = NULL;
+    *raw_len = 0;
+    return ok;
+}
+
+// The live rows of every table, packed, with what the header needs
+struct CompactSnapshot {
+    unsigned int flags;
+    struct {
+        unsigned char *rows;
+        size_t row_size;
+        unsigned long count;
+        unsigned int next_index;
+    } tables[MAX_TABLES];
+};
+
+/**
+ * @brief Copy the live rows of every table, so they can be encoded later
+ *        without holding the tables. The caller holds every table's lock;
+ *        this is one copy per row and nothing else.
+ *
+ * @param db The database
+ * @return struct CompactSnapshot* The copy, for Compact_encode, or NULL
+ */
+struct CompactSnapshot *Compact_snapshot(struct Database *db)
+{
+    check(db != NULL, "Database is NULL");
+
+    struct CompactSnapshot *snapshot = calloc(1, sizeof(struct CompactSnapshot));
+    check_mem(snapshot);
+    snapshot->flags = db->compress_text ? COMPACT_FLAG_TEXT_LZ : 0;
+
+    for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+        struct TableMeta *meta = db->tables[tbl];
+        snapshot->tables[tbl].next_index = __atomic_load_n(&db->table_index_counters[tbl], __ATOMIC_RELAXED);
+
+        unsigned long count = TableMeta_liveCount(meta);
+        if (count == 0) { continue; }
+
+        unsigned char *rows = malloc(count * meta->row_size);
+        if (rows == NULL) {
+            Compact_freeSnapshot(snapshot);
+            sentinel("Out of memory copying table %d", tbl);
+        }
+        unsigned long n = 0;
+        for (int i = TableMeta_nextLive(meta, 0); i >= 0 && n < count; i = TableMeta_nextLive(meta, i + 1)) {
+            memcpy(rows + n++ * meta->row_size, (unsigned char *)meta->rows + (size_t)i * meta->row_size, meta->row_size);
+        }
+        snapshot->tables[tbl].rows = rows;
+        snapshot->tables[tbl].row_size = meta->row_size;
+        snapshot->tables[tbl].count = n;
+    }
+    return snapshot;
+
+error:
+    return NULL;
+}
+
+void Compact_freeSnapshot(struct CompactSnapshot *snapshot)
+{
+    if (snapshot == NULL) { return; }
+    for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+        free(snapshot->tables[tbl].rows);
+    }
+    free(snapshot);
+}
+
+/**
+ * @brief Write a table's rows in blocks of COMPACT_BLOCK_ROWS.
+ */
+static int Compact_writeBlocks(FILE *file, enum Table table, const unsigned char *rows, size_t row_size, unsigned long count)
+{
+    char *raw = NULL;
+    size_t raw_len = 0;
+    FILE *block = NULL;
+    unsigned int in_block = 0;
+    int ok = 1;
+
+    for (unsigned long i = 0; ok && i < count; i++) {
+        if (block == NULL) {
+            block = open_memstream(&raw, &raw_len);
+            if (block == NULL) { return 0; }
+        }
+
+        struct GenericRow *grow = (struct GenericRow *)(rows + i * row_size);
+        ok = put_u16(block, grow->id) && Compact_writeRow(block, table, grow);
+        if (ok && ++in_block == COMPACT_BLOCK_ROWS) {
+            ok = Compact_endBlock(file, block, &raw, &raw_len);
+            block = NULL;
+            in_block = 0;
+        }
+    }
+
+    if (block) {
+        ok = Compact_endBlock(file, block, &raw, &raw_len) && ok;
+    }
+    return ok;
+}
+
+static enum MorkResult Compact_writeTables(const struct CompactSnapshot *snapshot, FILE *file)
+{
+    unsigned int flags = snapshot->flags;
+    check(fwrite(COMPACT_MAGIC, COMPACT_MAGIC_LEN, 1, file) == 1 &&
+          put_u16(file, COMPACT_VERSION) &&
+          put_u16(file, MAX_TABLES) &&
+          put_u16(file, flags), "Failed to write header");
+
+    for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+        // Only live rows were copied, so a sparse table costs its rows, not its capacity
+        const unsigned char *rows = snapshot->tables[tbl].rows;
+        size_t row_size = snapshot->tables[tbl].row_size;
+        unsigned long count = snapshot->tables[tbl].count;
+        check(put_u32(file, count) && put_u32(file, snapshot->tables[tbl].next_index),
+              "Failed to write header for table %d", tbl);
+
+        if (count > 0 && (flags & COMPACT_FLAG_TEXT_LZ) && Compact_isText(tbl)) {
+            check(Compact_writeBlocks(file, tbl, rows, row_size, count), "Failed to write rows of table %d", tbl);
+            continue;
+        }
+
+        for (unsigned long i = 0; i < count; i++) {
+            struct GenericRow *grow = (struct GenericRow *)(rows + i * row_size);
+            check(put_u16(file, grow->id) && Compact_writeRow(file, tbl, grow),
+                  "Failed to write row %lu of table %d", i, tbl);
+        }
+    }
+    return MORK_OK;
+
+error:
+    return MORK_ERROR_DB_FILE_WRITE;
+}
+
+/**
+ * @brief Replace the contents of a file with the live rows of every table.
+ *
+ * @param db   The database to write
+ * @param file The file to write to, opened for writing
+ * @return enum MorkResult
+ */
+enum MorkResult Compact_write(struct Database *db, FILE *file)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+    if (file == NULL) { return MORK_ERROR_DB_FILE_NULL; }
+
+    struct CompactSnapshot *snapshot = Compact_snapshot(db);
+    check(snapshot != NULL, "Failed to copy tables");
+    check(fseek(file, 0, SEEK_SET) == 0, "Failed to seek to start of file");
+    check(Compact_writeTables(snapshot, file) == MORK_OK, "Failed to write tables");
+    Compact_freeSnapshot(snapshot);
+    snapshot = NULL;
+
+    // The file may have held more rows before, so cut it off where we stopped
+    check(fflush(file) == 0, "Failed to flush file");
+    check(ftruncate(fileno(file), ftell(file)) == 0, "Failed to truncate file");
+
+    return MORK_OK;
+
+error:
+    Compact_freeSnapshot(snapshot);
+    return MORK_ERROR_DB_FILE_WRITE;
+}
+
+/**
+ * @brief Encode a snapshot as a compact image in memory. This is where the
+ *        rows are serialized and the text compressed, so it is meant for the
+ *        flusher's thread, with no table held.
+ *
+ * @param snapshot Taken by Compact_snapshot
+ * @param data     Set to the image, which the caller frees
+ * @param len      Set to the size of the image
+ * @return enum MorkResult
+ */
+enum MorkResult Compact_encode(const struct CompactSnapshot *snapshot, unsigned char **data, size_t *len)
+{
+    if (snapshot == NULL) { return MORK_ERROR_DB_NULL; }
+    if (data == NULL || len == NULL) { return MORK_ERROR_DB_INVALID_DATA; }
+
+    char *buf = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&buf, &size);
+    if (out == NULL) { return MORK_ERROR_DB; }
+
+    enum MorkResult res = Compact_writeTables(snapshot, out);
+    if (fclose(out) != 0 && res == MORK_OK) { res = MORK_ERROR_DB_FILE_WRITE; }
+    if (res != MORK_OK) {
+        free(buf);
+        return res;
+    }
+
+    *data = (unsigned char *)buf;
+    *len = size;
+    return MORK_OK;
+}
+
+/**
+ * @brief Build the compact image of every table in memory.
+ *
+ * @param db   The database to write
+ * @param data Set to the image, which the caller frees
+ * @param len  Set to the size of the image
+ * @return enum MorkResult
+ */
+enum MorkResult Compact_serialize(struct Database *db, unsigned char **data, size_t *len)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+
+    struct CompactSnapshot *snapshot = Compact_snapshot(db);
+    if (snapshot == NULL) { return MORK_ERROR_DB; }
+    enum MorkResult res = Compact_encode(snapshot, data, len);
+    Compact_freeSnapshot(snapshot);
+    return res;
+}
+
+/**
+ * @brief Read rows first through first + count - 1 of a table.
+ */
+static int Compact_readRows(FILE *file, enum Table table, struct TableMeta *meta, unsigned long first, unsigned long count, int fresh)
+{
+    for (unsigned long i = first; i < first + count; i++) {
+        struct GenericRow *grow = (struct GenericRow *)((unsigned char *)meta->rows + i * meta->row_size);
+        if (!(get_u16(file, &grow->id) && Compact_readRow(file, table, grow))) {
+            log_err("Failed to read row %lu of table %d", i, table);
+            return 0;
+        }
+        grow->set = 1;
+        // Keeps a fresh table's indexes current without a later scan
+        if (fresh) { TableMeta_markRow(meta, i); }
+    }
+    return 1;
+}
+
+/**
+ * @brief Read a table's rows from blocks written by Compact_writeBlocks,
+ *        decompressing one block at a time.
+ */
+static int Compact_readBlocks(FILE *file, enum Table table, struct TableMeta *meta, unsigned long count, int fresh)
+{
+    for (unsigned long first = 1; first <= count; first += COMPACT_BLOCK_ROWS) {
+        unsigned long rows = count - first + 1 < COMPACT_BLOCK_ROWS ? count - first + 1 : COMPACT_BLOCK_ROWS;
+
+        // No row takes more room on disk than in memory plus its lengths
+        unsigned long raw_len, stored_len;
+        if (!(get_u32(file, &raw_len) && get_u32(file, &stored_len))) { return 0; }
+        if (raw_len == 0 || stored_len == 0 || stored_len > raw_len || raw_len > rows * (meta->row_size + 16)) { return 0; }
+
+        unsigned char *stored = malloc(stored_len);
+        unsigned char *raw = stored_len == raw_len ? stored : malloc(raw_len);
+        int ok = stored != NULL && raw != NULL && fread(stored, stored_len, 1, file) == 1;
+        if (ok && raw != stored) {
+            ok = Lz_decompress(stored, stored_len, raw, raw_len) == MORK_OK;
+        }
+
+        FILE *block = ok ? fmemopen(raw, raw_len, "r") : NULL;
+        ok = block != NULL && Compact_readRows(block, table, meta, first, rows, fresh);
+        if (block) { fclose(block); }
+        if (raw != stored) { free(raw); }
+        free(stored);
+        if (!ok) { return 0; }
+    }
+    return 1;
+}
+
+/**
+ * @brief Load every table from a compact file. Rows are packed from row 1 up
+ *        and anything the tables held before is discarded.
+ *
+ * @param db   The database to load into
+ * @param file The file to read from
+ * @return enum MorkResult
+ */
+enum MorkResult Compact_read(struct Database *db, FILE *file)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+    if (file == NULL) { return MORK_ERROR_DB_FILE_NULL; }
+
+    char magic[COMPACT_MAGIC_LEN];
+    unsigned short version, tables;
+    unsigned short flags = 0;
+    check(fseek(file, 0, SEEK_SET) == 0, "Failed to seek to start of file");
+    check(fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, COMPACT_MAGIC, COMPACT_MAGIC_LEN) == 0,
+          "Not a compact database file");
+    check(get_u16(file, &version) && get_u16(file, &tables), "Failed to read header");
+    check(version >= 1 && version <= COMPACT_VERSION, "Unsupported database version %d", version);
+    check(tables == MAX_TABLES, "Expected %d tables, file has %d", MAX_TABLES, tables);
+    check(version < 2 || get_u16(file, &flags), "Failed to read header");
+    check((flags & ~COMPACT_FLAG_TEXT_LZ) == 0, "Unsupported database flags %x", flags);
+
+    for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+        unsigned long count, next_index;
+        check(get_u32(file, &count) && get_u32(file, &next_index), "Failed to read header for table %d", tbl);
+        db->table_index_counters[tbl] = next_index;
+
+        // Empty tables stay unallocated until something asks for them
+        struct TableMeta *meta = db->tables[tbl];
+        if (count == 0 && meta == NULL) { continue; }
+        int fresh = meta == NULL;
+        meta = Database_get(db, tbl);
+        check(meta != NULL, "Failed to create table %d", tbl);
+        check(count < meta->capacity, "Table %d has %lu rows, more than it can hold", tbl, count);
+
+        // A table we just created is already zeroed, and clearing it would
+        // fault in every page
+        unsigned char *rows = meta->rows;
+        if (!fresh) { memset(rows, 0, TableMeta_size(meta)); }
+        if (!fresh) { TableMeta_invalidate(meta); }
+        if ((flags & COMPACT_FLAG_TEXT_LZ) && Compact_isText(tbl)) {
+            check(Compact_readBlocks(file, tbl, meta, count, fresh), "Failed to read rows of table %d", tbl);
+        } else {
+            check(Compact_readRows(file, tbl, meta, 1, count, fresh), "Failed to read rows of table %d", tbl);
+        }
+
+        TableMeta_clearDirty(meta);
+    }
+
+    return MORK_OK;
+
+error:
+    return MORK_ERROR_DB_FILE_READ;
+}
@@ -0,0 +1,58 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../utils/error.h"
+
+#include <stdio.h>
+
+// The compact file format stores only live rows:
+//
+//   "MORK" | u16 version | u16 table count | u16 flags
+//   per table: u32 row count | u32 next index | rows
+//   per row:   u16 id | fields, strings as u16 length + bytes,
+//              id lists as u16 count + ids (trailing zeroes dropped)
+//
+// With COMPACT_FLAG_TEXT_LZ the rows of the text tables (descriptions and
+// dialog) are stored in blocks of up to COMPACT_BLOCK_ROWS rows instead:
+//
+//   per block: u32 raw length | u32 stored length | stored bytes
+//
+// where the stored bytes are the rows compressed with lz.h, or the rows as
+// they are when that would not make them any smaller (stored == raw).
+//
+// All integers are little-endian. Version 1 files have no flags. Files
+// without the magic are the legacy fixed layout of full-size row arrays.
+#define COMPACT_MAGIC "MORK"
+#define COMPACT_MAGIC_LEN 4
+#define COMPACT_VERSION 2
+
+#define COMPACT_FLAG_TEXT_LZ 0x0001
+#define COMPACT_BLOCK_ROWS 64
+
+struct Database;
+struct CompactSnapshot;
+
+int Compact_detect(FILE *file);
+enum MorkResult Compact_write(struct Database *db, FILE *file);
+enum MorkResult Compact_serialize(struct Database *db, unsigned char **data, size_t *len);
+struct CompactSnapshot *Compact_snapshot(struct Database *db);
+enum MorkResult Compact_encode(const struct CompactSnapshot *snapshot, unsigned char **data, size_t *len);
+void Compact_freeSnapshot(struct CompactSnapshot *snapshot);
+enum MorkResult Compact_read(struct Database *db, FILE *file);
@@ -17,31 +17,81 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "db.h"
+#include "cache.h"
+#include "roomgraph.h"
+#include "compact.h"
+#include "flush.h"
+#include "ioengine.h"
+#include "wal.h"
 
 #include <assert.h>
+#include <fcntl.h>
 #include <lcthw/dbg.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 void Database_init(struct Database *db)
 {
     if (db->initialized == 1) {
         return; // Don't re-initialize
     }
-    // Initialize all tables
-    db->tables[CHARACTERS] = CharacterTable_create();
-    CharacterTable_init(db->tables[CHARACTERS]);
-    db->tables[DIALOG] = DialogTable_create();
-    DialogTable_init(db->tables[DIALOG]);
-    db->tables[GAMES] = GameTable_create();
-    GameTable_init(db->tables[GAMES]);
-    db->tables[ITEMS] = ItemTable_create();
-    ItemTable_init(db->tables[ITEMS]);
-    db->tables[DESCRIPTION] = DescriptionTable_create();
-    DescriptionTable_init(db->tables[DESCRIPTION]);
-    db->tables[INVENTORY] = InventoryTable_create();
-    InventoryTable_init(db->tables[INVENTORY]);
-    db->tables[LOCATIONS] = LocationTable_create();
+    // Tables are created on first use by Database_get, so a process that
+    // never touches dialog (say) never allocates or faults in its rows
     db->initialized = 1;
+}
 
+static void *Database_createTable(enum Table table)
+{
+    switch (table) {
+        case CHARACTERS:
+            return CharacterTable_create();
+        case DESCRIPTION:
+            return DescriptionTable_create();
+        case DIALOG:
+            return DialogTable_create();
+        case GAMES:
+            return GameTable_create();
+        case INVENTORY:
+            return InventoryTable_create();
+        case ITEMS:
+            return ItemTable_create();
+        case LOCATIONS:
+            return LocationTable_create();
+        default:
+            return NULL;
+    }
+}
+
+size_t table_size(enum Table table)
+{
+    assert(table >= 0 && table < MAX_TABLES);
+
+    // Only the row arrays are persisted; the table meta is rebuilt in memory
+    switch (table) {
+        case CHARACTERS:
+            return MAX_ROWS_CS * sizeof(struct CharacterRecord);
+        case DESCRIPTION:
+            return MAX_ROWS_DESC * sizeof(struct DescriptionRecord);
+        case DIALOG:
+            return MAX_ROWS_DIALOG * sizeof(struct DialogRecord);
+        case GAMES:
+            return MAX_ROWS_GAMES * sizeof(struct GameRecord);
+        case INVENTORY:
+            return MAX_ROWS_INVENTORIES * sizeof(struct InventoryRecord);
+        case ITEMS:
+            return MAX_ROWS_ITEMS * sizeof(struct ItemRecord);
+        case LOCATIONS:
+            return MAX_LOCATIONS * sizeof(struct LocationRecord);
+        default:
+            sentinel("Unknown table type");
+    }
+
+error:
+    return 0;
 }
 
 long table_offset(enum Table table)
@@ -58,17 +108,17 @@ long table_offset(enum Table table)
     long offset = 0;
     switch (table) {
         case LOCATIONS:
-            offset += sizeof(struct ItemTable);
+            offset += table_size(ITEMS);
         case ITEMS:
-            offset += sizeof(struct InventoryTable);
+            offset += table_size(INVENTORY);
         case INVENTORY:
-            offset += sizeof(struct GameTable);
+            offset += table_size(GAMES);
         case GAMES:
-            offset += sizeof(struct DialogTable);
+            offset += table_size(DIALOG);
         case DIALOG:
-            offset += sizeof(struct DescriptionTable);
+            offset += table_size(DESCRIPTION);
         case DESCRIPTION:
-            offset += sizeof(struct CharacterTable);
+            offset += table_size(CHARACTERS);
         case CHARACTERS:
             break;
         default:
@@ -81,31 +131,414 @@ error:
     return -1;
 }
 
-size_t table_size(enum Table table)
+/**
+ * @brief Put a run of bytes at an offset in the backing store. With a file
+ *        the write is queued on the I/O engine, to go out with the rest of
+ *        its batch in Database_submit; with a mapping the bytes are already
+ *        in the file's pages, so they are synced there and then.
+ *
+ * @param db    The database
+ * @param range Where the bytes go, and the bytes themselves for a file
+ * @return enum MorkResult
+ */
+static enum MorkResult Database_writeAt(struct Database *db, const struct FlushRange *range)
 {
-    assert(table >= 0 && table < MAX_TABLES);
+    if (db->file) {
+        return IoEngine_write(db->io, range->data, range->len, (off_t)range->offset);
+    }
+
+    if (db->map) {
+        // msync wants a page-aligned address, so round down to the system page
+        size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+        size_t aligned = range->offset - range->offset % pagesize;
+        if (msync(db->map + aligned, range->len + (range->offset - aligned), MS_SYNC) != 0) { return MORK_ERROR_DB_FILE_FLUSH; }
+        return MORK_OK;
+    }
+
+    return MORK_ERROR_DB_FILE_NULL;
+}
+
+/**
+ * @brief Send every write queued by Database_writeAt to the file as one batch.
+ */
+static enum MorkResult Database_submit(struct Database *db)
+{
+    if (db->file == NULL) { return MORK_OK; }
+    return IoEngine_submit(db->io, fileno(db->file));
+}
+
+/**
+ * @brief Write part of a table's rows to the backing store.
+ *
+ * @param db    The database
+ * @param table The table the rows belong to
+ * @param start Byte offset into the table's row array
+ * @param len   Number of bytes to write
+ * @return enum MorkResult
+ */
+static enum MorkResult Database_writeRange(struct Database *db, enum Table table, size_t start, size_t len)
+{
+    struct TableMeta *meta = db->tables[table];
+    struct FlushRange range = {
+        .offset = table_offset(table) + start,
+        .len = len,
+        .data = (unsigned char *)meta->rows + start
+    };
+    return Database_writeAt(db, &range);
+}
+
+/**
+ * @brief Replace the contents of a compact file with an image of it. With a
+ *        log the image goes to a temporary sibling that is synced and renamed
+ *        over the original, and the directory synced, so the file on disk is
+ *        always whole; the new file is swapped in under the same FILE, so
+ *        db->file never changes.
+ *
+ * @param db    The database
+ * @param image The whole file
+ * @param len   Size of the image
+ * @return enum MorkResult
+ */
+static enum MorkResult Database_writeImage(struct Database *db, const unsigned char *image, size_t len)
+{
+    if (db->wal == NULL) {
+        if (fseek(db->file, 0, SEEK_SET) != 0) { return MORK_ERROR_DB_FILE_SEEK; }
+        if (len != 0 && fwrite(image, len, 1, db->file) != 1) { return MORK_ERROR_DB_FILE_WRITE; }
+        if (fflush(db->file) != 0) { return MORK_ERROR_DB_FILE_FLUSH; }
+        // The file may have held more rows before, so cut it off where we stopped
+        if (ftruncate(fileno(db->file), (off_t)len) != 0) { return MORK_ERROR_DB_FILE_WRITE; }
+        return MORK_OK;
+    }
+
+    size_t path_len = strlen(db->path) + 5;
+    char *tmp = malloc(path_len);
+    if (tmp == NULL) { return MORK_ERROR_DB; }
+    snprintf(tmp, path_len, "%s.tmp", db->path);
+
+    enum MorkResult res = MORK_ERROR_DB_FILE_WRITE;
+    FILE *out = fopen(tmp, "w+");
+    if (out == NULL) { goto done; }
+
+    if (len != 0 && fwrite(image, len, 1, out) != 1) { res = MORK_ERROR_DB_FILE_WRITE; }
+    else if (fflush(out) != 0 || fsync(fileno(out)) != 0) { res = MORK_ERROR_DB_FILE_FLUSH; }
+    else if (fflush(db->file) != 0) { res = MORK_ERROR_DB_FILE_FLUSH; }
+    else if (rename(tmp, db->path) != 0) { res = MORK_ERROR_DB_FILE_WRITE; }
+    else if (dup2(fileno(out), fileno(db->file)) < 0) { res = MORK_ERROR_DB_FILE_WRITE; }
+    // Until the rename is durable a power loss can bring back the old file,
+    // so the checkpoint must not drop the log before this
+    else { res = Wal_syncDir(db->path); }
+
+    if (res != MORK_OK && access(tmp, F_OK) == 0) { remove(tmp); }
+    fclose(out);
+
+done:
+    free(tmp);
+    return res;
+}
+
+static int Database_anyDirty(struct Database *db)
+{
+    for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+        struct TableMeta *meta = db->tables[tbl];
+        if (meta && meta->dirty_count != 0) { return 1; }
+    }
+    return 0;
+}
+
+/**
+ * @brief Rewrite a compact file from the live rows, if anything changed
+ *        since it was last written.
+ */
+static enum MorkResult Database_writeCompact(struct Database *db)
+{
+    if (!Database_anyDirty(db)) { return MORK_OK; }
+
+    unsigned char *image = NULL;
+    size_t len = 0;
+    enum MorkResult res = Compact_serialize(db, &image, &len);
+    if (res == MORK_OK) { res = Database_writeImage(db, image, len); }
+    free(image);
+    if (res != MORK_OK) { return res; }
+
+    for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+        TableMeta_clearDirty(db->tables[tbl]);
+    }
+    return MORK_OK;
+}
+
+/**
+ * @brief Once a snapshot is on disk, drop the part of the log it covers.
+ *        Runs on the flusher's thread.
+ */
+static enum MorkResult Database_checkpoint(struct Database *db, struct FlushHandle *handle)
+{
+    if (db->file && fflush(db->file) != 0) { return MORK_ERROR_DB_FILE_FLUSH; }
+    if (db->wal == NULL) { return MORK_OK; }
+
+    // The log is all that stands in for the snapshot until it is synced
+    if (fsync(fileno(db->file)) != 0) { return MORK_ERROR_DB_FILE_FLUSH; }
+    pthread_mutex_lock(&db->commit_lock);
+    enum MorkResult res = Wal_discard(db->wal, handle->wal_size);
+    pthread_mutex_unlock(&db->commit_lock);
+    return res;
+}
+
+/**
+ * @brief Write out a snapshot taken by Database_snapshot. Runs on the
+ *        flusher's thread. A failure leaves a note for the next snapshot,
+ *        since the rows this one held are no longer marked dirty.
+ */
+static enum MorkResult Database_runFlush(struct FlushHandle *handle)
+{
+    struct Database *db = handle->owner;
+    enum MorkResult res = MORK_OK;
+
+    // Encoding and compressing the rows is the slow part, so it happens here
+    if (handle->rows) {
+        res = Compact_encode(handle->rows, &handle->image, &handle->image_len);
+    }
+    if (res == MORK_OK && handle->image) {
+        res = Database_writeImage(db, handle->image, handle->image_len);
+    }
+    for (unsigned int i = 0; i < handle->range_count && res == MORK_OK; i++) {
+        res = Database_writeAt(db, &handle->ranges[i]);
+    }
+    // Submitted even after a failure, so nothing is left queued on the engine
+    enum MorkResult sent = Database_submit(db);
+    if (res == MORK_OK) { res = sent; }
+    if (res == MORK_OK) {
+        res = Database_checkpoint(db, handle);
+    }
+
+    if (res != MORK_OK) {
+        __atomic_store_n(&db->flush_failed, 1, __ATOMIC_RELEASE);
+    }
+    return res;
+}
+
+static void Database_freeRows(void *rows)
+{
+    Compact_freeSnapshot(rows);
+}
+
+/**
+ * @brief Copy whatever changed since the last flush into a flush handle,
+ *        then mark the tables clean. The caller holds every table's lock,
+ *        so nothing here encodes or compresses: a compact file gets a copy of
+ *        the live rows, encoded on the flusher's thread; a fixed file a copy
+ *        of each dirty page run, and a mapping just the offsets to sync.
+ */
+static enum MorkResult Database_snapshot(struct Database *db, struct FlushHandle *handle)
+{
+    handle->run = Database_runFlush;
+
+    if (__atomic_exchange_n(&db->flush_failed, 0, __ATOMIC_ACQ_REL)) {
+        // What the failed write held is only in memory now, so write it all again
+        for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+            TableMeta_markAll(db->tables[tbl]);
+        }
+    }
+
+    if (db->wal) {
+        pthread_mutex_lock(&db->commit_lock);
+        handle->wal_size = db->wal->size;
+        pthread_mutex_unlock(&db->commit_lock);
+    }
+
+    if (!Database_anyDirty(db)) { return MORK_OK; }
+
+    if (db->file && db->format == DB_FORMAT_COMPACT) {
+        handle->rows = Compact_snapshot(db);
+        if (handle->rows == NULL) { return MORK_ERROR_DB; }
+        handle->free_rows = Database_freeRows;
+    } else {
+        // Only the pages that changed since the last flush
+        unsigned int runs = 0;
+        for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+            struct TableMeta *meta = db->tables[tbl];
+            if (meta == NULL) { continue; }
+            unsigned int first = 0;
+            unsigned int count = 0;
+            for (unsigned int page = 0; (count = TableMeta_nextDirtyRun(meta, page, &first)) != 0; page = first + count) {
+                runs++;
+            }
+        }
 
+        handle->ranges = calloc(runs, sizeof(struct FlushRange));
+        if (handle->ranges == NULL) { return MORK_ERROR_DB; }
+
+        for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+            struct TableMeta *meta = db->tables[tbl];
+            if (meta == NULL) { continue; }
+
+            size_t size = table_size(tbl);
+            unsigned int first = 0;
+            unsigned int count = 0;
+            for (unsigned int page = 0; (count = TableMeta_nextDirtyRun(meta, page, &first)) != 0; page = first + count) {
+                size_t start = (size_t)first * ROW_PAGE_SIZE;
+                size_t len = (size_t)count * ROW_PAGE_SIZE;
+                if (start + len > size) { len = size - start; }
+
+                struct FlushRange *range = &handle->ranges[handle->range_count++];
+                range->offset = table_offset(tbl) + start;
+                range->len = len;
+                if (db->file) {
+                    range->data = malloc(len);
+                    if (range->data == NULL) { return MORK_ERROR_DB; }
+                    memcpy(range->data, (unsigned char *)meta->rows + start, len);
+                }
+            }
+        }
+    }
+
+    for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+        TableMeta_clearDirty(db->tables[tbl]);
+    }
+    return MORK_OK;
+}
+
+static void *Database_createMappedTable(enum Table table, void *rows)
+{
     switch (table) {
         case CHARACTERS:
-            return sizeof(struct CharacterTable);
+            return CharacterTable_createMapped(rows);
         case DESCRIPTION:
-            return sizeof(struct DescriptionTable);
+            return DescriptionTable_createMapped(rows);
         case DIALOG:
-            return sizeof(struct DialogTable);
+            return DialogTable_createMapped(rows);
         case GAMES:
-            return sizeof(struct GameTable);
+            return GameTable_createMapped(rows);
         case INVENTORY:
-            return sizeof(struct InventoryTable);
+            return InventoryTable_createMapped(rows);
         case ITEMS:
-            return sizeof(struct ItemTable);
+            return ItemTable_createMapped(rows);
         case LOCATIONS:
-            return sizeof(struct LocationTable);
+            return LocationTable_createMapped(rows);
         default:
-            sentinel("Unknown table type");
+            return NULL;
     }
+}
 
-error:
-    return 0;
+/**
+ * @brief Log a row change to the write-ahead log, if one is open. Installed as
+ *        every table's on_change hook, so it sees each create, update and delete.
+ */
+static void Database_logRow(void *ctx, struct TableMeta *meta, unsigned int idx)
+{
+    struct Database *db = ctx;
+    if (db == NULL) { return; }
+
+    if (meta == db->tables[LOCATIONS] || meta == db->tables[DESCRIPTION]) {
+        pthread_mutex_lock(&db->rooms_lock);
+        RoomGraph_invalidate(db->rooms);
+        pthread_mutex_unlock(&db->rooms_lock);
+    }
+    if (db->wal == NULL) { return; }
+
+    for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+        if (db->tables[tbl] != meta) { continue; }
+
+        struct GenericRow *row = (struct GenericRow *)((unsigned char *)meta->rows + (size_t)idx * meta->row_size);
+        enum MorkResult res = MORK_OK;
+        pthread_mutex_lock(&db->wal_lock);
+        if (row->set == 1) {
+            res = Wal_append(db->wal, WAL_OP_ROW, tbl, idx, row->id, row, meta->row_size);
+        } else {
+            res = Wal_append(db->wal, WAL_OP_CLEAR, tbl, idx, row->id, NULL, 0);
+        }
+        pthread_mutex_unlock(&db->wal_lock);
+        if (res != MORK_OK) { log_err("Failed to log change to table %d row %u", tbl, idx); }
+        return;
+    }
+}
+
+/**
+ * @brief Apply one logged row change during replay. Rows are found by id
+ *        rather than by the logged row index, since a compact file packs its
+ *        rows on load and a record can come back in a different row.
+ */
+static enum MorkResult Database_applyLogged(void *ctx, const struct WalEntryHeader *entry, const void *payload)
+{
+    struct Database *db = ctx;
+    if (entry->table >= MAX_TABLES) { return MORK_ERROR_DB_INVALID_DATA; }
+
+    struct TableMeta *meta = Database_get(db, entry->table);
+    if (meta == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+
+    int found = TableMeta_lookup(meta, entry->id);
+    unsigned int idx = 0;
+    struct GenericRow *row = NULL;
+    switch (entry->op) {
+        case WAL_OP_ROW:
+            if (entry->length != meta->row_size) { return MORK_ERROR_DB_INVALID_DATA; }
+            if (found >= 0) {
+                idx = (unsigned int)found;
+            } else if (entry->row != 0 && entry->row < meta->capacity &&
+                       ((struct GenericRow *)((unsigned char *)meta->rows + (size_t)entry->row * meta->row_size))->set != 1) {
+                idx = entry->row;
+            } else {
+                idx = findNextRowToFill(meta);
+                if (idx == 0) { return MORK_ERROR_DB_INVALID_DATA; }
+            }
+            row = (struct GenericRow *)((unsigned char *)meta->rows + (size_t)idx * meta->row_size);
+            memcpy(row, payload, meta->row_size);
+            // Ids handed out after the last checkpoint must not be reused
+            if (entry->id >= db->table_index_counters[entry->table]) {
+                db->table_index_counters[entry->table] = entry->id + 1;
+            }
+            break;
+        case WAL_OP_CLEAR:
+            if (found < 0) { return MORK_OK; }
+            idx = (unsigned int)found;
+            row = (struct GenericRow *)((unsigned char *)meta->rows + (size_t)idx * meta->row_size);
+            row->set = 0;
+            break;
+        default:
+            return MORK_ERROR_DB_INVALID_DATA;
+    }
+    TableMeta_markRow(meta, idx);
+    return MORK_OK;
+}
+
+/**
+ * @brief Open the log next to the database file and replay anything a crash
+ *        left in it. From then on every row change is logged.
+ */
+static enum MorkResult Database_openWal(struct Database *db)
+{
+    char *path = Wal_pathFor(db->path);
+    if (path == NULL) { return MORK_ERROR_DB; }
+    struct Wal *wal = Wal_open(path);
+    free(path);
+    if (wal == NULL) { return MORK_ERROR_DB_FAILED_LOAD; }
+
+    // Replayed rows are already in the log, so it is attached afterwards
+    enum MorkResult res = Wal_replay(wal, Database_applyLogged, db);
+    if (res != MORK_OK) {
+        Wal_close(wal);
+        return MORK_ERROR_DB_FAILED_LOAD;
+    }
+    db->wal = wal;
+    return MORK_OK;
+}
+
+/**
+ * @brief Drop the tables that live in the mapping and release it. The tables
+ *        cannot outlive the mapping, so the database goes back to uninitialized.
+ */
+static void Database_unmap(struct Database *db)
+{
+    for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+        if (db->tables[tbl] == NULL) { continue; }
+        Database_delete(db, tbl);
+    }
+    db->initialized = 0;
+
+    if (db->map) { munmap(db->map, db->map_size); }
+    if (db->fd >= 0) { close(db->fd); }
+    db->map = NULL;
+    db->map_size = 0;
+    db->fd = -1;
 }
 
 enum MorkResult Database_createFile(struct Database *db, const char *path)
@@ -120,15 +553,19 @@ enum MorkResult Database_createFile(struct Database *db, const char *path)
     db->file = fopen(path, "w+");
     check(db->file, "Failed to create file: %s", path);
 
+    // A log left beside an old file of the same name must not replay onto this one
+    char *wal_path = Wal_pathFor(path);
+    if (wal_path) { remove(wal_path); }
+    free(wal_path);
+
     Database_init(db);
 
-    // Write out the tables to disk
-    for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
-        Database_write(db, tbl);
-    }
+    // Write out the tables to disk, which for a new world is little more than the header
+    check(Compact_write(db, db->file) == MORK_OK, "Failed to write file: %s", path);
 
     // Close file to flush to disk
     fclose(db->file);
+    db->file = NULL;
 
     return MORK_OK;
 
@@ -136,36 +573,152 @@ error:
     return MORK_ERROR_DB;
 }
 
+/**
+ * @brief Size of a file in the fixed layout. The layout has no header or
+ *        version, so this is all that tells a file written with today's row
+ *        sizes from one written with older ones: a row that grew shifts every
+ *        table after it, and such a file must not be read as this layout.
+ */
+static size_t Database_fixedSize(void)
+{
+    return table_offset(LOCATIONS) + table_size(LOCATIONS);
+}
+
 enum MorkResult Database_open(struct Database *db, const char *path)
 {
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (path == NULL) { return MORK_ERROR_DB_INVALID_PATH; }
 
+    if (db->file || db->map) {
+        enum MorkResult res = Database_close(db);
+        if (res != MORK_OK) { return res; }
+    }
+    enum MorkResult failure = MORK_ERROR_DB;
+    // Rows are read straight into the tables, past the change hook
+    RoomGraph_invalidate(db->rooms);
+
     db->file = fopen(path, "rw+");
     check(db->file, "Failed to open file: %s", path);
 
+    free(db->path);
+    db->path = strdup(path);
+    check_mem(db->path);
+
     Database_init(db);
+    db->format = DB_FORMAT_COMPACT;
 
-    // If the file is empty, don't bother reading anything
+    long size = 0;
     if (fseek(db->file, 0, SEEK_END) == 0) {
-        long size = ftell(db->file);
-        if (size == 0) {
-            return MORK_OK;
+        size = ftell(db->file);
+    }
+
+    if (size == 0) {
+        // If the file is empty, don't bother reading anything
+    } else if (Compact_detect(db->file)) {
+        check(Compact_read(db, db->file) == MORK_OK, "Failed to read file: %s", path);
+    } else {
+        // Anything else is the fixed layout: each table written out in order
+        // at a known offset, so every table is read in one batch
+        db->format = DB_FORMAT_FIXED;
+        if ((size_t)size != Database_fixedSize()) {
+            failure = MORK_ERROR_DB_INVALID_DATA;
+            sentinel("Not a database file, or one with older row sizes (%ld bytes, expected %zu): %s",
+                     size, Database_fixedSize(), path);
+        }
+
+        enum MorkResult res = MORK_OK;
+        for (enum Table tbl = 0; tbl < MAX_TABLES && res == MORK_OK; tbl++) {
+            struct TableMeta *meta = Database_get(db, tbl);
+            res = meta ? IoEngine_read(db->io, meta->rows, table_size(tbl), table_offset(tbl)) : MORK_ERROR_DB_TABLE_NULL;
+        }
+        enum MorkResult got = IoEngine_submit(db->io, fileno(db->file));
+        check(res == MORK_OK && got == MORK_OK, "Failed to read tables from: %s", path);
+
+        for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+            // What we just read matches the disk, so there is nothing to write back
+            TableMeta_clearDirty(db->tables[tbl]);
+            TableMeta_invalidate(db->tables[tbl]);
         }
     }
 
-    // Load the database from disk
-    // The database file is just each table written out in order
-    // so we can just read them in order by offsets
+    // Whatever was committed after the last checkpoint goes back on top
+    check(Database_openWal(db) == MORK_OK, "Failed to replay log for: %s", path);
+    return MORK_OK;
 
+error:
+    // Nothing may be written back to a file that could not be read
+    if (db->file) {
+        fclose(db->file);
+        db->file = NULL;
+    }
+    return failure;
+}
+
+/**
+ * @brief Open a database file by mapping it into memory. The tables are built
+ *        directly on top of the mapped regions, so nothing is read up front and
+ *        pages are faulted in as rows are touched. A missing or empty file is
+ *        created and extended to full size, which reads back as all rows unset;
+ *        any other file must be exactly that size.
+ *
+ * @param db   The database
+ * @param path Path to the database file
+ * @return enum MorkResult
+ */
+enum MorkResult Database_openMapped(struct Database *db, const char *path)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+    if (path == NULL) { return MORK_ERROR_DB_INVALID_PATH; }
+
+    if (db->file || db->map) {
+        enum MorkResult res = Database_close(db);
+        if (res != MORK_OK) { return res; }
+    }
+    RoomGraph_invalidate(db->rooms);
+
+    enum MorkResult failure = MORK_ERROR_DB;
+    size_t size = Database_fixedSize();
+
+    db->fd = open(path, O_RDWR | O_CREAT, 0644);
+    check(db->fd >= 0, "Failed to open file: %s", path);
+
+    // Only the fixed layout has rows at known offsets
+    char magic[COMPACT_MAGIC_LEN];
+    check(pread(db->fd, magic, sizeof(magic), 0) != sizeof(magic) || memcmp(magic, COMPACT_MAGIC, COMPACT_MAGIC_LEN) != 0,
+          "Cannot map compact database file: %s", path);
+    db->format = DB_FORMAT_FIXED;
+
+    struct stat st;
+    check(fstat(db->fd, &st) == 0, "Failed to stat file: %s", path);
+    if (st.st_size == 0) {
+        check(ftruncate(db->fd, size) == 0, "Failed to size file: %s", path);
+    } else if ((size_t)st.st_size != size) {
+        // Growing it would shift its tables under the new offsets
+        failure = MORK_ERROR_DB_INVALID_DATA;
+        sentinel("Not a database file, or one with older row sizes (%lld bytes, expected %zu): %s",
+                 (long long)st.st_size, size, path);
+    }
+
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, db->fd, 0);
+    check(map != MAP_FAILED, "Failed to map file: %s", path);
+    db->map = map;
+    db->map_size = size;
+
+    // Any in-memory tables are replaced by views of the file
     for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
-        fseek(db->file, table_offset(tbl), SEEK_SET);
-        check(fread(db->tables[tbl], table_size(tbl), 1, db->file), "Failed to read table %d", tbl);
+        if (db->tables[tbl]) {
+            Database_delete(db, tbl);
+        }
+        db->tables[tbl] = Database_createMappedTable(tbl, db->map + table_offset(tbl));
+        check(db->tables[tbl] != NULL, "Failed to create mapped table %d", tbl);
     }
+    db->initialized = 1;
+
     return MORK_OK;
 
 error:
-    return MORK_ERROR_DB;
+    Database_unmap(db);
+    return failure;
 }
 
 enum MorkResult Database_close(struct Database *db)
@@ -176,6 +729,16 @@ enum MorkResult Database_close(struct Database *db)
         Database_init(db);
     }
 
+    // Only flushes already started are waited for; the one below goes
+    // through the same queue, so it ends up behind them anyway
+    Flusher_drain(db->flusher);
+
+    // Models describe this file's rows, which are about to be closed or replaced
+    pthread_mutex_lock(&db->cache_lock);
+    ModelCache_clear(db->cache);
+    pthread_mutex_unlock(&db->cache_lock);
+    RoomGraph_invalidate(db->rooms);
+
     if (db->file) {
         // Make sure we write out to the file before closing it
         enum MorkResult res = Database_flush(db);
@@ -184,33 +747,194 @@ enum MorkResult Database_close(struct Database *db)
         db->file = NULL;
     }
 
+    if (db->wal) {
+        // The flush checkpointed everything, so the log has nothing left to say
+        Wal_close(db->wal);
+        db->wal = NULL;
+        char *wal_path = Wal_pathFor(db->path);
+        if (wal_path) { remove(wal_path); }
+        free(wal_path);
+    }
+    free(db->path);
+    db->path = NULL;
+
+    if (db->map) {
+        enum MorkResult res = Database_flush(db);
+        if (res != MORK_OK) { return res; }
+        Database_unmap(db);
+    }
+
     return MORK_OK;
 }
 
+/**
+ * @brief Start writing out every change since the last flush and return
+ *        without waiting for it. The changes are copied while every table is
+ *        locked, so the file always gets a consistent picture of the tables,
+ *        and the copy is written by the flusher's thread. Once it is on disk
+ *        the part of the log it covers is dropped. Flushes finish in the
+ *        order they were started.
+ *
+ * @param db       The database
+ * @param callback Called with the result once the flush is done, or NULL.
+ *                 It runs on the flusher's thread (or on this one, if the
+ *                 flush never got that far) and must not use the database.
+ * @param ctx      Passed through to callback
+ * @return struct FlushHandle* Released by the caller, or NULL on failure
+ */
+struct FlushHandle *Database_flushAsync(struct Database *db, FlushHandle_callback callback, void *ctx)
+{
+    check(db != NULL, "Database is NULL");
+
+    struct FlushHandle *handle = FlushHandle_create(db, callback, ctx);
+    check(handle != NULL, "Failed to start flush");
+
+    if (db->file == NULL && db->map == NULL) {
+        Flusher_finish(NULL, handle, MORK_OK);
+        return handle;
+    }
+
+    for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+        pthread_rwlock_wrlock(&db->locks[tbl]);
+    }
+    enum MorkResult res = Database_snapshot(db, handle);
+    // Queued before the tables are unlocked, so snapshots are written in the
+    // order they were taken
+    if (res == MORK_OK) {
+        res = Flusher_submit(db->flusher, handle);
+    }
+    for (enum Table tbl = MAX_TABLES; tbl > 0; tbl--) {
+        pthread_rwlock_unlock(&db->locks[tbl - 1]);
+    }
+
+    if (res != MORK_OK) {
+        __atomic_store_n(&db->flush_failed, 1, __ATOMIC_RELEASE);
+        Flusher_finish(NULL, handle, res);
+    }
+    return handle;
+
+error:
+    return NULL;
+}
+
+/**
+ * @brief Write out every change since the last flush and checkpoint the log,
+ *        waiting until it is on disk.
+ *
+ * @param db The database
+ * @return enum MorkResult
+ */
 enum MorkResult Database_flush(struct Database *db)
 {
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
 
-    // Write the entire database to disk
-    for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
-        if (db->tables[tbl]) {
-            Database_write(db, tbl);
+    struct FlushHandle *handle = Database_flushAsync(db, NULL, NULL);
+    if (handle == NULL) { return MORK_ERROR_DB; }
+
+    enum MorkResult res = FlushHandle_wait(handle);
+    FlushHandle_release(handle);
+    return res;
+}
+
+/**
+ * @brief End the changes made so far as one batch for the log, without
+ *        writing anything. A batch is replayed whole or not at all, so a
+ *        server seals at the end of each turn, while no other turn is half
+ *        done, and commits with Database_commitSealed once it lets go.
+ *
+ * @param db The database
+ * @return enum MorkResult
+ */
+enum MorkResult Database_seal(struct Database *db)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+    if (db->wal == NULL) { return MORK_OK; }
+
+    pthread_mutex_lock(&db->wal_lock);
+    enum MorkResult res = Wal_seal(db->wal);
+    pthread_mutex_unlock(&db->wal_lock);
+    return res;
+}
+
+/**
+ * @brief Make every sealed batch durable by appending it to the write-ahead
+ *        log. The log is only locked to take the batches out, so changes keep
+ *        being logged during the write, and callers that arrive meanwhile
+ *        find their batches written with the next one: many turns share one
+ *        fdatasync. The database file itself is only rewritten when the log
+ *        grows past WAL_CHECKPOINT_SIZE, which starts a flush in the
+ *        background, or on flush and close. Without a log (a mapped file)
+ *        this is a flush.
+ *
+ * @param db The database
+ * @return enum MorkResult
+ */
+enum MorkResult Database_commitSealed(struct Database *db)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+    if (db->wal == NULL) { return Database_flush(db); }
+
+    pthread_mutex_lock(&db->commit_lock);
+    pthread_mutex_lock(&db->wal_lock);
+    enum MorkResult res = Wal_take(db->wal);
+    pthread_mutex_unlock(&db->wal_lock);
+
+    if (res == MORK_OK) {
+        res = Wal_write(db->wal);
+        if (res != MORK_OK) {
+            pthread_mutex_lock(&db->wal_lock);
+            Wal_untake(db->wal);
+            pthread_mutex_unlock(&db->wal_lock);
         }
     }
-
-    if (db->file) {
-        // Just to be extra sure
-        fflush(db->file);
+    size_t size = db->wal->size;
+    pthread_mutex_unlock(&db->commit_lock);
+    if (res != MORK_OK) { return res; }
+
+    // The batch is already durable, so the checkpoint need not be waited for;
+    // one in flight is enough, and the next commit will start another
+    if (size >= WAL_CHECKPOINT_SIZE && Flusher_outstanding(db->flusher) == 0) {
+        FlushHandle_release(Database_flushAsync(db, NULL, NULL));
     }
     return MORK_OK;
 }
 
+/**
+ * @brief Make every change since the last commit durable: seal it as one
+ *        batch and commit it, with one fdatasync for the whole batch. This is
+ *        cheap enough to run after every turn.
+ *
+ * @param db The database
+ * @return enum MorkResult
+ */
+enum MorkResult Database_commit(struct Database *db)
+{
+    enum MorkResult res = Database_seal(db);
+    if (res != MORK_OK) { return res; }
+    return Database_commitSealed(db);
+}
+
 struct Database *Database_create()
 {
     struct Database *db = calloc(1, sizeof(struct Database));
     check_mem(db);
 
     db->file = NULL;
+    db->path = NULL;
+    db->wal = NULL;
+    db->cache = ModelCache_create();
+    check(db->cache != NULL, "Failed to create model cache");
+    db->rooms = RoomGraph_create();
+    check(db->rooms != NULL, "Failed to create room graph");
+    db->flusher = Flusher_create();
+    check(db->flusher != NULL, "Failed to create flusher");
+    db->io = IoEngine_create(IO_BACKEND_URING);
+    check(db->io != NULL, "Failed to create I/O engine");
+    db->format = DB_FORMAT_COMPACT;
+    db->compress_text = 1;
+    db->fd = -1;
+    db->map = NULL;
+    db->map_size = 0;
     db->initialized = 0;
     for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
         db->table_index_counters[tbl] = 1;
@@ -218,13 +942,20 @@ struct Database *Database_create()
 
     for (int i = 0; i < MAX_TABLES; i++) {
         db->tables[i] = NULL;
+        check(pthread_rwlock_init(&db->locks[i], NULL) == 0, "Failed to create table lock");
     }
+    check(pthread_mutex_init(&db->tables_lock, NULL) == 0, "Failed to create lock");
+    check(pthread_mutex_init(&db->wal_lock, NULL) == 0, "Failed to create lock");
+    check(pthread_mutex_init(&db->commit_lock, NULL) == 0, "Failed to create lock");
+    check(pthread_mutex_init(&db->rooms_lock, NULL) == 0, "Failed to create lock");
+    check(pthread_mutex_init(&db->cache_lock, NULL) == 0, "Failed to create lock");
 
     Database_init(db);
 
     return db;
 
 error:
+    free(db);
     return NULL;
 }
 
@@ -277,6 +1008,18 @@ enum MorkResult Database_destroy(struct Database *db)
 
     db->initialized = 0;
 
+    Flusher_destroy(db->flusher);
+    IoEngine_destroy(db->io);
+    ModelCache_destroy(db->cache);
+    RoomGraph_destroy(db->rooms);
+    for (int i = 0; i < MAX_TABLES; i++) {
+        pthread_rwlock_destroy(&db->locks[i]);
+    }
+    pthread_mutex_destroy(&db->tables_lock);
+    pthread_mutex_destroy(&db->wal_lock);
+    pthread_mutex_destroy(&db->commit_lock);
+    pthread_mutex_destroy(&db->rooms_lock);
+    pthread_mutex_destroy(&db->cache_lock);
     free(db);
     return MORK_OK;
 }
@@ -286,7 +1029,23 @@ void *Database_get(struct Database *db, enum Table table)
     check(db != NULL, "Database is NULL");
     check(table >= 0 && table < MAX_TABLES, "Invalid table: %d", table);
 
-    return db->tables[table];
+    void *found = __atomic_load_n(&db->tables[table], __ATOMIC_ACQUIRE);
+    if (found != NULL) { return found; }
+
+    // Two threads may both find the table missing; only one creates it
+    pthread_mutex_lock(&db->tables_lock);
+    if (db->tables[table] == NULL) {
+        struct TableMeta *meta = Database_createTable(table);
+        if (meta != NULL) {
+            meta->on_change = Database_logRow;
+            meta->on_change_ctx = db;
+        }
+        __atomic_store_n(&db->tables[table], meta, __ATOMIC_RELEASE);
+    }
+    found = db->tables[table];
+    pthread_mutex_unlock(&db->tables_lock);
+    check(found != NULL, "Failed to create table: %d", table);
+    return found;
 
 error:
     return NULL;
@@ -298,6 +1057,12 @@ enum MorkResult Database_set(struct Database *db, enum Table table, void *data)
     if (table < 0 || table >= MAX_TABLES) { return MORK_ERROR_DB_INVALID_DATA; }
 
     db->tables[table] = data;
+    if (table == LOCATIONS || table == DESCRIPTION) { RoomGraph_invalidate(db->rooms); }
+    if (data) {
+        struct TableMeta *meta = data;
+        meta->on_change = Database_logRow;
+        meta->on_change_ctx = db;
+    }
     return MORK_OK;
 }
 
@@ -305,20 +1070,69 @@ enum MorkResult Database_write(struct Database *db, enum Table table)
 {
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (table < 0 || table >= MAX_TABLES) { return MORK_ERROR_DB_INVALID_DATA; }
-    if (db->file == NULL) { return MORK_ERROR_DB_FILE_NULL; }
+    if (db->file == NULL && db->map == NULL) { return MORK_ERROR_DB_FILE_NULL; }
+
+    struct TableMeta *meta = db->tables[table];
+    if (meta == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+
+    // A background flush still writing an older snapshot must not land on top
+    Flusher_drain(db->flusher);
+
+    if (db->file && db->format == DB_FORMAT_COMPACT) {
+        // Rows have no fixed place in a compact file, so it is rewritten whole
+        TableMeta_markAll(meta);
+        return Database_writeCompact(db);
+    }
 
     // We know the sizes of the individual tables, so we can write them directly via offset writes
-    int seekres  = fseek(db->file, table_offset(table), SEEK_SET);
-    if (seekres != 0) { return MORK_ERROR_DB_FILE_SEEK; }
+    enum MorkResult res = Database_writeRange(db, table, 0, table_size(table));
+    if (res == MORK_OK) { res = Database_submit(db); }
+    if (res != MORK_OK) { return res; }
+
+    TableMeta_clearDirty(meta);
+    return MORK_OK;
+}
+
+/**
+ * @brief Write only the pages of a table that changed since it was last written.
+ * 
+ * @param db    The database
+ * @param table The table to write
+ * @return enum MorkResult 
+ */
+enum MorkResult Database_writeDirty(struct Database *db, enum Table table)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+    if (table < 0 || table >= MAX_TABLES) { return MORK_ERROR_DB_INVALID_DATA; }
+
+    struct TableMeta *meta = db->tables[table];
+    if (meta == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    if (meta->dirty_count == 0) { return MORK_OK; }
+    if (db->file == NULL && db->map == NULL) { return MORK_ERROR_DB_FILE_NULL; }
 
-    size_t writeres = fwrite(db->tables[table], table_size(table), 1, db->file);
-    if (writeres != table_size(table)) { return MORK_ERROR_DB_FILE_WRITE; }
+    Flusher_drain(db->flusher);
 
-    int flushres = fflush(db->file);
-    if (flushres != 0) { return MORK_ERROR_DB_FILE_FLUSH; }
+    if (db->file && db->format == DB_FORMAT_COMPACT) {
+        return Database_writeCompact(db);
+    }
+
+    // Every dirty run goes to the file in one batch
+    size_t size = table_size(table);
+    unsigned int first = 0;
+    unsigned int count = 0;
+    enum MorkResult res = MORK_OK;
+    for (unsigned int page = 0; res == MORK_OK && (count = TableMeta_nextDirtyRun(meta, page, &first)) != 0; page = first + count) {
+        size_t start = (size_t)first * ROW_PAGE_SIZE;
+        size_t len = (size_t)count * ROW_PAGE_SIZE;
+        if (start + len > size) { len = size - start; }
+
+        res = Database_writeRange(db, table, start, len);
+    }
+    enum MorkResult sent = Database_submit(db);
+    if (res == MORK_OK) { res = sent; }
+    if (res != MORK_OK) { return res; }
 
-    // Return seek back to the beginning of the file
-    fseek(db->file, 0, SEEK_SET);
+    TableMeta_clearDirty(meta);
     return MORK_OK;
 }
 
@@ -327,25 +1141,38 @@ enum MorkResult Database_delete(struct Database *db, enum Table table)
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     check(table >= 0 && table < MAX_TABLES, "Invalid table: %d", table);
 
+    enum MorkResult res = MORK_OK;
     switch (table) {
         case CHARACTERS:
-            return CharacterTable_destroy((struct CharacterTable *)db->tables[CHARACTERS]);
+            res = CharacterTable_destroy((struct CharacterTable *)db->tables[CHARACTERS]);
+            break;
         case DESCRIPTION:
-            return DescriptionTable_destroy((struct DescriptionTable *)db->tables[DESCRIPTION]);
+            res = DescriptionTable_destroy((struct DescriptionTable *)db->tables[DESCRIPTION]);
+            break;
         case DIALOG:
-            return DialogTable_destroy((struct DialogTable *)db->tables[DIALOG]);
+            res = DialogTable_destroy((struct DialogTable *)db->tables[DIALOG]);
+            break;
         case GAMES:
-            return GameTable_destroy((struct GameTable *)db->tables[GAMES]);
+            res = GameTable_destroy((struct GameTable *)db->tables[GAMES]);
+            break;
         case INVENTORY:
-            return InventoryTable_destroy((struct InventoryTable *)db->tables[INVENTORY]);
+            res = InventoryTable_destroy((struct InventoryTable *)db->tables[INVENTORY]);
+            break;
         case ITEMS:
-            return ItemTable_destroy((struct ItemTable *)db->tables[ITEMS]);
+            res = ItemTable_destroy((struct ItemTable *)db->tables[ITEMS]);
+            break;
         case LOCATIONS:
-            return LocationTable_destroy((struct LocationTable *)db->tables[LOCATIONS]);
+            res = LocationTable_destroy((struct LocationTable *)db->tables[LOCATIONS]);
+            break;
         default:
             return MORK_ERROR_DB_INVALID_DATA;
     }
 
+    // The next Database_get starts the table over from empty
+    db->tables[table] = NULL;
+    if (table == LOCATIONS || table == DESCRIPTION) { RoomGraph_invalidate(db->rooms); }
+    return res;
+
 error:
     return MORK_ERROR_DB;
 }
@@ -357,19 +1184,19 @@ enum MorkResult Database_print(struct Database *db, enum Table table)
 
     switch (table) {
         case CHARACTERS:
-            return CharacterTable_print((struct CharacterTable *)db->tables[CHARACTERS]);
+            return CharacterTable_print((struct CharacterTable *)Database_get(db, CHARACTERS));
         case DESCRIPTION:
-            return DescriptionTable_print((struct DescriptionTable *)db->tables[DESCRIPTION]);
+            return DescriptionTable_print((struct DescriptionTable *)Database_get(db, DESCRIPTION));
         case DIALOG:
-            return DialogTable_print((struct DialogTable *)db->tables[DIALOG]);
+            return DialogTable_print((struct DialogTable *)Database_get(db, DIALOG));
         case GAMES:
-            return GameTable_print((struct GameTable *)db->tables[GAMES]);
+            return GameTable_print((struct GameTable *)Database_get(db, GAMES));
         case INVENTORY:
-            return InventoryTable_print((struct InventoryTable *)db->tables[INVENTORY]);
+            return InventoryTable_print((struct InventoryTable *)Database_get(db, INVENTORY));
         case ITEMS:
-            return ItemTable_list((struct ItemTable *)db->tables[ITEMS]);
+            return ItemTable_list((struct ItemTable *)Database_get(db, ITEMS));
         case LOCATIONS:
-            return LocationTable_print((struct LocationTable *)db->tables[LOCATIONS]);
+            return LocationTable_print((struct LocationTable *)Database_get(db, LOCATIONS));
         default:
             return MORK_ERROR_DB_INVALID_DATA;
     }
@@ -382,20 +1209,203 @@ unsigned int Database_getNextIndex(struct Database *db, enum Table table)
 {
     check(db != NULL, "Database is NULL");
     check(table >= 0 && table < MAX_TABLES, "Invalid table: %d", table);
-    return db->table_index_counters[table]++;
+    return __atomic_fetch_add(&db->table_index_counters[table], 1, __ATOMIC_RELAXED);
 
 error:
     return 0;
 }
 
+/**
+ * @brief Lock a table for reading, creating it if need be. Any number of
+ *        readers can hold the lock at once. Lookups build their indexes on
+ *        first use, so if the index this lookup reads is missing the table is
+ *        briefly locked for writing to build just that one; after that the
+ *        lookup only reads. Other indexes stay unbuilt until asked for.
+ *
+ * @param db    The database
+ * @param table The table
+ * @param index The index the caller's lookup reads
+ * @return enum MorkResult
+ */
+enum MorkResult Database_readLockFor(struct Database *db, enum Table table, enum TableIndex index)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+    struct TableMeta *meta = Database_get(db, table);
+    if (meta == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+
+    if (pthread_rwlock_rdlock(&db->locks[table]) != 0) { return MORK_ERROR_DB; }
+    while (!TableMeta_isPrepared(meta, index)) {
+        pthread_rwlock_unlock(&db->locks[table]);
+
+        pthread_rwlock_wrlock(&db->locks[table]);
+        enum MorkResult res = TableMeta_prepare(meta, index);
+        pthread_rwlock_unlock(&db->locks[table]);
+        if (res != MORK_OK) { return res; }
+
+        if (pthread_rwlock_rdlock(&db->locks[table]) != 0) { return MORK_ERROR_DB; }
+    }
+    return MORK_OK;
+}
+
+/**
+ * @brief Lock a table for reading, for lookups by id and walks over the rows.
+ *
+ * @param db    The database
+ * @param table The table
+ * @return enum MorkResult
+ */
+enum MorkResult Database_readLock(struct Database *db, enum Table table)
+{
+    return Database_readLockFor(db, table, INDEX_ID);
+}
+
+/**
+ * @brief Lock a table for writing, creating it if need be.
+ *
+ * @param db    The database
+ * @param table The table
+ * @return enum MorkResult
+ */
+enum MorkResult Database_writeLock(struct Database *db, enum Table table)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+    if (Database_get(db, table) == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    if (pthread_rwlock_wrlock(&db->locks[table]) != 0) { return MORK_ERROR_DB; }
+    return MORK_OK;
+}
+
+/**
+ * @brief Release a lock taken with Database_readLock or Database_writeLock.
+ *
+ * @param db    The database
+ * @param table The table
+ * @return enum MorkResult
+ */
+enum MorkResult Database_unlock(struct Database *db, enum Table table)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+    if (table < 0 || table >= MAX_TABLES) { return MORK_ERROR_DB_INVALID_DATA; }
+    if (pthread_rwlock_unlock(&db->locks[table]) != 0) { return MORK_ERROR_DB; }
+    return MORK_OK;
+}
+
+/**
+ * @brief Copy a record out of its table. Unlike the getters, the copy stays
+ *        valid whatever other threads do to the table afterwards.
+ *
+ * @param db    The database
+ * @param table The table
+ * @param id    The record id
+ * @param out   Receives the row; must be the size of one of the table's records
+ * @return enum MorkResult
+ */
+enum MorkResult Database_copy(struct Database *db, enum Table table, int id, void *out)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+    if (id <= 0) { return MORK_ERROR_DB_INVALID_ID; }
+    if (out == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
+
+    enum MorkResult res = Database_readLock(db, table);
+    if (res != MORK_OK) { return res; }
+
+    struct TableMeta *meta = db->tables[table];
+    int idx = TableMeta_lookup(meta, id);
+    if (idx < 0) {
+        res = MORK_ERROR_DB_NOT_FOUND;
+    } else {
+        memcpy(out, (unsigned char *)meta->rows + (size_t)idx * meta->row_size, meta->row_size);
+    }
+    Database_unlock(db, table);
+    return res;
+}
+
+/**
+ * @brief Copy a record out of its table by name. Only tables with a name
+ *        column (characters, descriptions, items and locations) have one.
+ *
+ * @param db    The database
+ * @param table The table
+ * @param name  The name, or for descriptions the full text
+ * @param out   Receives the row
+ * @return enum MorkResult
+ */
+enum MorkResult Database_copyByName(struct Database *db, enum Table table, const char *name, void *out)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+    if (name == NULL || out == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
+
+    enum MorkResult res = Database_readLockFor(db, table, INDEX_NAME);
+    if (res != MORK_OK) { return res; }
+
+    struct TableMeta *meta = db->tables[table];
+    int idx = meta->name_size != 0 ? TableMeta_lookupName(meta, name) : -1;
+    if (idx < 0) {
+        res = MORK_ERROR_DB_NOT_FOUND;
+    } else {
+        memcpy(out, (unsigned char *)meta->rows + (size_t)idx * meta->row_size, meta->row_size);
+    }
+    Database_unlock(db, table);
+    return res;
+}
+
+/**
+ * @brief Look up a model loaded from a record and take a reference to it.
+ *        The reference is taken under the cache lock, so an eviction on
+ *        another thread cannot free the model in between.
+ *
+ * @param db     The database
+ * @param kind   What sort of model
+ * @param id     The id of the record it was loaded from
+ * @param retain Takes one reference to the model
+ * @return void* The model, now the caller's to release, or NULL if it is not loaded
+ */
+void *Database_cacheGet(struct Database *db, enum CacheKind kind, unsigned int id, ModelCache_retainFn retain)
+{
+    if (db == NULL || retain == NULL) { return NULL; }
+
+    pthread_mutex_lock(&db->cache_lock);
+    void *model = ModelCache_get(db->cache, kind, id);
+    if (model != NULL) { model = retain(model); }
+    pthread_mutex_unlock(&db->cache_lock);
+    return model;
+}
+
+/**
+ * @brief Remember a loaded model, as ModelCache_put does, under the cache lock.
+ *
+ * @param db      The database
+ * @param kind    What sort of model
+ * @param id      The id of the record it was loaded from
+ * @param model   The model; the cache takes over one reference
+ * @param release Drops one reference to the model
+ * @return enum MorkResult
+ */
+enum MorkResult Database_cachePut(struct Database *db, enum CacheKind kind, unsigned int id, void *model,
+                                  ModelCache_releaseFn release)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+
+    pthread_mutex_lock(&db->cache_lock);
+    enum MorkResult res = ModelCache_put(db->cache, kind, id, model, release);
+    pthread_mutex_unlock(&db->cache_lock);
+    return res;
+}
+
+static void Database_evict(struct Database *db, enum CacheKind kind, unsigned int id)
+{
+    pthread_mutex_lock(&db->cache_lock);
+    ModelCache_evict(db->cache, kind, id);
+    pthread_mutex_unlock(&db->cache_lock);
+}
+
 struct CharacterRecord *Database_getCharacter(struct Database *db, int id)
 {
     check(db != NULL, "Database is NULL");
+    check(Database_readLock(db, CHARACTERS) == MORK_OK, "Character table is NULL");
 
-    struct CharacterTable *table = db->tables[CHARACTERS];
-    check(table != NULL, "Character table is NULL");
-
-    return CharacterTable_get(table, id);
+    struct CharacterRecord *record = CharacterTable_get(db->tables[CHARACTERS], id);
+    Database_unlock(db, CHARACTERS);
+    return record;
 
 error:
     return NULL;
@@ -404,11 +1414,11 @@ error:
 struct CharacterRecord *Database_getCharacterByName(struct Database *db, char *name)
 {
     check(db != NULL, "Database is NULL");
+    check(Database_readLockFor(db, CHARACTERS, INDEX_NAME) == MORK_OK, "Character table is NULL");
 
-    struct CharacterTable *table = db->tables[CHARACTERS];
-    check(table != NULL, "Character table is NULL");
-
-    return CharacterTable_getByName(table, name);
+    struct CharacterRecord *record = CharacterTable_getByName(db->tables[CHARACTERS], name);
+    Database_unlock(db, CHARACTERS);
+    return record;
 
 error:
     return NULL;
@@ -419,10 +1429,14 @@ enum MorkResult Database_createCharacter(struct Database *db, struct CharacterRe
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (stats == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    struct CharacterTable *table = db->tables[CHARACTERS];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, CHARACTERS);
+    if (res != MORK_OK) { return res; }
+
+    Database_evict(db, CACHE_CHARACTERS, stats->id);
 
-    return CharacterTable_newRow(table, stats);
+    res = CharacterTable_newRow(db->tables[CHARACTERS], stats);
+    Database_unlock(db, CHARACTERS);
+    return res;
 }
 
 enum MorkResult Database_updateCharacter(struct Database *db, struct CharacterRecord *stats)
@@ -430,10 +1444,14 @@ enum MorkResult Database_updateCharacter(struct Database *db, struct CharacterRe
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (stats == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    struct CharacterTable *table = db->tables[CHARACTERS];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, CHARACTERS);
+    if (res != MORK_OK) { return res; }
 
-    return CharacterTable_update(table, stats);
+    Database_evict(db, CACHE_CHARACTERS, stats->id);
+
+    res = CharacterTable_update(db->tables[CHARACTERS], stats);
+    Database_unlock(db, CHARACTERS);
+    return res;
 }
 
 enum MorkResult Database_deleteCharacter(struct Database *db, int id)
@@ -441,21 +1459,25 @@ enum MorkResult Database_deleteCharacter(struct Database *db, int id)
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (id <= 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    struct CharacterTable *table = db->tables[CHARACTERS];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, CHARACTERS);
+    if (res != MORK_OK) { return res; }
+
+    Database_evict(db, CACHE_CHARACTERS, id);
 
-    return CharacterTable_delete(table, id);
+    res = CharacterTable_delete(db->tables[CHARACTERS], id);
+    Database_unlock(db, CHARACTERS);
+    return res;
 }
 
 struct DialogRecord *Database_getDialog(struct Database *db, int id)
 {
     check(db != NULL, "Expected a non-null database.");
     check(id > 0, "Expected a valid ID.");
+    check(Database_readLock(db, DIALOG) == MORK_OK, "Dialog table is not initialized.");
 
-    struct DialogTable *table = db->tables[DIALOG];
-    check(table != NULL, "Dialog table is not initialized.");
-
-    return DialogTable_get(table, id);
+    struct DialogRecord *record = DialogTable_get(db->tables[DIALOG], id);
+    Database_unlock(db, DIALOG);
+    return record;
 
 error:
     return NULL;
@@ -466,10 +1488,12 @@ enum MorkResult Database_createDialog(struct Database *db, struct DialogRecord *
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (dialog == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    struct DialogTable *table = db->tables[DIALOG];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, DIALOG);
+    if (res != MORK_OK) { return res; }
 
-    return DialogTable_newRow(table, dialog);
+    res = DialogTable_newRow(db->tables[DIALOG], dialog);
+    Database_unlock(db, DIALOG);
+    return res;
 }
 
 enum MorkResult Database_updateDialog(struct Database *db, struct DialogRecord *dialog)
@@ -477,10 +1501,12 @@ enum MorkResult Database_updateDialog(struct Database *db, struct DialogRecord *
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (dialog == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    struct DialogTable *table = db->tables[DIALOG];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, DIALOG);
+    if (res != MORK_OK) { return res; }
 
-    return DialogTable_update(table, dialog);
+    res = DialogTable_update(db->tables[DIALOG], dialog);
+    Database_unlock(db, DIALOG);
+    return res;
 }
 
 enum MorkResult Database_deleteDialog(struct Database *db, int id)
@@ -488,21 +1514,23 @@ enum MorkResult Database_deleteDialog(struct Database *db, int id)
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (id <= 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    struct DialogTable *table = db->tables[DIALOG];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, DIALOG);
+    if (res != MORK_OK) { return res; }
 
-    return DialogTable_delete(table, id);
+    res = DialogTable_delete(db->tables[DIALOG], id);
+    Database_unlock(db, DIALOG);
+    return res;
 }
 
 struct ItemRecord *Database_getItem(struct Database *db, int id)
 {
     check(db != NULL, "Expected a non-null database.");
     check(id > 0, "Expected a valid ID.");
+    check(Database_readLock(db, ITEMS) == MORK_OK, "Item table is not initialized.");
 
-    struct ItemTable *table = db->tables[ITEMS];
-    check(table != NULL, "Item table is not initialized.");
-
-    return ItemTable_get(table, id);
+    struct ItemRecord *record = ItemTable_get(db->tables[ITEMS], id);
+    Database_unlock(db, ITEMS);
+    return record;
 
 error:
     return NULL;
@@ -512,11 +1540,11 @@ struct ItemRecord *Database_getItemByName(struct Database *db, char *name)
 {
     check(db != NULL, "Expected a non-null database.");
     check(name != NULL && strcmp(name, "") != 0, "Expected a valid name");
+    check(Database_readLockFor(db, ITEMS, INDEX_NAME) == MORK_OK, "Item table is not initialized.");
 
-    struct ItemTable *table = db->tables[ITEMS];
-    check(table != NULL, "Item table is not initialized.");
-
-    return ItemTable_getByName(table, name);
+    struct ItemRecord *record = ItemTable_getByName(db->tables[ITEMS], name);
+    Database_unlock(db, ITEMS);
+    return record;
 
 error:
     return NULL;
@@ -527,32 +1555,40 @@ enum MorkResult Database_createItem(struct Database *db, struct ItemRecord *item
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (item == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    struct ItemTable *table = db->tables[ITEMS];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, ITEMS);
+    if (res != MORK_OK) { return res; }
 
-    return ItemTable_newRow(table, item);
+    Database_evict(db, CACHE_ITEMS, item->id);
+
+    res = ItemTable_newRow(db->tables[ITEMS], item);
+    Database_unlock(db, ITEMS);
+    return res;
 }
 
 enum MorkResult Database_updateItem(struct Database *db, struct ItemRecord *item)
 {
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (item == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
-    
-    struct ItemTable *table = db->tables[ITEMS];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
 
-    return ItemTable_update(table, item);
+    enum MorkResult res = Database_writeLock(db, ITEMS);
+    if (res != MORK_OK) { return res; }
+
+    Database_evict(db, CACHE_ITEMS, item->id);
+
+    res = ItemTable_update(db->tables[ITEMS], item);
+    Database_unlock(db, ITEMS);
+    return res;
 }
 
 struct DescriptionRecord *Database_getDescription(struct Database *db, int id)
 {
     check(db != NULL, "Expected a non-null database.");
     check(id > 0, "Expected a valid ID.");
+    check(Database_readLock(db, DESCRIPTION) == MORK_OK, "Description table is not initialized.");
 
-    struct DescriptionTable *table = db->tables[DESCRIPTION];
-    check(table != NULL, "Description table is not initialized.");
-
-    return DescriptionTable_get(table, id);
+    struct DescriptionRecord *record = DescriptionTable_get(db->tables[DESCRIPTION], id);
+    Database_unlock(db, DESCRIPTION);
+    return record;
 
 error:
     return NULL;
@@ -562,31 +1598,73 @@ struct DescriptionRecord *Database_getDescriptionByPrefix(struct Database *db, c
 {
     check(db != NULL, "Expected a non-null database.");
     check(prefix != NULL, "Expected a valid prefix");
+    check(Database_readLockFor(db, DESCRIPTION, INDEX_SORTED) == MORK_OK, "Description table is not initialized.");
 
-    struct DescriptionTable *table = db->tables[DESCRIPTION];
-    check(table != NULL, "Description table is not initialized.");
+    struct DescriptionRecord *record = DescriptionTable_get_by_prefix(db->tables[DESCRIPTION], prefix);
+    Database_unlock(db, DESCRIPTION);
+    return record;
+
+error:
+    return NULL;
+}
 
-    return DescriptionTable_get_by_prefix(table, prefix);
+static void Database_descriptionKey(char *key, const char *text)
+{
+    // Compare against the text as a record would store it
+    snprintf(key, MAX_DESCRIPTION, "%s", text);
+}
+
+struct DescriptionRecord *Database_getDescriptionByText(struct Database *db, char *text)
+{
+    check(db != NULL, "Expected a non-null database.");
+    check(text != NULL, "Expected valid text");
+
+    char key[MAX_DESCRIPTION];
+    Database_descriptionKey(key, text);
+
+    check(Database_readLockFor(db, DESCRIPTION, INDEX_NAME) == MORK_OK, "Description table is not initialized.");
+    struct DescriptionRecord *record = DescriptionTable_get_by_text(db->tables[DESCRIPTION], key);
+    Database_unlock(db, DESCRIPTION);
+    return record;
 
 error:
     return NULL;
 }
 
-struct DescriptionRecord *Database_getOrCreateDescription(struct Database *db, char *prefix)
+/**
+ * @brief Intern a description: return the record holding exactly this text,
+ *        creating it if there is none, so identical text is stored once. The
+ *        lookup and the insert happen under one lock, so two threads interning
+ *        the same text get the same record.
+ *
+ * @param db   The database
+ * @param text The description text
+ * @return struct DescriptionRecord*
+ */
+struct DescriptionRecord *Database_getOrCreateDescription(struct Database *db, char *text)
 {
     check(db != NULL, "Expected a non-null database.");
-    check(prefix != NULL, "Expected a valid prefix");
+    check(text != NULL, "Expected valid text");
+
+    char key[MAX_DESCRIPTION];
+    Database_descriptionKey(key, text);
 
+    check(Database_writeLock(db, DESCRIPTION) == MORK_OK, "Description table is not initialized.");
     struct DescriptionTable *table = db->tables[DESCRIPTION];
-    check(table != NULL, "Description table is not initialized.");
 
-    struct DescriptionRecord *desc = DescriptionTable_get_by_prefix(table, prefix);
+    struct DescriptionRecord *desc = DescriptionTable_get_by_text(table, key);
     if (desc == NULL) {
-        desc = DescriptionRecord_create(Database_getNextIndex(db, DESCRIPTION), prefix, 0);
-        enum MorkResult res = Database_createDescription(db, desc);
-        check(res == MORK_OK, "Failed to create description record.");
-        desc = Database_getDescriptionByPrefix(db, prefix);
+        unsigned int id = Database_getNextIndex(db, DESCRIPTION);
+        struct DescriptionRecord *record = DescriptionRecord_create(id, text, 0);
+        if (record != NULL) {
+            if (DescriptionTable_insert(table, record) == MORK_OK) {
+                desc = DescriptionTable_get(table, id);
+            }
+            free(record);
+        }
     }
+    Database_unlock(db, DESCRIPTION);
+    check(desc != NULL, "Failed to create description record.");
 
     return desc;
 
@@ -599,10 +1677,12 @@ enum MorkResult Database_createDescription(struct Database *db, struct Descripti
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (desc == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    struct DescriptionTable *table = db->tables[DESCRIPTION];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, DESCRIPTION);
+    if (res != MORK_OK) { return res; }
 
-    return DescriptionTable_insert(table, desc);
+    res = DescriptionTable_insert(db->tables[DESCRIPTION], desc);
+    Database_unlock(db, DESCRIPTION);
+    return res;
 }
 
 enum MorkResult Database_updateDescription(struct Database *db, struct DescriptionRecord *desc)
@@ -610,10 +1690,12 @@ enum MorkResult Database_updateDescription(struct Database *db, struct Descripti
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (desc == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    struct DescriptionTable *table = db->tables[DESCRIPTION];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, DESCRIPTION);
+    if (res != MORK_OK) { return res; }
 
-    return DescriptionTable_update(table, desc);
+    res = DescriptionTable_update(db->tables[DESCRIPTION], desc);
+    Database_unlock(db, DESCRIPTION);
+    return res;
 }
 
 enum MorkResult Database_deleteDescription(struct Database *db, int id)
@@ -621,38 +1703,68 @@ enum MorkResult Database_deleteDescription(struct Database *db, int id)
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (id <= 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    struct DescriptionTable *table = db->tables[DESCRIPTION];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, DESCRIPTION);
+    if (res != MORK_OK) { return res; }
 
-    return DescriptionTable_delete(table, id);
+    res = DescriptionTable_delete(db->tables[DESCRIPTION], id);
+    Database_unlock(db, DESCRIPTION);
+    return res;
 }
 
 struct InventoryRecord *Database_getInventory(struct Database *db, int id)
 {
     check(db != NULL, "Expected a non-null database.");
     check(id > 0, "Expected a valid ID.");
+    check(Database_readLock(db, INVENTORY) == MORK_OK, "Inventory table is not initialized.");
 
-    struct InventoryTable *table = db->tables[INVENTORY];
-    check(table != NULL, "Inventory table is not initialized.");
-
-    return InventoryTable_get(table, id);
+    struct InventoryRecord *record = InventoryTable_get(db->tables[INVENTORY], id);
+    Database_unlock(db, INVENTORY);
+    return record;
 
 error:
     return NULL;
 }
 
+/**
+ * @brief Copy the inventory of a character out of its table. The owner is
+ *        copied too, so neither row is read after its lock is released.
+ *
+ * @param db    The database
+ * @param owner The owner's name
+ * @param out   Receives the inventory
+ * @return enum MorkResult
+ */
+static enum MorkResult Database_copyInventoryByOwner(struct Database *db, const char *owner, struct InventoryRecord *out)
+{
+    struct CharacterRecord owner_record;
+    enum MorkResult res = Database_copyByName(db, CHARACTERS, owner, &owner_record);
+    if (res != MORK_OK) { return res; }
+
+    res = Database_readLockFor(db, INVENTORY, INDEX_KEY);
+    if (res != MORK_OK) { return res; }
+
+    struct InventoryRecord *record = InventoryTable_getByOwner(db->tables[INVENTORY], owner_record.id);
+    if (record == NULL) {
+        res = MORK_ERROR_DB_NOT_FOUND;
+    } else {
+        *out = *record;
+    }
+    Database_unlock(db, INVENTORY);
+    return res;
+}
+
 struct InventoryRecord *Database_getInventoryByOwner(struct Database *db, char *owner)
 {
     check(db != NULL, "Expected a non-null database.");
     check(owner != NULL && strcmp(owner, "") != 0, "Expected a valid owner.");
 
-    struct InventoryTable *table = db->tables[INVENTORY];
-    check(table != NULL, "Inventory table is not initialized.");
+    struct CharacterRecord owner_record;
+    check(Database_copyByName(db, CHARACTERS, owner, &owner_record) == MORK_OK, "Character stats record not found.");
 
-    struct CharacterRecord *owner_record = Database_getCharacterByName(db, owner);
-    check(owner_record != NULL, "Character stats record not found.");
-
-    return InventoryTable_getByOwner(table, owner_record->id);
+    check(Database_readLockFor(db, INVENTORY, INDEX_KEY) == MORK_OK, "Inventory table is not initialized.");
+    struct InventoryRecord *record = InventoryTable_getByOwner(db->tables[INVENTORY], owner_record.id);
+    Database_unlock(db, INVENTORY);
+    return record;
 
 error:
     return NULL;
@@ -663,13 +1775,16 @@ enum MorkResult Database_createInventory(struct Database *db, char *owner)
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (owner == NULL || strcmp(owner, "") == 0) { return MORK_ERROR_DB_INVALID_DATA; }
 
-    struct InventoryTable *table = db->tables[INVENTORY];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    struct CharacterRecord owner_record;
+    enum MorkResult res = Database_copyByName(db, CHARACTERS, owner, &owner_record);
+    if (res != MORK_OK) { return res; }
 
-    struct CharacterRecord *owner_record = Database_getCharacterByName(db, owner);
-    if (owner_record == NULL) { return MORK_ERROR_DB_NOT_FOUND; }
+    res = Database_writeLock(db, INVENTORY);
+    if (res != MORK_OK) { return res; }
 
-    return InventoryTable_add(table, owner_record->id, Database_getNextIndex(db, INVENTORY));
+    res = InventoryTable_add(db->tables[INVENTORY], owner_record.id, Database_getNextIndex(db, INVENTORY));
+    Database_unlock(db, INVENTORY);
+    return res;
 }
 
 enum MorkResult Database_updateInventory(struct Database *db, struct InventoryRecord *record)
@@ -677,10 +1792,12 @@ enum MorkResult Database_updateInventory(struct Database *db, struct InventoryRe
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (record == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    struct InventoryTable *table = db->tables[INVENTORY];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, INVENTORY);
+    if (res != MORK_OK) { return res; }
 
-    return InventoryTable_update(table, record);
+    res = InventoryTable_update(db->tables[INVENTORY], record);
+    Database_unlock(db, INVENTORY);
+    return res;
 }
 
 enum MorkResult Database_deleteInventory(struct Database *db, int id)
@@ -688,26 +1805,30 @@ enum MorkResult Database_deleteInventory(struct Database *db, int id)
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (id <= 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    struct InventoryTable *table = db->tables[INVENTORY];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, INVENTORY);
+    if (res != MORK_OK) { return res; }
 
-    return InventoryTable_remove(table, id);
+    res = InventoryTable_remove(db->tables[INVENTORY], id);
+    Database_unlock(db, INVENTORY);
+    return res;
 }
 
 struct ItemRecord **Database_getItemsInInventory(struct Database *db, char *owner)
 {
     check(db != NULL, "Expected a non-null database.");
 
-    struct InventoryRecord *inventory = Database_getInventoryByOwner(db, owner);
-    check(inventory != NULL, "Inventory record not found.");
+    check(owner != NULL && strcmp(owner, "") != 0, "Expected a valid owner.");
+
+    // Work from a copy, so the items are read without holding the inventory
+    struct InventoryRecord inventory;
+    check(Database_copyInventoryByOwner(db, owner, &inventory) == MORK_OK, "Inventory record not found.");
 
-    struct ItemRecord **items = calloc(InventoryRecord_getItemCount(inventory), sizeof(struct ItemRecord *));
+    struct ItemRecord **items = calloc(InventoryRecord_getItemCount(&inventory), sizeof(struct ItemRecord *));
     check_mem(items);
 
-    for (int i = 0; i < InventoryRecord_getItemCount(inventory); i++)
+    for (int i = 0; i < InventoryRecord_getItemCount(&inventory); i++)
     {
-        if (inventory->item_ids[i] == 0) { continue; }
-        items[i] = Database_getItem(db, inventory->item_ids[i]);
+        items[i] = Database_getItem(db, inventory.item_ids[i]);
     }
 
     return items;
@@ -721,21 +1842,25 @@ enum MorkResult Database_deleteItem(struct Database *db, int id)
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (id <= 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    struct ItemTable *table = db->tables[ITEMS];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, ITEMS);
+    if (res != MORK_OK) { return res; }
 
-    return ItemTable_delete(table, id);
+    Database_evict(db, CACHE_ITEMS, id);
+
+    res = ItemTable_delete(db->tables[ITEMS], id);
+    Database_unlock(db, ITEMS);
+    return res;
 }
 
 struct LocationRecord *Database_getLocation(struct Database *db, int id)
 {
     check(db != NULL, "Expected a non-null database.");
     check(id > 0, "Expected a valid ID.");
+    check(Database_readLock(db, LOCATIONS) == MORK_OK, "Location table is not initialized.");
 
-    struct LocationTable *table = db->tables[LOCATIONS];
-    check(table != NULL, "Location table is not initialized.");
-
-    return LocationTable_get(table, id);
+    struct LocationRecord *record = LocationTable_get(db->tables[LOCATIONS], id);
+    Database_unlock(db, LOCATIONS);
+    return record;
 
 error:
     return NULL;
@@ -745,11 +1870,11 @@ struct LocationRecord *Database_getLocationByName(struct Database *db, char *nam
 {
     check(db != NULL, "Expected a non-null database.");
     check(name != NULL && strcmp(name, "") != 0, "Expected a valid name.");
+    check(Database_readLockFor(db, LOCATIONS, INDEX_NAME) == MORK_OK, "Location table is not initialized.");
 
-    struct LocationTable *table = db->tables[LOCATIONS];
-    check(table != NULL, "Location table is not initialized.");
-
-    return LocationTable_getByName(table, name);
+    struct LocationRecord *record = LocationTable_getByName(db->tables[LOCATIONS], name);
+    Database_unlock(db, LOCATIONS);
+    return record;
 
 error:
     return NULL;
@@ -760,10 +1885,14 @@ enum MorkResult Database_createLocation(struct Database *db, struct LocationReco
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (location == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    struct LocationTable *table = db->tables[LOCATIONS];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, LOCATIONS);
+    if (res != MORK_OK) { return res; }
+
+    Database_evict(db, CACHE_LOCATIONS, location->id);
 
-    return LocationTable_add(table, location);
+    res = LocationTable_add(db->tables[LOCATIONS], location);
+    Database_unlock(db, LOCATIONS);
+    return res;
 }
 
 enum MorkResult Database_updateLocation(struct Database *db, struct LocationRecord *location)
@@ -771,10 +1900,14 @@ enum MorkResult Database_updateLocation(struct Database *db, struct LocationReco
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (location == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    struct LocationTable *table = db->tables[LOCATIONS];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, LOCATIONS);
+    if (res != MORK_OK) { return res; }
+
+    Database_evict(db, CACHE_LOCATIONS, location->id);
 
-    return LocationTable_update(table, location);
+    res = LocationTable_update(db->tables[LOCATIONS], location);
+    Database_unlock(db, LOCATIONS);
+    return res;
 }
 
 enum MorkResult Database_deleteLocation(struct Database *db, int id)
@@ -782,21 +1915,96 @@ enum MorkResult Database_deleteLocation(struct Database *db, int id)
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (id <= 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    struct LocationTable *table = db->tables[LOCATIONS];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, LOCATIONS);
+    if (res != MORK_OK) { return res; }
+
+    Database_evict(db, CACHE_LOCATIONS, id);
+
+    res = LocationTable_remove(db->tables[LOCATIONS], id);
+    Database_unlock(db, LOCATIONS);
+    return res;
+}
+
+/**
+ * @brief Copy a room, or the room one of its exits leads to, out of the room
+ *        graph while the tables it was built from are locked.
+ */
+static enum MorkResult Database_copyRoomNode(struct Database *db, int id, int direction, struct Room *out)
+{
+    if (db == NULL) { return MORK_ERROR_DB_NULL; }
+    if (id <= 0) { return MORK_ERROR_DB_INVALID_ID; }
+    if (out == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
+
+    enum MorkResult res = Database_readLock(db, DESCRIPTION);
+    if (res != MORK_OK) { return res; }
+    res = Database_readLockFor(db, LOCATIONS, INDEX_HOT);
+    if (res != MORK_OK) {
+        Database_unlock(db, DESCRIPTION);
+        return res;
+    }
+
+    pthread_mutex_lock(&db->rooms_lock);
+    if (db->rooms->built != 1) {
+        res = RoomGraph_build(db->rooms, db->tables[LOCATIONS], db->tables[DESCRIPTION]);
+    }
+    if (res == MORK_OK) {
+        const struct RoomNode *node = RoomGraph_get(db->rooms, id);
+        if (node != NULL && direction >= 0) { node = RoomGraph_exit(db->rooms, node, direction); }
+        if (node == NULL) {
+            res = MORK_ERROR_DB_NOT_FOUND;
+        } else {
+            // The node and its description text only hold while the locks do
+            RoomGraph_copy(db->rooms, node, out);
+        }
+    } else {
+        log_err("Failed to build room graph.");
+    }
+    pthread_mutex_unlock(&db->rooms_lock);
 
-    return LocationTable_remove(table, id);
+    Database_unlock(db, LOCATIONS);
+    Database_unlock(db, DESCRIPTION);
+    return res;
+}
+
+/**
+ * @brief Copy a location's node out of the room graph, building the graph if
+ *        the location or description tables changed since it was last built.
+ *        Only ids, exits and description text are read; no model is loaded.
+ *
+ * @param db  The database
+ * @param id  The location id
+ * @param out Where the room goes
+ * @return enum MorkResult MORK_ERROR_DB_NOT_FOUND if there is no such location
+ */
+enum MorkResult Database_copyRoom(struct Database *db, int id, struct Room *out)
+{
+    return Database_copyRoomNode(db, id, -1, out);
+}
+
+/**
+ * @brief Copy out the room an exit of a location leads to.
+ *
+ * @param db        The database
+ * @param id        The location id
+ * @param direction Which exit, in ExitDirection order
+ * @param out       Where the neighbour goes
+ * @return enum MorkResult MORK_ERROR_DB_NOT_FOUND if there is no exit that way
+ */
+enum MorkResult Database_copyRoomExit(struct Database *db, int id, int direction, struct Room *out)
+{
+    if (direction < 0 || direction >= MAX_EXITS) { return MORK_ERROR_DB_NOT_FOUND; }
+    return Database_copyRoomNode(db, id, direction, out);
 }
 
 struct GameRecord *Database_getGame(struct Database *db, int id)
 {
     check(db != NULL, "Expected a non-null database.");
     check(id > 0, "Expected a valid ID.");
+    check(Database_readLock(db, GAMES) == MORK_OK, "Game table is not initialized.");
 
-    struct GameTable *table = db->tables[GAMES];
-    check(table != NULL, "Game table is not initialized.");
-
-    return GameTable_get(table, id);
+    struct GameRecord *record = GameTable_get(db->tables[GAMES], id);
+    Database_unlock(db, GAMES);
+    return record;
 
 error:
     return NULL;
@@ -807,10 +2015,12 @@ enum MorkResult Database_createGame(struct Database *db, struct GameRecord *game
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (game == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    struct GameTable *table = db->tables[GAMES];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, GAMES);
+    if (res != MORK_OK) { return res; }
 
-    return GameTable_insert(table, game);
+    res = GameTable_insert(db->tables[GAMES], game);
+    Database_unlock(db, GAMES);
+    return res;
 }
 
 enum MorkResult Database_updateGame(struct Database *db, struct GameRecord *game)
@@ -818,10 +2028,12 @@ enum MorkResult Database_updateGame(struct Database *db, struct GameRecord *game
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (game == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    struct GameTable *table = db->tables[GAMES];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, GAMES);
+    if (res != MORK_OK) { return res; }
 
-    return GameTable_update(table, game);
+    res = GameTable_update(db->tables[GAMES], game);
+    Database_unlock(db, GAMES);
+    return res;
 }
 
 enum MorkResult Database_deleteGame(struct Database *db, int id)
@@ -829,8 +2041,10 @@ enum MorkResult Database_deleteGame(struct Database *db, int id)
     if (db == NULL) { return MORK_ERROR_DB_NULL; }
     if (id <= 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    struct GameTable *table = db->tables[GAMES];
-    if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    enum MorkResult res = Database_writeLock(db, GAMES);
+    if (res != MORK_OK) { return res; }
 
-    return GameTable_delete(table, id);
+    res = GameTable_delete(db->tables[GAMES], id);
+    Database_unlock(db, GAMES);
+    return res;
 }
@@ -19,6 +19,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include "../utils/error.h"
+#include "cache.h"
+#include "flush.h"
 
 #include "tables/character.h"
 #include "tables/description.h"
@@ -27,6 +29,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "tables/inventory.h"
 #include "tables/items.h"
 #include "tables/location.h"
+#include <pthread.h>
 #include <stdio.h>
 
 // In Mork, we have Models and Records that back them.
@@ -46,29 +49,94 @@ enum Table {
     LOCATIONS
 };
 
+// How the open file lays out its rows. New files are compact; fixed files
+// (full-size row arrays at fixed offsets) are still read and written in
+// place, and are the only layout that can be mapped.
+enum DatabaseFormat {
+    DB_FORMAT_COMPACT = 0,
+    DB_FORMAT_FIXED
+};
+
+struct ModelCache;
+struct RoomGraph;
+struct Room;
+struct Wal;
+struct IoEngine;
+
+// Locking: every table has a reader-writer lock. Record getters take it
+// shared and setters take it exclusive, so any number of threads can read
+// while others write to different tables. A getter's pointer points into
+// the table and is only stable while the caller holds the table's lock (see
+// Database_readLock); Database_copy hands back a private copy instead.
+// Locks are only ever nested in enum Table order. Opening, closing and
+// creating the file, and the table-level ops, are not locked and must not
+// overlap anything else; flush and commit are safe to call at any time. The
+// file itself is written by the flusher's thread (see flush.h), which only
+// ever works from snapshots, so it never takes the table locks. The
+// model cache and the room graph are only guarded where the database itself
+// touches them; the models loaded from them belong to one thread at a time.
+
 struct Database {
     unsigned char initialized;
+    unsigned char format; // enum DatabaseFormat of the open file
+    unsigned char compress_text; // Compact files store the text tables compressed (on by default)
     FILE *file;
+    char *path;         // Path given to Database_open
+    struct Wal *wal;    // Changes since the file was last checkpointed
+    struct ModelCache *cache; // Models loaded from the rows, by id
+    struct RoomGraph *rooms;  // Exits between locations, built on first use
+    int fd;             // Backing file when opened with Database_openMapped
+    unsigned char *map; // The whole file, mapped shared
+    size_t map_size;
     void *tables[MAX_TABLES];
-    unsigned int table_index_counters[MAX_TABLES];
+    unsigned int table_index_counters[MAX_TABLES]; // Next id to hand out, atomic
+
+    pthread_rwlock_t locks[MAX_TABLES];
+    pthread_mutex_t tables_lock; // Creating a missing table
+    pthread_mutex_t wal_lock;    // Appending to the log
+    pthread_mutex_t commit_lock; // Writing the log; taken before wal_lock
+    pthread_mutex_t rooms_lock;  // Building and invalidating the room graph
+    pthread_mutex_t cache_lock;  // Every use of the model cache
+
+    struct Flusher *flusher;     // Writes snapshots of the tables to the file
+    unsigned char flush_failed;  // Set by the flusher when a write fails, atomic
+    struct IoEngine *io;         // Batched reads and writes of a fixed file
 };
 
 struct Database *Database_create();
 enum MorkResult Database_createFile(struct Database *db, const char *path);
 enum MorkResult Database_open(struct Database *db, const char *path);
+enum MorkResult Database_openMapped(struct Database *db, const char *path);
 enum MorkResult Database_close(struct Database *db);
 enum MorkResult Database_flush(struct Database *db);
+struct FlushHandle *Database_flushAsync(struct Database *db, FlushHandle_callback callback, void *ctx);
+enum MorkResult Database_seal(struct Database *db);
+enum MorkResult Database_commitSealed(struct Database *db);
+enum MorkResult Database_commit(struct Database *db);
 enum MorkResult Database_destroy(struct Database *db);
 
 // Table-level ops
 void *Database_get(struct Database *db, enum Table table);
 enum MorkResult Database_set(struct Database *db, enum Table table, void *data);
 enum MorkResult Database_write(struct Database *db, enum Table table);
+enum MorkResult Database_writeDirty(struct Database *db, enum Table table);
 enum MorkResult Database_delete(struct Database *db, enum Table table);
 enum MorkResult Database_print(struct Database *db, enum Table table);
 
 unsigned int Database_getNextIndex(struct Database *db, enum Table table);
 
+enum MorkResult Database_readLock(struct Database *db, enum Table table);
+enum MorkResult Database_readLockFor(struct Database *db, enum Table table, enum TableIndex index);
+enum MorkResult Database_writeLock(struct Database *db, enum Table table);
+enum MorkResult Database_unlock(struct Database *db, enum Table table);
+enum MorkResult Database_copy(struct Database *db, enum Table table, int id, void *out);
+enum MorkResult Database_copyByName(struct Database *db, enum Table table, const char *name, void *out);
+
+// Models loaded from the rows, shared by every thread
+void *Database_cacheGet(struct Database *db, enum CacheKind kind, unsigned int id, ModelCache_retainFn retain);
+enum MorkResult Database_cachePut(struct Database *db, enum CacheKind kind, unsigned int id, void *model,
+                                  ModelCache_releaseFn release);
+
 // Record-level ops (setters return index of record in table)
 struct CharacterRecord *Database_getCharacter(struct Database *db, int id);
 struct CharacterRecord *Database_getCharacterByName(struct Database *db, char *name);
@@ -78,7 +146,8 @@ enum MorkResult Database_deleteCharacter(struct Database *db, int id);
 
 struct DescriptionRecord *Database_getDescription(struct Database *db, int id);
 struct DescriptionRecord *Database_getDescriptionByPrefix(struct Database *db, char *prefix);
-struct DescriptionRecord *Database_getOrCreateDescription(struct Database *db, char *prefix);
+struct DescriptionRecord *Database_getDescriptionByText(struct Database *db, char *text);
+struct DescriptionRecord *Database_getOrCreateDescription(struct Database *db, char *text);
 enum MorkResult Database_createDescription(struct Database *db, struct DescriptionRecord *description);
 enum MorkResult Database_updateDescription(struct Database *db, struct DescriptionRecord *description);
 enum MorkResult Database_deleteDescription(struct Database *db, int id);
@@ -107,6 +176,8 @@ struct LocationRecord *Database_getLocationByName(struct Database *db, char *nam
 enum MorkResult Database_createLocation(struct Database *db, struct LocationRecord *location);
 enum MorkResult Database_updateLocation(struct Database *db, struct LocationRecord *location);
 enum MorkResult Database_deleteLocation(struct Database *db, int id);
+enum MorkResult Database_copyRoom(struct Database *db, int id, struct Room *out);
+enum MorkResult Database_copyRoomExit(struct Database *db, int id, int direction, struct Room *out);
 
 struct GameRecord *Database_getGame(struct Database *db, int id);
 enum MorkResult Database_createGame(struct Database *db, struct GameRecord *game);
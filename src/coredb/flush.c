@@ -0,0 +1,250 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "flush.h"
+
+#include <lcthw/dbg.h>
+#include <stdlib.h>
+
+/**
+ * @brief Start a flush handle. It holds one reference for the caller.
+ *
+ * @param owner    The database the flush belongs to
+ * @param callback Called with the result once the flush is done, or NULL
+ * @param ctx      Passed through to callback
+ * @return struct FlushHandle*
+ */
+struct FlushHandle *FlushHandle_create(void *owner, FlushHandle_callback callback, void *ctx)
+{
+    struct FlushHandle *handle = calloc(1, sizeof(struct FlushHandle));
+    check_mem(handle);
+    handle->refs = 1;
+    handle->result = MORK_OK;
+    handle->owner = owner;
+    handle->callback = callback;
+    handle->ctx = ctx;
+    return handle;
+
+error:
+    return NULL;
+}
+
+static void FlushHandle_free(struct FlushHandle *handle)
+{
+    for (unsigned int i = 0; i < handle->range_count; i++) {
+        free(handle->ranges[i].data);
+    }
+    free(handle->ranges);
+    if (handle->rows) { handle->free_rows(handle->rows); }
+    free(handle->image);
+    free(handle);
+}
+
+/**
+ * @brief Block until the flush is on disk (or has failed).
+ *
+ * @param handle The flush
+ * @return enum MorkResult The flush's result
+ */
+enum MorkResult FlushHandle_wait(struct FlushHandle *handle)
+{
+    if (handle == NULL) { return MORK_ERROR_DB_NULL; }
+    if (handle->flusher == NULL) { return handle->result; }
+
+    pthread_mutex_lock(&handle->flusher->lock);
+    while (!handle->done) {
+        pthread_cond_wait(&handle->flusher->finished, &handle->flusher->lock);
+    }
+    enum MorkResult result = handle->result;
+    pthread_mutex_unlock(&handle->flusher->lock);
+    return result;
+}
+
+/**
+ * @brief Check whether the flush has finished, without blocking.
+ */
+int FlushHandle_isDone(struct FlushHandle *handle)
+{
+    if (handle == NULL) { return 1; }
+    if (handle->flusher == NULL) { return handle->done; }
+
+    pthread_mutex_lock(&handle->flusher->lock);
+    int done = handle->done;
+    pthread_mutex_unlock(&handle->flusher->lock);
+    return done;
+}
+
+/**
+ * @brief Drop the caller's reference. The flush carries on regardless.
+ */
+void FlushHandle_release(struct FlushHandle *handle)
+{
+    if (handle == NULL) { return; }
+
+    unsigned int refs;
+    if (handle->flusher) { pthread_mutex_lock(&handle->flusher->lock); }
+    refs = --handle->refs;
+    if (handle->flusher) { pthread_mutex_unlock(&handle->flusher->lock); }
+    if (refs == 0) { FlushHandle_free(handle); }
+}
+
+static void *Flusher_loop(void *arg)
+{
+    struct Flusher *flusher = arg;
+
+    pthread_mutex_lock(&flusher->lock);
+    for (;;) {
+        while (flusher->head == NULL && !flusher->stopping) {
+            pthread_cond_wait(&flusher->wake, &flusher->lock);
+        }
+        if (flusher->head == NULL) { break; }
+
+        struct FlushHandle *handle = flusher->head;
+        flusher->head = handle->next;
+        if (flusher->head == NULL) { flusher->tail = NULL; }
+        pthread_mutex_unlock(&flusher->lock);
+
+        Flusher_finish(flusher, handle, handle->run(handle));
+
+        pthread_mutex_lock(&flusher->lock);
+    }
+    pthread_mutex_unlock(&flusher->lock);
+    return NULL;
+}
+
+struct Flusher *Flusher_create()
+{
+    struct Flusher *flusher = calloc(1, sizeof(struct Flusher));
+    check_mem(flusher);
+    check(pthread_mutex_init(&flusher->lock, NULL) == 0, "Failed to create flusher lock");
+    check(pthread_cond_init(&flusher->wake, NULL) == 0, "Failed to create flusher condition");
+    check(pthread_cond_init(&flusher->finished, NULL) == 0, "Failed to create flusher condition");
+    return flusher;
+
+error:
+    free(flusher);
+    return NULL;
+}
+
+/**
+ * @brief Finish everything queued, stop the I/O thread and free the flusher.
+ */
+void Flusher_destroy(struct Flusher *flusher)
+{
+    if (flusher == NULL) { return; }
+
+    pthread_mutex_lock(&flusher->lock);
+    flusher->stopping = 1;
+    pthread_cond_signal(&flusher->wake);
+    pthread_mutex_unlock(&flusher->lock);
+    if (flusher->running) { pthread_join(flusher->thread, NULL); }
+
+    pthread_mutex_destroy(&flusher->lock);
+    pthread_cond_destroy(&flusher->wake);
+    pthread_cond_destroy(&flusher->finished);
+    free(flusher);
+}
+
+/**
+ * @brief Record a flush's result, tell whoever is waiting and drop the
+ *        queue's reference. Also used for flushes that never reach the queue.
+ *
+ * @param flusher The flusher, or NULL if the handle was never queued
+ * @param handle  The flush
+ * @param result  How it went
+ */
+void Flusher_finish(struct Flusher *flusher, struct FlushHandle *handle, enum MorkResult result)
+{
+    if (handle->callback) { handle->callback(handle->ctx, result); }
+
+    if (flusher == NULL) {
+        handle->result = result;
+        handle->done = 1;
+        return;
+    }
+
+    pthread_mutex_lock(&flusher->lock);
+    handle->result = result;
+    handle->done = 1;
+    unsigned int refs = --handle->refs;
+    flusher->outstanding--;
+    pthread_cond_broadcast(&flusher->finished);
+    pthread_mutex_unlock(&flusher->lock);
+    if (refs == 0) { FlushHandle_free(handle); }
+}
+
+/**
+ * @brief Queue a flush for the I/O thread, starting it on first use.
+ *
+ * @param flusher The flusher
+ * @param handle  The flush, with its snapshot and run function filled in
+ * @return enum MorkResult
+ */
+enum MorkResult Flusher_submit(struct Flusher *flusher, struct FlushHandle *handle)
+{
+    if (flusher == NULL) { return MORK_ERROR_DB_NULL; }
+    if (handle == NULL || handle->run == NULL) { return MORK_ERROR_DB_INVALID_DATA; }
+
+    pthread_mutex_lock(&flusher->lock);
+    if (!flusher->running) {
+        if (pthread_create(&flusher->thread, NULL, Flusher_loop, flusher) != 0) {
+            pthread_mutex_unlock(&flusher->lock);
+            return MORK_ERROR_DB;
+        }
+        flusher->running = 1;
+    }
+
+    handle->flusher = flusher;
+    handle->refs++;
+    handle->next = NULL;
+    if (flusher->tail) {
+        flusher->tail->next = handle;
+    } else {
+        flusher->head = handle;
+    }
+    flusher->tail = handle;
+    flusher->outstanding++;
+    pthread_cond_signal(&flusher->wake);
+    pthread_mutex_unlock(&flusher->lock);
+    return MORK_OK;
+}
+
+/**
+ * @brief Count the flushes queued or being written.
+ */
+unsigned int Flusher_outstanding(struct Flusher *flusher)
+{
+    if (flusher == NULL) { return 0; }
+    pthread_mutex_lock(&flusher->lock);
+    unsigned int outstanding = flusher->outstanding;
+    pthread_mutex_unlock(&flusher->lock);
+    return outstanding;
+}
+
+/**
+ * @brief Block until every queued flush has finished.
+ */
+void Flusher_drain(struct Flusher *flusher)
+{
+    if (flusher == NULL) { return; }
+    pthread_mutex_lock(&flusher->lock);
+    while (flusher->outstanding > 0) {
+        pthread_cond_wait(&flusher->finished, &flusher->lock);
+    }
+    pthread_mutex_unlock(&flusher->lock);
+}
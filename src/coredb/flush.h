@@ -0,0 +1,90 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../utils/error.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Background writes. A flush takes a snapshot of whatever needs writing while
+// the tables are locked, then hands it to one I/O thread per database and
+// returns. The thread works through the snapshots in the order they were
+// taken, so the file never goes back in time. A handle lets the caller wait
+// for, poll or be called back about its flush; callbacks run on the I/O
+// thread and must not call back into the database. Handles must be released
+// before the database is destroyed.
+
+typedef void (*FlushHandle_callback)(void *ctx, enum MorkResult result);
+
+struct FlushHandle;
+typedef enum MorkResult (*FlushHandle_runFn)(struct FlushHandle *handle);
+
+// A run of bytes to put at an offset in the file. data is NULL when the
+// bytes already live in the file's mapping and only need syncing.
+struct FlushRange {
+    size_t offset;
+    size_t len;
+    unsigned char *data;
+};
+
+struct FlushHandle {
+    struct FlushHandle *next; // In the I/O thread's queue
+    struct Flusher *flusher;  // Set once queued; guards refs and done
+    unsigned int refs;        // The caller's and the queue's
+    unsigned char done;
+    enum MorkResult result;
+
+    FlushHandle_runFn run;
+    void *owner;              // The database the snapshot was taken from
+    void *rows;               // Rows copied under the locks, encoded by run
+    void (*free_rows)(void *rows);
+    unsigned char *image;     // A whole file, for formats rewritten in full
+    size_t image_len;
+    struct FlushRange *ranges;
+    unsigned int range_count;
+    size_t wal_size;          // Log bytes the snapshot covers
+
+    FlushHandle_callback callback;
+    void *ctx;
+};
+
+struct Flusher {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;      // Work was queued, or it is time to stop
+    pthread_cond_t finished;  // A flush finished
+    pthread_t thread;
+    unsigned char running;
+    unsigned char stopping;
+    struct FlushHandle *head;
+    struct FlushHandle *tail;
+    unsigned int outstanding; // Queued or being written
+};
+
+struct FlushHandle *FlushHandle_create(void *owner, FlushHandle_callback callback, void *ctx);
+enum MorkResult FlushHandle_wait(struct FlushHandle *handle);
+int FlushHandle_isDone(struct FlushHandle *handle);
+void FlushHandle_release(struct FlushHandle *handle);
+
+struct Flusher *Flusher_create();
+void Flusher_destroy(struct Flusher *flusher);
+void Flusher_finish(struct Flusher *flusher, struct FlushHandle *handle, enum MorkResult result);
+enum MorkResult Flusher_submit(struct Flusher *flusher, struct FlushHandle *handle);
+unsigned int Flusher_outstanding(struct Flusher *flusher);
+void Flusher_drain(struct Flusher *flusher);
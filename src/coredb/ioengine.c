@@ -0,0 +1,344 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ioengine.h"
+
+#include <errno.h>
+#include <lcthw/dbg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define MORK_HAVE_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+// Requests in flight at once; a bigger batch goes through in several rounds
+#define IO_RING_DEPTH 64
+#define IO_RING_MAX_LEN (1u << 30)
+
+/**
+ * @brief Do one request with plain pread or pwrite, picking up after the
+ *        first done bytes. Short transfers are retried; running into the end
+ *        of the file on a read is an error, since tables have fixed sizes.
+ */
+static enum MorkResult IoEngine_runSync(int fd, const struct IoRequest *req, size_t done)
+{
+    while (done < req->len) {
+        unsigned char *at = (unsigned char *)req->buf + done;
+        ssize_t n = req->write ? pwrite(fd, at, req->len - done, req->offset + (off_t)done)
+                               : pread(fd, at, req->len - done, req->offset + (off_t)done);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n < 0) { return req->write ? MORK_ERROR_DB_FILE_WRITE : MORK_ERROR_DB_FILE_READ; }
+        if (n == 0) { return req->write ? MORK_ERROR_DB_FILE_WRITE : MORK_ERROR_DB_FILE_READ; }
+        done += (size_t)n;
+    }
+    return MORK_OK;
+}
+
+#ifdef MORK_HAVE_URING
+
+struct IoRing {
+    int fd;
+    unsigned int entries;
+
+    unsigned char *sq_map;
+    size_t sq_len;
+    unsigned char *cq_map; // The same as sq_map when the kernel shares them
+    size_t cq_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static void IoRing_destroy(struct IoRing *ring)
+{
+    if (ring == NULL) { return; }
+    if (ring->sqes && ring->sqes != MAP_FAILED) { munmap(ring->sqes, ring->sqes_len); }
+    if (ring->cq_map && ring->cq_map != MAP_FAILED && ring->cq_map != ring->sq_map) { munmap(ring->cq_map, ring->cq_len); }
+    if (ring->sq_map && ring->sq_map != MAP_FAILED) { munmap(ring->sq_map, ring->sq_len); }
+    if (ring->fd >= 0) { close(ring->fd); }
+    free(ring);
+}
+
+/**
+ * @brief Set up a ring and map its queues. Returns NULL, quietly, when the
+ *        kernel has no io_uring or does not let this process use it.
+ */
+static struct IoRing *IoRing_create(unsigned int entries)
+{
+    struct IoRing *ring = calloc(1, sizeof(struct IoRing));
+    if (ring == NULL) { return NULL; }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) { goto error; }
+    ring->entries = params.sq_entries;
+
+    ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && ring->cq_len > ring->sq_len) { ring->sq_len = ring->cq_len; }
+
+    ring->sq_map = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) { goto error; }
+    if (single) {
+        ring->cq_map = ring->sq_map;
+    } else {
+        ring->cq_map = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED) { goto error; }
+    }
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) { goto error; }
+
+    ring->sq_head = (unsigned int *)(ring->sq_map + params.sq_off.head);
+    ring->sq_tail = (unsigned int *)(ring->sq_map + params.sq_off.tail);
+    ring->sq_mask = (unsigned int *)(ring->sq_map + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(ring->sq_map + params.sq_off.array);
+    ring->cq_head = (unsigned int *)(ring->cq_map + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(ring->cq_map + params.cq_off.tail);
+    ring->cq_mask = (unsigned int *)(ring->cq_map + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(ring->cq_map + params.cq_off.cqes);
+    return ring;
+
+error:
+    IoRing_destroy(ring);
+    return NULL;
+}
+
+/**
+ * @brief Run a batch through the ring: fill the submission queue, enter the
+ *        kernel once to submit and wait, and reap the completions. Anything
+ *        the kernel leaves short, or refuses outright (an old kernel without
+ *        plain read and write ops), is finished with pread or pwrite.
+ *        MORK_ERROR_DB means the ring itself failed and cannot be used again.
+ */
+static enum MorkResult IoRing_run(struct IoRing *ring, int fd, struct IoRequest *reqs, unsigned int count)
+{
+    enum MorkResult res = MORK_OK;
+
+    for (unsigned int first = 0; first < count; first += ring->entries) {
+        unsigned int batch = count - first < ring->entries ? count - first : ring->entries;
+
+        unsigned int tail = *ring->sq_tail;
+        for (unsigned int i = 0; i < batch; i++) {
+            struct IoRequest *req = &reqs[first + i];
+            unsigned int slot = tail & *ring->sq_mask;
+            struct io_uring_sqe *sqe = &ring->sqes[slot];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = req->write ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->addr = (unsigned long)req->buf;
+            // Anything past what one op can carry is finished as a short transfer
+            sqe->len = req->len > IO_RING_MAX_LEN ? IO_RING_MAX_LEN : (unsigned int)req->len;
+            sqe->off = (unsigned long long)req->offset;
+            sqe->user_data = first + i;
+            ring->sq_array[slot] = slot;
+            tail++;
+        }
+        __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+        unsigned int submitted = 0;
+        unsigned int completed = 0;
+        while (completed < batch) {
+            long n = syscall(__NR_io_uring_enter, ring->fd, batch - submitted, batch - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n < 0) { return MORK_ERROR_DB; }
+            submitted += (unsigned int)n;
+
+            unsigned int head = *ring->cq_head;
+            unsigned int ready = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != ready; head++) {
+                struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+                struct IoRequest *req = &reqs[cqe->user_data];
+                enum MorkResult done = MORK_OK;
+                if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP || cqe->res == -EINTR || cqe->res == -EAGAIN) {
+                    done = IoEngine_runSync(fd, req, 0);
+                } else if (cqe->res < 0) {
+                    done = req->write ? MORK_ERROR_DB_FILE_WRITE : MORK_ERROR_DB_FILE_READ;
+                } else if ((size_t)cqe->res < req->len) {
+                    done = IoEngine_runSync(fd, req, (size_t)cqe->res);
+                }
+                if (done != MORK_OK && res == MORK_OK) { res = done; }
+                completed++;
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+    return res;
+}
+
+#else
+
+struct IoRing {
+    int unused;
+};
+
+static struct IoRing *IoRing_create(unsigned int entries)
+{
+    (void)entries;
+    return NULL;
+}
+
+static void IoRing_destroy(struct IoRing *ring)
+{
+    free(ring);
+}
+
+static enum MorkResult IoRing_run(struct IoRing *ring, int fd, struct IoRequest *reqs, unsigned int count)
+{
+    (void)ring; (void)fd; (void)reqs; (void)count;
+    return MORK_ERROR_DB;
+}
+
+#endif
+
+/**
+ * @brief Create an engine. Asking for io_uring where it is not available
+ *        (an old kernel, a sandbox, another OS) gives the sync backend, so
+ *        check engine->backend to see which one you got.
+ *
+ * @param backend The backend to try for
+ * @return struct IoEngine*
+ */
+struct IoEngine *IoEngine_create(enum IoBackend backend)
+{
+    struct IoEngine *engine = calloc(1, sizeof(struct IoEngine));
+    check_mem(engine);
+
+    engine->backend = IO_BACKEND_SYNC;
+    if (backend == IO_BACKEND_URING) {
+        engine->ring = IoRing_create(IO_RING_DEPTH);
+        if (engine->ring) { engine->backend = IO_BACKEND_URING; }
+    }
+    return engine;
+
+error:
+    return NULL;
+}
+
+void IoEngine_destroy(struct IoEngine *engine)
+{
+    if (engine == NULL) { return; }
+    IoRing_destroy(engine->ring);
+    free(engine->requests);
+    free(engine);
+}
+
+static enum MorkResult IoEngine_queue(struct IoEngine *engine, unsigned char write, void *buf, size_t len, off_t offset)
+{
+    if (engine == NULL) { return MORK_ERROR_DB_NULL; }
+    if (buf == NULL || offset < 0) { return MORK_ERROR_DB_INVALID_DATA; }
+    if (len == 0) { return MORK_OK; }
+
+    if (engine->count == engine->capacity) {
+        unsigned int capacity = engine->capacity ? engine->capacity * 2 : 16;
+        struct IoRequest *grown = realloc(engine->requests, capacity * sizeof(struct IoRequest));
+        if (grown == NULL) { return MORK_ERROR_DB; }
+        engine->requests = grown;
+        engine->capacity = capacity;
+    }
+
+    struct IoRequest *req = &engine->requests[engine->count++];
+    req->write = write;
+    req->buf = buf;
+    req->len = len;
+    req->offset = offset;
+    return MORK_OK;
+}
+
+/**
+ * @brief Queue a read into buf. The buffer must stay put until the submit.
+ *
+ * @param engine The engine
+ * @param buf    Where the bytes go
+ * @param len    Number of bytes
+ * @param offset Where in the file they come from
+ * @return enum MorkResult
+ */
+enum MorkResult IoEngine_read(struct IoEngine *engine, void *buf, size_t len, off_t offset)
+{
+    return IoEngine_queue(engine, 0, buf, len, offset);
+}
+
+/**
+ * @brief Queue a write from buf. The buffer must stay put until the submit.
+ *
+ * @param engine The engine
+ * @param buf    The bytes to write
+ * @param len    Number of bytes
+ * @param offset Where in the file they go
+ * @return enum MorkResult
+ */
+enum MorkResult IoEngine_write(struct IoEngine *engine, const void *buf, size_t len, off_t offset)
+{
+    return IoEngine_queue(engine, 1, (void *)buf, len, offset);
+}
+
+/**
+ * @brief Run everything queued against a file and wait for all of it. The
+ *        queue is emptied whether or not it succeeds. Requests in one batch
+ *        may complete in any order, so they should not overlap.
+ *
+ * @param engine The engine
+ * @param fd     The file
+ * @return enum MorkResult The first failure, if any
+ */
+enum MorkResult IoEngine_submit(struct IoEngine *engine, int fd)
+{
+    if (engine == NULL) { return MORK_ERROR_DB_NULL; }
+    if (fd < 0) {
+        engine->count = 0;
+        return MORK_ERROR_DB_FILE_NULL;
+    }
+
+    enum MorkResult res = MORK_OK;
+    if (engine->ring) {
+        res = IoRing_run(engine->ring, fd, engine->requests, engine->count);
+        if (res == MORK_ERROR_DB) {
+            // Reads and writes are safe to repeat, so redo the batch without the ring
+            log_warn("io_uring failed, falling back to pread and pwrite");
+            IoRing_destroy(engine->ring);
+            engine->ring = NULL;
+            engine->backend = IO_BACKEND_SYNC;
+        }
+    }
+    if (engine->ring == NULL) {
+        res = MORK_OK;
+        for (unsigned int i = 0; i < engine->count && res == MORK_OK; i++) {
+            res = IoEngine_runSync(fd, &engine->requests[i], 0);
+        }
+    }
+    engine->count = 0;
+    return res;
+}
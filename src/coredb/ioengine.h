@@ -0,0 +1,66 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../utils/error.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Batched file I/O for the storage layer. Reads and writes are queued and
+// then handed to the kernel together by IoEngine_submit, which returns once
+// every one of them is done. With io_uring the whole batch goes in with a
+// single io_uring_enter and the kernel is free to overlap it; the sync
+// backend falls back to one pread or pwrite each, which is what io_uring
+// turns into when the kernel does not support it. An engine is used by one
+// thread at a time.
+
+enum IoBackend {
+    IO_BACKEND_SYNC = 0, // pread and pwrite
+    IO_BACKEND_URING
+};
+
+// Buffers and offsets aligned to this suit O_DIRECT and whole-page writes
+#define IO_ALIGN 4096
+
+struct IoRequest {
+    unsigned char write;
+    void *buf;
+    size_t len;
+    off_t offset;
+};
+
+struct IoRing;
+
+struct IoEngine {
+    enum IoBackend backend;
+    struct IoRing *ring; // NULL for the sync backend
+
+    // Queued since the last submit
+    struct IoRequest *requests;
+    unsigned int count;
+    unsigned int capacity;
+};
+
+struct IoEngine *IoEngine_create(enum IoBackend backend);
+void IoEngine_destroy(struct IoEngine *engine);
+
+enum MorkResult IoEngine_read(struct IoEngine *engine, void *buf, size_t len, off_t offset);
+enum MorkResult IoEngine_write(struct IoEngine *engine, const void *buf, size_t len, off_t offset);
+enum MorkResult IoEngine_submit(struct IoEngine *engine, int fd);
@@ -0,0 +1,182 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lz.h"
+
+#include <string.h>
+
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+
+static unsigned int Lz_hash(const unsigned char *at)
+{
+    unsigned int value;
+    memcpy(&value, at, sizeof(value));
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * @brief The most a block of len bytes can grow to when compressed, which
+ *        is what it costs to store it all as literals.
+ */
+size_t Lz_bound(size_t len)
+{
+    return len + len / 255 + 16;
+}
+
+// Writes a length that did not fit in its nibble as a run of extra bytes
+static int Lz_putLength(unsigned char *dst, size_t cap, size_t *op, size_t extra)
+{
+    while (extra >= 255) {
+        if (*op >= cap) { return 0; }
+        dst[(*op)++] = 255;
+        extra -= 255;
+    }
+    if (*op >= cap) { return 0; }
+    dst[(*op)++] = (unsigned char)extra;
+    return 1;
+}
+
+static int Lz_putSequence(unsigned char *dst, size_t cap, size_t *op, const unsigned char *literals,
+                          size_t literal_len, size_t offset, size_t match_len)
+{
+    size_t match_code = match_len ? match_len - LZ_MIN_MATCH : 0;
+    if (*op >= cap) { return 0; }
+    dst[(*op)++] = (unsigned char)(((literal_len < 15 ? literal_len : 15) << 4) | (match_code < 15 ? match_code : 15));
+
+    if (literal_len >= 15 && !Lz_putLength(dst, cap, op, literal_len - 15)) { return 0; }
+    if (*op + literal_len > cap) { return 0; }
+    memcpy(dst + *op, literals, literal_len);
+    *op += literal_len;
+
+    if (match_len == 0) { return 1; }
+    if (*op + 2 > cap) { return 0; }
+    dst[(*op)++] = offset & 0xFF;
+    dst[(*op)++] = (offset >> 8) & 0xFF;
+    return match_code < 15 || Lz_putLength(dst, cap, op, match_code - 15);
+}
+
+/**
+ * @brief Compress a block. Matches are found through a small hash table of
+ *        the last place each 4-byte prefix was seen, so this is one pass.
+ *
+ * @param src     The bytes to compress
+ * @param len     Number of bytes
+ * @param dst     Where the compressed block goes
+ * @param cap     Size of dst; Lz_bound(len) is always enough
+ * @param out_len Set to the size of the compressed block
+ * @return enum MorkResult
+ */
+enum MorkResult Lz_compress(const unsigned char *src, size_t len, unsigned char *dst, size_t cap, size_t *out_len)
+{
+    if ((src == NULL && len != 0) || dst == NULL || out_len == NULL) { return MORK_ERROR_DB_INVALID_DATA; }
+    if (len > 0xFFFFFFFEu) { return MORK_ERROR_DB_INVALID_DATA; }
+
+    // Positions are stored one up, so zero means nothing seen yet
+    unsigned int table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    size_t op = 0;
+    size_t anchor = 0;
+    size_t ip = 0;
+    while (ip + LZ_MIN_MATCH <= len) {
+        unsigned int hash = Lz_hash(src + ip);
+        size_t candidate = table[hash];
+        table[hash] = (unsigned int)(ip + 1);
+
+        if (candidate == 0 || ip - (candidate - 1) > LZ_MAX_OFFSET ||
+            memcmp(src + candidate - 1, src + ip, LZ_MIN_MATCH) != 0) {
+            ip++;
+            continue;
+        }
+
+        size_t match = candidate - 1;
+        size_t match_len = LZ_MIN_MATCH;
+        while (ip + match_len < len && src[match + match_len] == src[ip + match_len]) { match_len++; }
+
+        if (!Lz_putSequence(dst, cap, &op, src + anchor, ip - anchor, ip - match, match_len)) { return MORK_ERROR_DB_FILE_WRITE; }
+        ip += match_len;
+        anchor = ip;
+    }
+
+    if (!Lz_putSequence(dst, cap, &op, src + anchor, len - anchor, 0, 0)) { return MORK_ERROR_DB_FILE_WRITE; }
+    *out_len = op;
+    return MORK_OK;
+}
+
+static int Lz_getLength(const unsigned char *src, size_t len, size_t *ip, size_t *value)
+{
+    unsigned char byte;
+    do {
+        if (*ip >= len) { return 0; }
+        byte = src[(*ip)++];
+        *value += byte;
+    } while (byte == 255);
+    return 1;
+}
+
+/**
+ * @brief Decompress a block, which must come out at exactly raw_len bytes.
+ *        Every length and offset is checked, so a corrupt block is an error
+ *        rather than a stray write.
+ *
+ * @param src     The compressed block
+ * @param len     Size of the compressed block
+ * @param dst     Where the bytes go
+ * @param raw_len Size of the block before it was compressed
+ * @return enum MorkResult
+ */
+enum MorkResult Lz_decompress(const unsigned char *src, size_t len, unsigned char *dst, size_t raw_len)
+{
+    if ((src == NULL && len != 0) || (dst == NULL && raw_len != 0)) { return MORK_ERROR_DB_INVALID_DATA; }
+
+    size_t ip = 0;
+    size_t op = 0;
+    int ended = 0; // A whole block always ends with a literals-only sequence
+    while (ip < len) {
+        unsigned char token = src[ip++];
+
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && !Lz_getLength(src, len, &ip, &literal_len)) { return MORK_ERROR_DB_INVALID_DATA; }
+        if (literal_len > len - ip || literal_len > raw_len - op) { return MORK_ERROR_DB_INVALID_DATA; }
+        memcpy(dst + op, src + ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+        if (ip == len) {
+            ended = 1;
+            break;
+        }
+
+        if (len - ip < 2) { return MORK_ERROR_DB_INVALID_DATA; }
+        size_t offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) { return MORK_ERROR_DB_INVALID_DATA; }
+
+        size_t match_len = token & 15;
+        if (match_len == 15 && !Lz_getLength(src, len, &ip, &match_len)) { return MORK_ERROR_DB_INVALID_DATA; }
+        match_len += LZ_MIN_MATCH;
+        if (match_len > raw_len - op) { return MORK_ERROR_DB_INVALID_DATA; }
+
+        // Byte by byte, since a match may overlap what it is copying
+        for (size_t i = 0; i < match_len; i++, op++) {
+            dst[op] = dst[op - offset];
+        }
+    }
+
+    return ended && op == raw_len ? MORK_OK : MORK_ERROR_DB_INVALID_DATA;
+}
@@ -0,0 +1,37 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../utils/error.h"
+
+#include <stddef.h>
+
+// A small LZ77 codec for blocks of rows, in the spirit of LZ4: a stream of
+// sequences, each a token byte (literal count in the high nibble, match
+// length minus LZ_MIN_MATCH in the low one, 15 meaning "more bytes follow,
+// each added on until one is not 255"), the literals, and a little-endian
+// u16 offset back to the match. The last sequence is literals only. It
+// favours speed over ratio and needs no dictionary, so a block decodes on
+// its own.
+
+#define LZ_MIN_MATCH 4
+
+size_t Lz_bound(size_t len);
+enum MorkResult Lz_compress(const unsigned char *src, size_t len, unsigned char *dst, size_t cap, size_t *out_len);
+enum MorkResult Lz_decompress(const unsigned char *src, size_t len, unsigned char *dst, size_t raw_len);
@@ -0,0 +1,167 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "roomgraph.h"
+
+#include <lcthw/dbg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct RoomGraph *RoomGraph_create()
+{
+    struct RoomGraph *graph = calloc(1, sizeof(struct RoomGraph));
+    check_mem(graph);
+    return graph;
+
+error:
+    return NULL;
+}
+
+void RoomGraph_destroy(struct RoomGraph *graph)
+{
+    if (graph == NULL) { return; }
+    free(graph->node_by_id);
+    free(graph);
+}
+
+/**
+ * @brief Rebuild the graph from the location rows. Exits are resolved to node
+ *        indices here, so following one later is a single array access.
+ *
+ * @param graph        The graph
+ * @param locations    The location table
+ * @param descriptions The description table the location texts live in
+ * @return enum MorkResult
+ */
+enum MorkResult RoomGraph_build(struct RoomGraph *graph, struct LocationTable *locations, struct DescriptionTable *descriptions)
+{
+    if (graph == NULL) { return MORK_ERROR_DB_NULL; }
+    if (locations == NULL || descriptions == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+
+    RoomGraph_invalidate(graph);
+
+    // Only the packed hot columns are walked; names are never touched
+    const struct LocationHot *rows = LocationTable_hotRows(locations);
+    if (rows == NULL) { return MORK_ERROR_DB; }
+
+    unsigned int max_id = 0;
+    for (unsigned int i = 0; i < MAX_LOCATIONS; i++) {
+        if (rows[i].set == 1 && rows[i].id > max_id) { max_id = rows[i].id; }
+    }
+
+    if (graph->node_by_id == NULL || max_id > graph->max_id) {
+        unsigned short *grown = realloc(graph->node_by_id, (max_id + 1) * sizeof(unsigned short));
+        if (grown == NULL) { return MORK_ERROR_DB; }
+        graph->node_by_id = grown;
+        graph->max_id = max_id;
+    }
+    memset(graph->node_by_id, 0, (graph->max_id + 1) * sizeof(unsigned short));
+
+    for (unsigned int i = 0; i < MAX_LOCATIONS; i++) {
+        const struct LocationHot *rec = &rows[i];
+        if (rec->set != 1 || rec->id == 0) { continue; }
+
+        struct RoomNode *node = &graph->nodes[graph->count];
+        node->id = rec->id;
+        node->description = NULL;
+        if (rec->descriptionID != 0) {
+            struct DescriptionRecord *desc = DescriptionTable_get(descriptions, rec->descriptionID);
+            if (desc != NULL) { node->description = desc->description; }
+        }
+        graph->node_by_id[rec->id] = ++graph->count;
+    }
+
+    // Exits can only be resolved once every node has its index. Nodes were
+    // numbered in row order, so the same walk visits them in turn.
+    unsigned short n = 0;
+    for (unsigned int i = 0; i < MAX_LOCATIONS; i++) {
+        const struct LocationHot *rec = &rows[i];
+        if (rec->set != 1 || rec->id == 0) { continue; }
+        struct RoomNode *node = &graph->nodes[n++];
+        for (int dir = 0; dir < MAX_EXITS; dir++) {
+            unsigned short to = rec->exitIDs[dir];
+            node->exits[dir] = (to != 0 && to <= max_id && graph->node_by_id[to] != 0)
+                ? graph->node_by_id[to] - 1
+                : ROOM_NONE;
+        }
+    }
+
+    graph->built = 1;
+    return MORK_OK;
+}
+
+/**
+ * @brief Mark the graph out of date. Description pointers may dangle from
+ *        here on, so nothing may be read until the next build.
+ *
+ * @param graph The graph
+ */
+void RoomGraph_invalidate(struct RoomGraph *graph)
+{
+    if (graph == NULL) { return; }
+    graph->built = 0;
+    graph->count = 0;
+}
+
+/**
+ * @brief Find the node for a location.
+ *
+ * @param graph The graph, which must be built
+ * @param id    The location id
+ * @return const struct RoomNode* The node, or NULL if there is no such location
+ */
+const struct RoomNode *RoomGraph_get(struct RoomGraph *graph, unsigned int id)
+{
+    if (graph == NULL || graph->built != 1) { return NULL; }
+    if (id == 0 || id > graph->max_id || graph->node_by_id[id] == 0) { return NULL; }
+    return &graph->nodes[graph->node_by_id[id] - 1];
+}
+
+/**
+ * @brief Follow an exit.
+ *
+ * @param graph     The graph, which must be built
+ * @param node      Where we are
+ * @param direction Index into the exits, in ExitDirection order
+ * @return const struct RoomNode* The neighbour, or NULL if there is no exit that way
+ */
+const struct RoomNode *RoomGraph_exit(struct RoomGraph *graph, const struct RoomNode *node, int direction)
+{
+    if (graph == NULL || graph->built != 1 || node == NULL) { return NULL; }
+    if (direction < 0 || direction >= MAX_EXITS) { return NULL; }
+    if (node->exits[direction] == ROOM_NONE) { return NULL; }
+    return &graph->nodes[node->exits[direction]];
+}
+
+/**
+ * @brief Copy a node out of the graph, with its exits as location ids and its
+ *        description text, so it stays good after the graph is rebuilt.
+ *
+ * @param graph The graph, which must be built
+ * @param node  The node
+ * @param out   Where the copy goes
+ */
+void RoomGraph_copy(struct RoomGraph *graph, const struct RoomNode *node, struct Room *out)
+{
+    out->id = node->id;
+    for (int dir = 0; dir < MAX_EXITS; dir++) {
+        out->exits[dir] = node->exits[dir] == ROOM_NONE ? 0 : graph->nodes[node->exits[dir]].id;
+    }
+    snprintf(out->description, MAX_DESCRIPTION, "%s", node->description ? node->description : "");
+}
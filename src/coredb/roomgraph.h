@@ -0,0 +1,62 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../utils/error.h"
+
+#include "tables/description.h"
+#include "tables/location.h"
+
+// The map as movement sees it: for every location, its id, where each of its
+// six exits leads and the text shown for it, with nothing else loaded. It is
+// built from the location and description tables on first use and thrown
+// away whenever either table changes.
+
+#define ROOM_NONE 0xFFFF // No exit that way
+
+struct RoomNode {
+    unsigned short id;
+    unsigned short exits[MAX_EXITS]; // Index of the neighbouring node, or ROOM_NONE
+    const char *description;         // Borrowed from the description table
+};
+
+// A node copied out of the graph, for use once its locks are let go
+struct Room {
+    unsigned short id;
+    unsigned short exits[MAX_EXITS]; // Id of the neighbouring location, or 0
+    char description[MAX_DESCRIPTION]; // Empty if the location has none
+};
+
+struct RoomGraph {
+    unsigned char built;
+    unsigned short count;
+    struct RoomNode nodes[MAX_LOCATIONS];
+    unsigned short *node_by_id; // Node index + 1, 0 if there is no such location
+    unsigned int max_id;
+};
+
+struct RoomGraph *RoomGraph_create();
+void RoomGraph_destroy(struct RoomGraph *graph);
+
+enum MorkResult RoomGraph_build(struct RoomGraph *graph, struct LocationTable *locations, struct DescriptionTable *descriptions);
+void RoomGraph_invalidate(struct RoomGraph *graph);
+
+const struct RoomNode *RoomGraph_get(struct RoomGraph *graph, unsigned int id);
+const struct RoomNode *RoomGraph_exit(struct RoomGraph *graph, const struct RoomNode *node, int direction);
+void RoomGraph_copy(struct RoomGraph *graph, const struct RoomNode *node, struct Room *out);
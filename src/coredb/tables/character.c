@@ -108,6 +108,11 @@ enum MorkResult CharacterRecord_print(struct CharacterRecord *record) {
     return MORK_OK;
 }
 
+static void CharacterTable_setColumns(struct CharacterTable *table)
+{
+    TableMeta_setNameColumn(&table->meta, offsetof(struct CharacterRecord, name), MAX_NAME_LEN);
+}
+
 /**
  * @brief The constructor for the CharacterTable struct.
  * 
@@ -116,10 +121,41 @@ enum MorkResult CharacterRecord_print(struct CharacterRecord *record) {
 struct CharacterTable *CharacterTable_create() {
     struct CharacterTable *table = (struct CharacterTable *)calloc(1, sizeof(struct CharacterTable));
     check_mem(table);
-    CharacterTable_init(table);
+    table->rows = calloc(MAX_ROWS_CS, sizeof(struct CharacterRecord));
+    check_mem(table->rows);
+    check(TableMeta_init(&table->meta, table->rows, sizeof(struct CharacterRecord), MAX_ROWS_CS) == MORK_OK,
+          "Failed to initialize table meta");
+    CharacterTable_setColumns(table);
+    table->meta.zeroed = 1; // calloc'd, so every row starts unset
+    return table;
+
+error:
+    return NULL;
+}
+
+/**
+ * @brief Create a CharacterTable on top of existing row storage, such as a region of
+ *        a mapped database file. The rows are used as they are and are not
+ *        freed when the table is destroyed.
+ *
+ * @param rows Storage for MAX_ROWS_CS rows
+ * @return struct CharacterTable*
+ */
+struct CharacterTable *CharacterTable_createMapped(struct CharacterRecord *rows)
+{
+    struct CharacterTable *table = NULL;
+    check(rows != NULL, "Expected row storage, got NULL");
+    table = calloc(1, sizeof(struct CharacterTable));
+    check_mem(table);
+    table->rows = rows;
+    check(TableMeta_init(&table->meta, table->rows, sizeof(struct CharacterRecord), MAX_ROWS_CS) == MORK_OK,
+          "Failed to initialize table meta");
+    CharacterTable_setColumns(table);
+    table->meta.borrowed = 1;
     return table;
 
 error:
+    if (table) { free(table); }
     return NULL;
 }
 
@@ -135,12 +171,14 @@ enum MorkResult CharacterTable_init(struct CharacterTable *table) {
         table->rows[i].id = 0;
         table->rows[i].set = 0;
     }
+    TableMeta_markAll(&table->meta);
+    TableMeta_invalidate(&table->meta);
     return MORK_OK;
 }
 
 
 /**
- * @brief Add a new row to the table. If the table is full, the row with the lowest ID will be overwritten.
+ * @brief Add a new row to the table. Fails with MORK_ERROR_DB_TABLE_FULL rather than overwriting a live row.
  * 
  * @param table  The table to add the row to
  * @param record The record to add
@@ -149,9 +187,11 @@ enum MorkResult CharacterTable_init(struct CharacterTable *table) {
 enum MorkResult CharacterTable_newRow(struct CharacterTable *table, struct CharacterRecord *record)
 {
     record->set = 1;
-    unsigned short idx = findNextRowToFill(table->rows, MAX_ROWS_CS);
+    unsigned short idx = findNextRowToFill(&table->meta);
+    if (idx == 0) { return MORK_ERROR_DB_TABLE_FULL; }
     memcpy(&table->rows[idx], record, sizeof(struct CharacterRecord));
     table->rows[idx].set = 1;
+    TableMeta_markRow(&table->meta, idx);
     return MORK_OK;
 }
 
@@ -168,12 +208,12 @@ enum MorkResult CharacterTable_update(struct CharacterTable *table, struct Chara
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
     if (record == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    for (int i = 0; i < MAX_ROWS_CS; i++) {
-        if (table->rows[i].id == record->id && table->rows[i].set == 1) {
-            memcpy(&table->rows[i], record, sizeof(struct CharacterRecord));
-            table->rows[i].set = 1;
-            return MORK_OK;
-        }
+    int idx = TableMeta_lookup(&table->meta, record->id);
+    if (idx >= 0) {
+        memcpy(&table->rows[idx], record, sizeof(struct CharacterRecord));
+        table->rows[idx].set = 1;
+        TableMeta_markRow(&table->meta, idx);
+        return MORK_OK;
     }
 
     return CharacterTable_newRow(table, record);
@@ -190,10 +230,9 @@ struct CharacterRecord *CharacterTable_get(struct CharacterTable *table, int id)
     check(table != NULL, "Expected a valid table, got NULL");
     check(id > 0, "Expected a valid id, got %d", id);
 
-    for (int i = 0; i < MAX_ROWS_CS; i++) {
-        if (table->rows[i].id == id && table->rows[i].set == 1) {
-            return &table->rows[i];
-        }
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0) {
+        return &table->rows[idx];
     }
 
     log_err("Character not found (by ID). ID: %d", id);
@@ -213,10 +252,9 @@ struct CharacterRecord *CharacterTable_getByName(struct CharacterTable *table, c
     check(table != NULL, "Expected a valid table, got NULL");
     check(name != NULL && strcmp(name, "") != 0, "Expected a valid name");
 
-    for (int i = 0; i < MAX_ROWS_CS; i++) {
-        if (strcmp(table->rows[i].name, name) == 0 && table->rows[i].set == 1) {
-            return &table->rows[i];
-        }
+    int idx = TableMeta_lookupName(&table->meta, name);
+    if (idx >= 0) {
+        return &table->rows[idx];
     }
 
     log_err("Character not found (by name). Name: %s", name);
@@ -235,11 +273,11 @@ enum MorkResult CharacterTable_delete(struct CharacterTable *table, int id) {
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
     if (id <= 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    for (int i = 0; i < MAX_ROWS_CS; i++) {
-        if (table->rows[i].id == id && table->rows[i].set == 1) {
-            table->rows[i].set = 0;
-            return MORK_OK;
-        }
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0) {
+        table->rows[idx].set = 0;
+        TableMeta_markRow(&table->meta, idx);
+        return MORK_OK;
     }
     return MORK_ERROR_DB_NOT_FOUND;
 }
@@ -252,12 +290,9 @@ enum MorkResult CharacterTable_delete(struct CharacterTable *table, int id) {
 enum MorkResult CharacterTable_print(struct CharacterTable *table) {
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
 
-    for (int i = 0; i < MAX_ROWS_CS; i++) {
-        struct CharacterRecord *row = &table->rows[i];
-        if (row->set == 1) {
-            if (CharacterRecord_print(row) != MORK_OK) {
-                return MORK_ERROR_DB;
-            }
+    for (int i = TableMeta_nextLive(&table->meta, 0); i >= 0; i = TableMeta_nextLive(&table->meta, i + 1)) {
+        if (CharacterRecord_print(&table->rows[i]) != MORK_OK) {
+            return MORK_ERROR_DB;
         }
         printf("\n");
     }
@@ -271,6 +306,8 @@ enum MorkResult CharacterTable_print(struct CharacterTable *table) {
  */
 enum MorkResult CharacterTable_destroy(struct CharacterTable *table) {
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    TableMeta_destroy(&table->meta);
+    if (!table->meta.borrowed) { free(table->rows); }
     free(table);
     return MORK_OK;
 }
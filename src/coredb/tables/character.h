@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include "../../utils/error.h"
+#include "row.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -75,10 +76,12 @@ enum MorkResult CharacterRecord_print(struct CharacterRecord *rec);
 // We know that the maximum number of rows is 256,
 // so we can use unsigned chars to store row index data
 struct CharacterTable {
-    struct CharacterRecord rows[MAX_ROWS_CS];
+    struct TableMeta meta;
+    struct CharacterRecord *rows;
 };
 
 struct CharacterTable *CharacterTable_create();
+struct CharacterTable *CharacterTable_createMapped(struct CharacterRecord *rows);
 
 enum MorkResult CharacterTable_init(struct CharacterTable *table);
 enum MorkResult CharacterTable_newRow(struct CharacterTable *table, struct CharacterRecord *record);
@@ -21,6 +21,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <string.h>
 #include <lcthw/dbg.h>
+#include <stddef.h>
 #include <stdlib.h>
 
 /**
@@ -77,6 +78,8 @@ enum MorkResult DescriptionTable_init(struct DescriptionTable *table) {
         table->rows[i].id = 0;
         table->rows[i].set = 0;
     }
+    TableMeta_markAll(&table->meta);
+    TableMeta_invalidate(&table->meta);
     return MORK_OK;
 }
 
@@ -89,11 +92,43 @@ struct DescriptionTable *DescriptionTable_create()
 {
     struct DescriptionTable *table = calloc(1, sizeof(struct DescriptionTable));
     check_mem(table);
+    table->rows = calloc(MAX_ROWS_DESC, sizeof(struct DescriptionRecord));
+    check_mem(table->rows);
+    check(TableMeta_init(&table->meta, table->rows, sizeof(struct DescriptionRecord), MAX_ROWS_DESC) == MORK_OK,
+          "Failed to initialize table meta");
+    TableMeta_setSortColumn(&table->meta, offsetof(struct DescriptionRecord, description), MAX_DESCRIPTION);
+    TableMeta_setNameColumn(&table->meta, offsetof(struct DescriptionRecord, description), MAX_DESCRIPTION);
+    table->meta.zeroed = 1; // calloc'd, so every row starts unset
+    return table;
+
+error:
+    return NULL;
+}
 
-    DescriptionTable_init(table);
+/**
+ * @brief Create a DescriptionTable on top of existing row storage, such as a region of
+ *        a mapped database file. The rows are used as they are and are not
+ *        freed when the table is destroyed.
+ *
+ * @param rows Storage for MAX_ROWS_DESC rows
+ * @return struct DescriptionTable*
+ */
+struct DescriptionTable *DescriptionTable_createMapped(struct DescriptionRecord *rows)
+{
+    struct DescriptionTable *table = NULL;
+    check(rows != NULL, "Expected row storage, got NULL");
+    table = calloc(1, sizeof(struct DescriptionTable));
+    check_mem(table);
+    table->rows = rows;
+    check(TableMeta_init(&table->meta, table->rows, sizeof(struct DescriptionRecord), MAX_ROWS_DESC) == MORK_OK,
+          "Failed to initialize table meta");
+    TableMeta_setSortColumn(&table->meta, offsetof(struct DescriptionRecord, description), MAX_DESCRIPTION);
+    TableMeta_setNameColumn(&table->meta, offsetof(struct DescriptionRecord, description), MAX_DESCRIPTION);
+    table->meta.borrowed = 1;
     return table;
 
 error:
+    if (table) { free(table); }
     return NULL;
 }
 
@@ -105,6 +140,8 @@ error:
 enum MorkResult DescriptionTable_destroy(struct DescriptionTable *table)
 {
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    TableMeta_destroy(&table->meta);
+    if (!table->meta.borrowed) { free(table->rows); }
     free(table);
     return MORK_OK;
 }
@@ -123,10 +160,12 @@ enum MorkResult DescriptionTable_insert(struct DescriptionTable *table, struct D
     if (record == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
     record->set = 1;
-    unsigned short idx = findNextRowToFill(table->rows, MAX_ROWS_DESC);
+    unsigned short idx = findNextRowToFill(&table->meta);
+    if (idx == 0) { return MORK_ERROR_DB_TABLE_FULL; }
 
     memcpy(&table->rows[idx], record, sizeof(struct DescriptionRecord));
     table->rows[idx].set = 1;
+    TableMeta_markRow(&table->meta, idx);
 
     return MORK_OK;
 }
@@ -144,12 +183,12 @@ enum MorkResult DescriptionTable_update(struct DescriptionTable *table, struct D
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
     if (record == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    for (int i = 0; i < MAX_ROWS_DESC; i++) {
-        if (table->rows[i].set == 1 && table->rows[i].id == record->id) {
-            memcpy(&table->rows[i], record, sizeof(struct DescriptionRecord));
-            table->rows[i].set = 1;
-            return MORK_OK;
-        }
+    int idx = TableMeta_lookup(&table->meta, record->id);
+    if (idx >= 0) {
+        memcpy(&table->rows[idx], record, sizeof(struct DescriptionRecord));
+        table->rows[idx].set = 1;
+        TableMeta_markRow(&table->meta, idx);
+        return MORK_OK;
     }
 
     return MORK_ERROR_DB_NOT_FOUND;
@@ -167,11 +206,9 @@ struct DescriptionRecord *DescriptionTable_get(struct DescriptionTable *table, u
     check(id > 0, "ID is not set");
     check(table != NULL, "Table is NULL");
 
-    for (unsigned short i = 0; i < MAX_ROWS_DESC; i++) {
-        struct DescriptionRecord *rec = &table->rows[i];
-        if (rec->set == 1 && rec->id == id) {
-            return rec;
-        }
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0) {
+        return &table->rows[idx];
     }
 
 error:
@@ -190,10 +227,11 @@ struct DescriptionRecord *DescriptionTable_get_next(struct DescriptionTable *tab
     check(table != NULL, "Expected table, got NULL");
     check(id != 0, "Expected valid ID");
 
-    for (int i = 0; i < MAX_ROWS_DESC; i++) {
-        if (table->rows[i].id == id && table->rows[i].set == 1) {
-            return &table->rows[table->rows[i].next_id];
-        }
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0) {
+        // next_id is an id like any other, not a row index
+        int next = TableMeta_lookup(&table->meta, table->rows[idx].next_id);
+        return next >= 0 ? &table->rows[next] : NULL;
     }
 
 error:
@@ -202,6 +240,8 @@ error:
 
 /**
  * @brief Attempts to find a DescriptionRecord by matching against content.
+ *        Descriptions are kept sorted, so this is a binary search to the run
+ *        of matches; of those, the lowest row wins, as it did with a scan.
  * 
  * @param table The table to search
  * @param prefix The prefix to search for
@@ -212,11 +252,40 @@ struct DescriptionRecord *DescriptionTable_get_by_prefix(struct DescriptionTable
     check(table != NULL, "Expected table, got NULL");
     check(prefix != NULL && strcmp(prefix, "") != 0, "Expected valid prefix, got empty or NULL");
 
-    for (int i = 0; i < MAX_ROWS_DESC; i++) {
-        if (table->rows[i].set == 1 && strncmp(table->rows[i].description, prefix, strlen(prefix)) == 0) {
-            return &table->rows[i];
+    unsigned int first = 0;
+    unsigned int count = TableMeta_prefixRange(&table->meta, prefix, &first);
+    int found = -1;
+    for (unsigned int i = first; i < first + count; i++) {
+        if (found == -1 || table->meta.sorted[i] < found) {
+            found = table->meta.sorted[i];
         }
     }
+    if (found >= 0) {
+        return &table->rows[found];
+    }
+
+error:
+    return NULL;
+}
+
+/**
+ * @brief Find the description whose text is exactly the given text. The
+ *        description column doubles as the table's hashed name column, so
+ *        this is a bucket lookup rather than a search.
+ *
+ * @param table The table to search
+ * @param text  The full text, already cut to what a record can hold
+ * @return struct DescriptionRecord*
+ */
+struct DescriptionRecord *DescriptionTable_get_by_text(struct DescriptionTable *table, char *text)
+{
+    check(table != NULL, "Expected table, got NULL");
+    check(text != NULL && strcmp(text, "") != 0, "Expected valid text, got empty or NULL");
+
+    int idx = TableMeta_lookupName(&table->meta, text);
+    if (idx >= 0) {
+        return &table->rows[idx];
+    }
 
 error:
     return NULL;
@@ -233,11 +302,11 @@ enum MorkResult DescriptionTable_delete(struct DescriptionTable *table, unsigned
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
     if (id == 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    for (int i = 0; i < MAX_ROWS_DESC; i++) {
-        if (table->rows[i].id == id && table->rows[i].set == 1) {
-            table->rows[i].set = 0;
-            return MORK_OK;
-        }
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0) {
+        table->rows[idx].set = 0;
+        TableMeta_markRow(&table->meta, idx);
+        return MORK_OK;
     }
     return MORK_ERROR_DB_NOT_FOUND;
 }
@@ -246,11 +315,9 @@ enum MorkResult DescriptionTable_print(struct DescriptionTable *table)
 {
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
 
-    for (int i = 0; i < MAX_ROWS_DESC; i++) {
+    for (int i = TableMeta_nextLive(&table->meta, 0); i >= 0; i = TableMeta_nextLive(&table->meta, i + 1)) {
         struct DescriptionRecord *rec = &table->rows[i];
-        if (rec->set == 1) {
-            log_info("ID: %d, Description: %s, Next ID: %d", rec->id, rec->description, rec->next_id);
-        }
+        log_info("ID: %d, Description: %s, Next ID: %d", rec->id, rec->description, rec->next_id);
     }
 
     return MORK_OK;
@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 #include "../../utils/error.h"
+#include "row.h"
 
 #define MAX_DESCRIPTION 512
 #define MAX_ROWS_DESC 65535
@@ -33,16 +34,19 @@ struct DescriptionRecord *DescriptionRecord_create(unsigned short id, char *desc
 enum MorkResult DescriptionRecord_destroy(struct DescriptionRecord *entry);
 
 struct DescriptionTable {
-    struct DescriptionRecord rows[MAX_ROWS_DESC];
+    struct TableMeta meta;
+    struct DescriptionRecord *rows;
 };
 
 struct DescriptionTable *DescriptionTable_create();
+struct DescriptionTable *DescriptionTable_createMapped(struct DescriptionRecord *rows);
 enum MorkResult DescriptionTable_init(struct DescriptionTable *table);
 enum MorkResult DescriptionTable_insert(struct DescriptionTable *table, struct DescriptionRecord *entry);
 enum MorkResult DescriptionTable_update(struct DescriptionTable *table, struct DescriptionRecord *entry);
 struct DescriptionRecord *DescriptionTable_get(struct DescriptionTable *table, unsigned short id);
 struct DescriptionRecord *DescriptionTable_get_next(struct DescriptionTable *table, unsigned short id); // For easy continuation of text
 struct DescriptionRecord *DescriptionTable_get_by_prefix(struct DescriptionTable *table, char *prefix);
+struct DescriptionRecord *DescriptionTable_get_by_text(struct DescriptionTable *table, char *text);
 enum MorkResult DescriptionTable_delete(struct DescriptionTable *table, unsigned short id);
 enum MorkResult DescriptionTable_destroy(struct DescriptionTable *table);
 
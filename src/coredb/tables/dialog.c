@@ -74,6 +74,8 @@ enum MorkResult DialogTable_init(struct DialogTable *table) {
         table->rows[i].id = 0;
         table->rows[i].set = 0;
     }
+    TableMeta_markAll(&table->meta);
+    TableMeta_invalidate(&table->meta);
 
     return MORK_OK;
 }
@@ -87,11 +89,39 @@ struct DialogTable *DialogTable_create()
 {
     struct DialogTable *table = calloc(1, sizeof(struct DialogTable));
     check_mem(table);
+    table->rows = calloc(MAX_ROWS_DIALOG, sizeof(struct DialogRecord));
+    check_mem(table->rows);
+    check(TableMeta_init(&table->meta, table->rows, sizeof(struct DialogRecord), MAX_ROWS_DIALOG) == MORK_OK,
+          "Failed to initialize table meta");
+    table->meta.zeroed = 1; // calloc'd, so every row starts unset
+    return table;
 
-    DialogTable_init(table);
+error:
+    return NULL;
+}
+
+/**
+ * @brief Create a DialogTable on top of existing row storage, such as a region of
+ *        a mapped database file. The rows are used as they are and are not
+ *        freed when the table is destroyed.
+ *
+ * @param rows Storage for MAX_ROWS_DIALOG rows
+ * @return struct DialogTable*
+ */
+struct DialogTable *DialogTable_createMapped(struct DialogRecord *rows)
+{
+    struct DialogTable *table = NULL;
+    check(rows != NULL, "Expected row storage, got NULL");
+    table = calloc(1, sizeof(struct DialogTable));
+    check_mem(table);
+    table->rows = rows;
+    check(TableMeta_init(&table->meta, table->rows, sizeof(struct DialogRecord), MAX_ROWS_DIALOG) == MORK_OK,
+          "Failed to initialize table meta");
+    table->meta.borrowed = 1;
     return table;
 
 error:
+    if (table) { free(table); }
     return NULL;
 }
 
@@ -103,16 +133,9 @@ error:
 enum MorkResult DialogTable_destroy(struct DialogTable *table)
 {
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
-    
-    for (int i = 0; i < MAX_ROWS_DIALOG; i++) {
-        if (table->rows[i].set == 1) {
-            enum MorkResult retval = DialogRecord_destroy(&table->rows[i]);
-            if (retval != MORK_OK) {
-                return retval;
-            }
-        }
-    }
 
+    TableMeta_destroy(&table->meta);
+    if (!table->meta.borrowed) { free(table->rows); }
     free(table);
     return MORK_OK;
 }
@@ -129,9 +152,11 @@ enum MorkResult DialogTable_newRow(struct DialogTable *table, struct DialogRecor
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
     if (rec == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    unsigned short idx = findNextRowToFill(table->rows, MAX_ROWS_DIALOG);
+    unsigned short idx = findNextRowToFill(&table->meta);
+    if (idx == 0) { return MORK_ERROR_DB_TABLE_FULL; }
     memcpy(&table->rows[idx], rec, sizeof(struct DialogRecord));
     table->rows[idx].set = 1;
+    TableMeta_markRow(&table->meta, idx);
     return MORK_OK;
 }
 
@@ -148,12 +173,12 @@ enum MorkResult DialogTable_update(struct DialogTable *table, struct DialogRecor
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
     if (rec == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    for (unsigned short i = 0; i < MAX_ROWS_DIALOG; ++i) {
-        if (table->rows[i].set == 1 && table->rows[i].id == rec->id) {
-            memcpy(&table->rows[i], rec, sizeof(struct DialogRecord));
-            table->rows[i].set = 1;
-            return MORK_OK;
-        }
+    int idx = TableMeta_lookup(&table->meta, rec->id);
+    if (idx >= 0) {
+        memcpy(&table->rows[idx], rec, sizeof(struct DialogRecord));
+        table->rows[idx].set = 1;
+        TableMeta_markRow(&table->meta, idx);
+        return MORK_OK;
     }
 
     return DialogTable_newRow(table, rec);
@@ -171,10 +196,9 @@ struct DialogRecord *DialogTable_get(struct DialogTable *table, unsigned short i
     check(table != NULL, "Expected table, got NULL");
     check(id > 0, "Expected valid ID, got 0");
 
-    for (int i = 0; i < MAX_ROWS_DIALOG; i++) {
-        if (table->rows[i].set == 1 && table->rows[i].id == id) {
-            return &table->rows[i];
-        }
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0) {
+        return &table->rows[idx];
     }
 
     log_err("Dialog ID %d not found", id);
@@ -194,11 +218,11 @@ enum MorkResult DialogTable_delete(struct DialogTable *table, unsigned short id)
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
     if (id == 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    for (int i = 0; i < MAX_ROWS_DIALOG; i++) {
-        if (table->rows[i].set == 1 && table->rows[i].id == id) {
-            table->rows[i].set = 0;
-            return MORK_OK;
-        }
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0) {
+        table->rows[idx].set = 0;
+        TableMeta_markRow(&table->meta, idx);
+        return MORK_OK;
     }
     return MORK_ERROR_DB_NOT_FOUND;
 }
@@ -212,12 +236,10 @@ enum MorkResult DialogTable_print(struct DialogTable *table)
 {
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
 
-    for (int i = 0; i < MAX_ROWS_DIALOG; i++) {
-        if (table->rows[i].set == 1) {
-            printf("ID: %d\n", table->rows[i].id);
-            printf("Text: %s\n", table->rows[i].text);
-            printf("Next ID: %d\n", table->rows[i].next_id);
-        }
+    for (int i = TableMeta_nextLive(&table->meta, 0); i >= 0; i = TableMeta_nextLive(&table->meta, i + 1)) {
+        printf("ID: %d\n", table->rows[i].id);
+        printf("Text: %s\n", table->rows[i].text);
+        printf("Next ID: %d\n", table->rows[i].next_id);
     }
     return MORK_OK;
 }
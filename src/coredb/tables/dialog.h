@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include "../../utils/error.h"
+#include "row.h"
 
 #define MAX_TEXT 505 // To ensure we add to 512 bytes
 #define MAX_ROWS_DIALOG 65535
@@ -35,10 +36,12 @@ struct DialogRecord *DialogRecord_create(unsigned short id, char *dialog, int ne
 enum MorkResult DialogRecord_destroy(struct DialogRecord *record);
 
 struct DialogTable {
-    struct DialogRecord rows[MAX_ROWS_DIALOG]; // Total size on disk is 512 * 65535 = 33,553,920 bytes. A bit excessive for Zork, but this is Mork
+    struct TableMeta meta;
+    struct DialogRecord *rows; // 512 * 65535 = 33,553,920 bytes on disk. A bit excessive for Zork, but this is Mork
 };
 
 struct DialogTable *DialogTable_create();
+struct DialogTable *DialogTable_createMapped(struct DialogRecord *rows);
 enum MorkResult DialogTable_init(struct DialogTable *table);
 enum MorkResult DialogTable_destroy(struct DialogTable *table);
 
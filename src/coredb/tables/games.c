@@ -69,6 +69,8 @@ enum MorkResult GameTable_init(struct GameTable *table)
         table->rows[i].id = 0;
         table->rows[i].set = 0;
     }
+    TableMeta_markAll(&table->meta);
+    TableMeta_invalidate(&table->meta);
     return MORK_OK;
 }
 
@@ -76,11 +78,39 @@ struct GameTable *GameTable_create()
 {
     struct GameTable *table = calloc(1, sizeof(struct GameTable));
     check_mem(table);
+    table->rows = calloc(MAX_ROWS_GAMES, sizeof(struct GameRecord));
+    check_mem(table->rows);
+    check(TableMeta_init(&table->meta, table->rows, sizeof(struct GameRecord), MAX_ROWS_GAMES) == MORK_OK,
+          "Failed to initialize table meta");
+    table->meta.zeroed = 1; // calloc'd, so every row starts unset
+    return table;
 
-    GameTable_init(table);
+error:
+    return NULL;
+}
+
+/**
+ * @brief Create a GameTable on top of existing row storage, such as a region of
+ *        a mapped database file. The rows are used as they are and are not
+ *        freed when the table is destroyed.
+ *
+ * @param rows Storage for MAX_ROWS_GAMES rows
+ * @return struct GameTable*
+ */
+struct GameTable *GameTable_createMapped(struct GameRecord *rows)
+{
+    struct GameTable *table = NULL;
+    check(rows != NULL, "Expected row storage, got NULL");
+    table = calloc(1, sizeof(struct GameTable));
+    check_mem(table);
+    table->rows = rows;
+    check(TableMeta_init(&table->meta, table->rows, sizeof(struct GameRecord), MAX_ROWS_GAMES) == MORK_OK,
+          "Failed to initialize table meta");
+    table->meta.borrowed = 1;
     return table;
 
 error:
+    if (table) { free(table); }
     return NULL;
 }
 
@@ -89,6 +119,8 @@ enum MorkResult GameTable_destroy(struct GameTable *table)
     if (table == NULL) {
         return MORK_ERROR_DB_TABLE_NULL;
     }
+    TableMeta_destroy(&table->meta);
+    if (!table->meta.borrowed) { free(table->rows); }
     free(table);
     return MORK_OK;
 }
@@ -98,11 +130,9 @@ struct GameRecord *GameTable_get(struct GameTable *table, unsigned short id)
     check(id > 0, "ID is not set");
     check(table != NULL, "Table is NULL");
 
-    for (unsigned short i = 0; i < MAX_ROWS_GAMES; i++) {
-        struct GameRecord *rec = &table->rows[i];
-        if (rec->id == id) {
-            return rec;
-        }
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0) {
+        return &table->rows[idx];
     }
 
 error:
@@ -119,10 +149,12 @@ enum MorkResult GameTable_insert(struct GameTable *table, struct GameRecord *rec
     }
 
     record->set = 1;
-    unsigned short idx = findNextRowToFill(table->rows, MAX_ROWS_GAMES);
+    unsigned short idx = findNextRowToFill(&table->meta);
+    if (idx == 0) { return MORK_ERROR_DB_TABLE_FULL; }
 
     memcpy(&table->rows[idx], record, sizeof(struct GameRecord));
     table->rows[idx].set = 1;
+    TableMeta_markRow(&table->meta, idx);
 
     return MORK_OK;
 }
@@ -136,12 +168,12 @@ enum MorkResult GameTable_update(struct GameTable *table, struct GameRecord *rec
         return MORK_ERROR_DB_RECORD_NULL;
     }
 
-    for (int i = 0; i < MAX_ROWS_GAMES; i++) {
-        if (table->rows[i].id == record->id) {
-            memcpy(&table->rows[i], record, sizeof(struct GameRecord));
-            table->rows[i].set = 1;
-            return MORK_OK;
-        }
+    int idx = TableMeta_lookup(&table->meta, record->id);
+    if (idx >= 0) {
+        memcpy(&table->rows[idx], record, sizeof(struct GameRecord));
+        table->rows[idx].set = 1;
+        TableMeta_markRow(&table->meta, idx);
+        return MORK_OK;
     }
 
     return GameTable_insert(table, record);
@@ -153,12 +185,12 @@ enum MorkResult GameTable_delete(struct GameTable *table, unsigned short id)
         return MORK_ERROR_DB_TABLE_NULL;
     }
 
-    for (int i = 0; i < MAX_ROWS_GAMES; i++) {
-        if (table->rows[i].id == id) {
-            table->rows[i].id = 0;
-            table->rows[i].set = 0;
-            return MORK_OK;
-        }
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0) {
+        table->rows[idx].set = 0;
+        TableMeta_markRow(&table->meta, idx);
+        table->rows[idx].id = 0;
+        return MORK_OK;
     }
 
     return MORK_ERROR_DB_NOT_FOUND;
@@ -170,12 +202,9 @@ enum MorkResult GameTable_print(struct GameTable *table)
         return MORK_ERROR_DB_TABLE_NULL;
     }
 
-    for (int i = 0; i < MAX_ROWS_GAMES; i++) {
-        struct GameRecord *row = &table->rows[i];
-        if (row->set == 1) {
-            if (GameRecord_print(row) != MORK_OK) {
-                return MORK_ERROR_DB;
-            }
+    for (int i = TableMeta_nextLive(&table->meta, 0); i >= 0; i = TableMeta_nextLive(&table->meta, i + 1)) {
+        if (GameRecord_print(&table->rows[i]) != MORK_OK) {
+            return MORK_ERROR_DB;
         }
         printf("\n");
     }
@@ -3,6 +3,7 @@
 #define MAX_ROWS_GAMES 65535
 
 #include "../../utils/error.h"
+#include "row.h"
 
 #include <stdlib.h>
 
@@ -21,11 +22,13 @@ enum MorkResult GameRecord_setLocationID(struct GameRecord *record, unsigned sho
 enum MorkResult GameRecord_print(struct GameRecord *record);
 
 struct GameTable {
-    struct GameRecord rows[MAX_ROWS_GAMES];
+    struct TableMeta meta;
+    struct GameRecord *rows;
 };
 
 enum MorkResult GameTable_init(struct GameTable *table);
 struct GameTable *GameTable_create();
+struct GameTable *GameTable_createMapped(struct GameRecord *rows);
 enum MorkResult GameTable_destroy(struct GameTable *table);
 
 struct GameRecord *GameTable_get(struct GameTable *table, unsigned short id);
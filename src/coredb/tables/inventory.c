@@ -20,7 +20,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "row.h"
 
 #include <lcthw/dbg.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
 struct InventoryRecord* InventoryRecord_create(unsigned short id, unsigned short owner_id)
 {
@@ -33,9 +35,7 @@ struct InventoryRecord* InventoryRecord_create(unsigned short id, unsigned short
     record->id = id;
     record->set = 1;
     record->owner_id = owner_id;
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        record->item_ids[i] = 0;
-    }
+    record->item_count = 0;
 
     return record;
 
@@ -57,13 +57,10 @@ enum MorkResult InventoryRecord_addItem(struct InventoryRecord* record, unsigned
     if (record == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
     if (item_id == 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        if (record->item_ids[i] == 0) {
-            record->item_ids[i] = item_id;
-            return MORK_OK;
-        }
-    }
-    return MORK_ERROR_DB_FIELD_FULL;
+    if (record->item_count >= MAX_INVENTORY_ITEMS) { return MORK_ERROR_DB_FIELD_FULL; }
+
+    record->item_ids[record->item_count++] = item_id;
+    return MORK_OK;
 }
 
 enum MorkResult InventoryRecord_removeItem(struct InventoryRecord* record, unsigned short item_id)
@@ -71,9 +68,12 @@ enum MorkResult InventoryRecord_removeItem(struct InventoryRecord* record, unsig
     if (record == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
     if (item_id == 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
+    for (unsigned short i = 0; i < record->item_count; i++) {
         if (record->item_ids[i] == item_id) {
-            record->item_ids[i] = 0;
+            // Close the gap so the held ids stay packed and in order
+            memmove(&record->item_ids[i], &record->item_ids[i + 1],
+                    (record->item_count - i - 1) * sizeof(unsigned short));
+            record->item_ids[--record->item_count] = 0;
             return MORK_OK;
         }
     }
@@ -83,14 +83,7 @@ enum MorkResult InventoryRecord_removeItem(struct InventoryRecord* record, unsig
 unsigned short InventoryRecord_getItemCount(struct InventoryRecord* record)
 {
     if (record == NULL) return 0;
-
-    unsigned short count = 0;
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        if (record->item_ids[i] != 0) {
-            count++;
-        }
-    }
-    return count;
+    return record->item_count;
 }
 
 unsigned short InventoryRecord_getID(struct InventoryRecord* record)
@@ -114,7 +107,9 @@ enum MorkResult InventoryTable_init(struct InventoryTable* table)
     for (int i = 0; i < MAX_ROWS_INVENTORIES; i++) {
         memset(&table->rows[i], 0, sizeof(struct InventoryRecord));
     }
-    
+    TableMeta_markAll(&table->meta);
+    TableMeta_invalidate(&table->meta);
+
     return MORK_OK;
 }
 
@@ -122,11 +117,41 @@ struct InventoryTable* InventoryTable_create()
 {
     struct InventoryTable* table = calloc(1, sizeof(struct InventoryTable));
     check_mem(table);
+    table->rows = calloc(MAX_ROWS_INVENTORIES, sizeof(struct InventoryRecord));
+    check_mem(table->rows);
+    check(TableMeta_init(&table->meta, table->rows, sizeof(struct InventoryRecord), MAX_ROWS_INVENTORIES) == MORK_OK,
+          "Failed to initialize table meta");
+    TableMeta_setKeyColumn(&table->meta, offsetof(struct InventoryRecord, owner_id));
+    table->meta.zeroed = 1; // calloc'd, so every row starts unset
+    return table;
 
-    InventoryTable_init(table);
+error:
+    return NULL;
+}
+
+/**
+ * @brief Create a InventoryTable on top of existing row storage, such as a region of
+ *        a mapped database file. The rows are used as they are and are not
+ *        freed when the table is destroyed.
+ *
+ * @param rows Storage for MAX_ROWS_INVENTORIES rows
+ * @return struct InventoryTable*
+ */
+struct InventoryTable *InventoryTable_createMapped(struct InventoryRecord *rows)
+{
+    struct InventoryTable *table = NULL;
+    check(rows != NULL, "Expected row storage, got NULL");
+    table = calloc(1, sizeof(struct InventoryTable));
+    check_mem(table);
+    table->rows = rows;
+    check(TableMeta_init(&table->meta, table->rows, sizeof(struct InventoryRecord), MAX_ROWS_INVENTORIES) == MORK_OK,
+          "Failed to initialize table meta");
+    TableMeta_setKeyColumn(&table->meta, offsetof(struct InventoryRecord, owner_id));
+    table->meta.borrowed = 1;
     return table;
 
 error:
+    if (table) { free(table); }
     return NULL;
 }
 
@@ -135,6 +160,8 @@ enum MorkResult InventoryTable_destroy(struct InventoryTable* table)
     if (table == NULL) {
         return MORK_ERROR_DB_TABLE_NULL;
     }
+    TableMeta_destroy(&table->meta);
+    if (!table->meta.borrowed) { free(table->rows); }
     free(table);
     return MORK_OK;
 }
@@ -148,18 +175,16 @@ enum MorkResult InventoryTable_add(struct InventoryTable *table, unsigned short
         return MORK_ERROR_DB_INVALID_ID;
     }
 
-    for (int i = 0; i < MAX_ROWS_INVENTORIES; i++) {
-        if (table->rows[i].set == 0 && table->rows[i].id == 0) {
-            table->rows[i].set = 1;
-            table->rows[i].id = junction_id;
-            table->rows[i].owner_id = owner_id;
-            for (int j = 0; j < MAX_INVENTORY_ITEMS; j++) {
-                table->rows[i].item_ids[j] = 0;
-            }
-            return MORK_OK;
-        }
-    }
-    return MORK_ERROR_DB_TABLE_FULL;
+    unsigned short idx = findNextRowToFill(&table->meta);
+    if (idx == 0) { return MORK_ERROR_DB_TABLE_FULL; }
+
+    table->rows[idx].set = 1;
+    table->rows[idx].id = junction_id;
+    table->rows[idx].owner_id = owner_id;
+    table->rows[idx].item_count = 0;
+    memset(table->rows[idx].item_ids, 0, sizeof(table->rows[idx].item_ids));
+    TableMeta_markRow(&table->meta, idx);
+    return MORK_OK;
 }
 
 enum MorkResult InventoryTable_update(struct InventoryTable *table, struct InventoryRecord *record)
@@ -167,14 +192,22 @@ enum MorkResult InventoryTable_update(struct InventoryTable *table, struct Inven
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
     if (record == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    for (int i = 0; i < MAX_ROWS_INVENTORIES; i++) {
-        if (table->rows[i].set == 1 && table->rows[i].id == record->id) {
-            table->rows[i].owner_id = record->owner_id;
-            for (int j = 0; j < MAX_INVENTORY_ITEMS; j++) {
-                table->rows[i].item_ids[j] = record->item_ids[j];
-            }
-            return MORK_OK;
+    if (record->item_count > MAX_INVENTORY_ITEMS) { return MORK_ERROR_DB_INVALID_DATA; }
+
+    int idx = TableMeta_lookup(&table->meta, record->id);
+    if (idx >= 0) {
+        struct InventoryRecord *row = &table->rows[idx];
+        row->owner_id = record->owner_id;
+
+        // Only the held ids are copied; a shrinking list clears what it left behind
+        memcpy(row->item_ids, record->item_ids, record->item_count * sizeof(unsigned short));
+        if (row->item_count > record->item_count) {
+            memset(&row->item_ids[record->item_count], 0,
+                   (row->item_count - record->item_count) * sizeof(unsigned short));
         }
+        row->item_count = record->item_count;
+        TableMeta_markRow(&table->meta, idx);
+        return MORK_OK;
     }
     return MORK_ERROR_DB_NOT_FOUND;
 }
@@ -184,16 +217,15 @@ enum MorkResult InventoryTable_remove(struct InventoryTable *table, unsigned sho
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
     if (id == 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    for (int i = 0; i < MAX_ROWS_INVENTORIES; i++) {
-        if (table->rows[i].set == 1 && table->rows[i].id == id) {
-            table->rows[i].set = 0;
-            table->rows[i].id = 0;
-            table->rows[i].owner_id = 0;
-            for (int j = 0; j < MAX_INVENTORY_ITEMS; j++) {
-                table->rows[i].item_ids[j] = 0;
-            }
-            return MORK_OK;
-        }
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0) {
+        table->rows[idx].set = 0;
+        TableMeta_markRow(&table->meta, idx);
+        table->rows[idx].id = 0;
+        table->rows[idx].owner_id = 0;
+        memset(table->rows[idx].item_ids, 0, table->rows[idx].item_count * sizeof(unsigned short));
+        table->rows[idx].item_count = 0;
+        return MORK_OK;
     }
     return MORK_ERROR_DB_NOT_FOUND;
 }
@@ -203,10 +235,9 @@ struct InventoryRecord* InventoryTable_get(struct InventoryTable *table, unsigne
     check(table != NULL, "Expected a valid table, got NULL");
     check(id != 0, "Expected a valid ID");
 
-    for (int i = 0; i < MAX_ROWS_INVENTORIES; i++) {
-        if (table->rows[i].set == 1 && table->rows[i].id == id) {
-            return &table->rows[i];
-        }
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0) {
+        return &table->rows[idx];
     }
 
 error:
@@ -218,10 +249,9 @@ struct InventoryRecord* InventoryTable_getByOwner(struct InventoryTable* table,
     check(table != NULL, "Expected valid table, got NULL");
     check(owner_id > 0, "Expected valid Owner ID");
 
-    for (int i = 0; i < MAX_ROWS_INVENTORIES; i++) {
-        if (table->rows[i].set == 1 && table->rows[i].owner_id == owner_id) {
-            return &table->rows[i];
-        }
+    int idx = TableMeta_lookupKey(&table->meta, owner_id);
+    if (idx >= 0) {
+        return &table->rows[idx];
     }
 
 error:
@@ -232,15 +262,11 @@ enum MorkResult InventoryTable_print(struct InventoryTable* table)
 {
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
 
-    for (int i = 0; i < MAX_ROWS_INVENTORIES; i++) {
+    for (int i = TableMeta_nextLive(&table->meta, 0); i >= 0; i = TableMeta_nextLive(&table->meta, i + 1)) {
         struct InventoryRecord* row = &table->rows[i];
-        if (row->set == 1) {
-            log_info("ID: %d, Owner ID: %d", row->id, row->owner_id);
-            for (int j = 0; j < MAX_INVENTORY_ITEMS; j++) {
-                if (row->item_ids[j] != 0) {
-                    log_info("Item ID: %d", row->item_ids[j]);
-                }
-            }
+        log_info("ID: %d, Owner ID: %d", row->id, row->owner_id);
+        for (int j = 0; j < row->item_count; j++) {
+            log_info("Item ID: %d", row->item_ids[j]);
         }
     }
     return MORK_OK;
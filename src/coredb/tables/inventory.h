@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include "../../utils/error.h"
+#include "row.h"
 
 #define MAX_INVENTORY_ITEMS 256
 #define MAX_ROWS_INVENTORIES 65535
@@ -27,6 +28,7 @@ struct InventoryRecord {
     unsigned short id;
     unsigned char set;
     unsigned short owner_id;
+    unsigned short item_count; // item_ids is packed: the first item_count are held, the rest are 0
     unsigned short item_ids[MAX_INVENTORY_ITEMS];
 };
 
@@ -39,10 +41,12 @@ unsigned short InventoryRecord_getID(struct InventoryRecord* record);
 unsigned short InventoryRecord_getOwnerID(struct InventoryRecord* record);
 
 struct InventoryTable {
-    struct InventoryRecord rows[MAX_ROWS_INVENTORIES];
+    struct TableMeta meta;
+    struct InventoryRecord *rows;
 };
 
 struct InventoryTable* InventoryTable_create();
+struct InventoryTable* InventoryTable_createMapped(struct InventoryRecord *rows);
 enum MorkResult InventoryTable_init(struct InventoryTable* table);
 enum MorkResult InventoryTable_destroy(struct InventoryTable* table);
 enum MorkResult InventoryTable_add(struct InventoryTable* table, unsigned short owner_id, int junction_id);
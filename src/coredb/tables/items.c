@@ -61,6 +61,8 @@ enum MorkResult ItemTable_init(struct ItemTable *table) {
     for (int i = 0; i < MAX_ROWS_ITEMS; i++) {
         memset(&table->rows[i], 0, sizeof(struct ItemRecord));
     }
+    TableMeta_markAll(&table->meta);
+    TableMeta_invalidate(&table->meta);
 
     return MORK_OK;
 }
@@ -68,9 +70,13 @@ enum MorkResult ItemTable_init(struct ItemTable *table) {
 struct ItemTable *ItemTable_create()
 {
     struct ItemTable *table = calloc(1, sizeof(struct ItemTable));
-    memset(table, 0, sizeof(struct ItemTable));
     check_mem(table);
-    ItemTable_init(table);
+    table->rows = calloc(MAX_ROWS_ITEMS, sizeof(struct ItemRecord));
+    check_mem(table->rows);
+    check(TableMeta_init(&table->meta, table->rows, sizeof(struct ItemRecord), MAX_ROWS_ITEMS) == MORK_OK,
+          "Failed to initialize table meta");
+    TableMeta_setNameColumn(&table->meta, offsetof(struct ItemRecord, name), MAX_NAME);
+    table->meta.zeroed = 1; // calloc'd, so every row starts unset
 
     return table;
 
@@ -78,9 +84,37 @@ error:
     return NULL;
 }
 
+/**
+ * @brief Create a ItemTable on top of existing row storage, such as a region of
+ *        a mapped database file. The rows are used as they are and are not
+ *        freed when the table is destroyed.
+ *
+ * @param rows Storage for MAX_ROWS_ITEMS rows
+ * @return struct ItemTable*
+ */
+struct ItemTable *ItemTable_createMapped(struct ItemRecord *rows)
+{
+    struct ItemTable *table = NULL;
+    check(rows != NULL, "Expected row storage, got NULL");
+    table = calloc(1, sizeof(struct ItemTable));
+    check_mem(table);
+    table->rows = rows;
+    check(TableMeta_init(&table->meta, table->rows, sizeof(struct ItemRecord), MAX_ROWS_ITEMS) == MORK_OK,
+          "Failed to initialize table meta");
+    TableMeta_setNameColumn(&table->meta, offsetof(struct ItemRecord, name), MAX_NAME);
+    table->meta.borrowed = 1;
+    return table;
+
+error:
+    if (table) { free(table); }
+    return NULL;
+}
+
 enum MorkResult ItemTable_destroy(struct ItemTable *table)
 {
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    TableMeta_destroy(&table->meta);
+    if (!table->meta.borrowed) { free(table->rows); }
     free(table);
     return MORK_OK;
 }
@@ -91,9 +125,11 @@ enum MorkResult ItemTable_newRow(struct ItemTable *it, struct ItemRecord *record
     if (record == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
     record->set = 1;
-    unsigned short idx = findNextRowToFill(it->rows, MAX_ROWS_ITEMS);
+    unsigned short idx = findNextRowToFill(&it->meta);
+    if (idx == 0) { return MORK_ERROR_DB_TABLE_FULL; }
     memcpy(&it->rows[idx], record, sizeof(struct ItemRecord));
     it->rows[idx].set = 1;
+    TableMeta_markRow(&it->meta, idx);
 
     return MORK_OK;
 }
@@ -103,12 +139,12 @@ enum MorkResult ItemTable_update(struct ItemTable *it, struct ItemRecord *record
     if (it == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
     if (record == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    for (unsigned short i = 0; i < MAX_ROWS_ITEMS; i++) {
-        if (it->rows[i].id == record->id) {
-            memcpy(&it->rows[i], record, sizeof(struct ItemRecord));
-            it->rows[i].set = 1;
-            return MORK_OK;
-        }
+    int idx = TableMeta_lookup(&it->meta, record->id);
+    if (idx >= 0) {
+        memcpy(&it->rows[idx], record, sizeof(struct ItemRecord));
+        it->rows[idx].set = 1;
+        TableMeta_markRow(&it->meta, idx);
+        return MORK_OK;
     }
 
     return ItemTable_newRow(it, record);
@@ -120,10 +156,9 @@ struct ItemRecord *ItemTable_get(struct ItemTable *table, unsigned short id)
     check(table->rows != NULL, "Expected valid rows, got NULL");
     check(id > 0, "Expected a valid ID");
 
-    for (int i = 0; i < MAX_ROWS_ITEMS; i++) {
-        if (table->rows[i].set == 1 && table->rows[i].id == id) {
-            return &table->rows[i];
-        }
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0) {
+        return &table->rows[idx];
     }
 
     log_err("Item not found (by ID).");
@@ -137,10 +172,9 @@ struct ItemRecord *ItemTable_getByName(struct ItemTable *table, char *name)
     check(table != NULL, "Expected a valid table, got NULL");
     check(name != NULL && strcmp(name, "") != 0, "Expected a valid name");
 
-    for (int i = 0; i < MAX_ROWS_ITEMS; i++) {
-        if (strncmp(table->rows[i].name, name, MAX_NAME) == 0) {
-            return &table->rows[i];
-        }
+    int idx = TableMeta_lookupName(&table->meta, name);
+    if (idx >= 0) {
+        return &table->rows[idx];
     }
 
     log_err("Item not found (by name).");
@@ -153,10 +187,8 @@ enum MorkResult ItemTable_list(struct ItemTable *table)
 {
     if (table == NULL) return MORK_ERROR_DB_TABLE_NULL; 
 
-    for (int i = 0; i < MAX_ROWS_ITEMS; i++) {
-        if (table->rows[i].set == 1) {
-            log_info("ID: %d, Name: %s, Description ID: %d", table->rows[i].id, table->rows[i].name, table->rows[i].description_id);
-        }
+    for (int i = TableMeta_nextLive(&table->meta, 0); i >= 0; i = TableMeta_nextLive(&table->meta, i + 1)) {
+        log_info("ID: %d, Name: %s, Description ID: %d", table->rows[i].id, table->rows[i].name, table->rows[i].description_id);
     }
 
     return MORK_OK;
@@ -167,11 +199,11 @@ enum MorkResult ItemTable_delete(struct ItemTable *table, unsigned short id)
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
     if (id == 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    for (int i = 0; i < MAX_ROWS_ITEMS; i++) {
-        if (table->rows[i].id == id) {
-            table->rows[i].set = 0;
-            return MORK_OK;
-        }
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0) {
+        table->rows[idx].set = 0;
+        TableMeta_markRow(&table->meta, idx);
+        return MORK_OK;
     }
 
     return MORK_ERROR_DB_NOT_FOUND;
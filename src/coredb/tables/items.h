@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include "../../utils/error.h"
+#include "row.h"
 
 #define MAX_NAME 124
 #define MAX_ROWS_ITEMS 65535
@@ -34,10 +35,12 @@ struct ItemRecord *ItemRecord_create(unsigned short id, char *name, unsigned sho
 enum MorkResult ItemRecord_destroy(struct ItemRecord *ir);
 
 struct ItemTable {
-    struct ItemRecord rows[MAX_ROWS_ITEMS];
+    struct TableMeta meta;
+    struct ItemRecord *rows;
 };
 
 struct ItemTable *ItemTable_create();
+struct ItemTable *ItemTable_createMapped(struct ItemRecord *rows);
 enum MorkResult ItemTable_init(struct ItemTable *it);
 enum MorkResult ItemTable_destroy(struct ItemTable *it);
 struct ItemRecord *ItemTable_get(struct ItemTable *it, unsigned short index);
@@ -24,7 +24,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 
 struct LocationRecord *LocationRecord_create(
-    unsigned char id,
+    unsigned short id,
     char *name,
     unsigned short descriptionID
 )
@@ -200,28 +200,74 @@ enum MorkResult LocationRecord_removeCharacterID(struct LocationRecord *record,
     return MORK_ERROR_DB_NOT_FOUND;
 }
 
+#define LOCATION_HOT(field) \
+    { offsetof(struct LocationRecord, field), offsetof(struct LocationHot, field), sizeof(((struct LocationHot *)0)->field) }
+
+static const struct HotColumn LocationTable_hotColumns[] = {
+    LOCATION_HOT(id),
+    LOCATION_HOT(set),
+    LOCATION_HOT(descriptionID),
+    LOCATION_HOT(exitIDs),
+    LOCATION_HOT(itemIDs),
+    LOCATION_HOT(characterIDs)
+};
+
+static void LocationTable_setColumns(struct LocationTable *table)
+{
+    TableMeta_setNameColumn(&table->meta, offsetof(struct LocationRecord, name), MAX_NAME);
+    TableMeta_setHotColumns(&table->meta, LocationTable_hotColumns,
+                            sizeof(LocationTable_hotColumns) / sizeof(LocationTable_hotColumns[0]),
+                            sizeof(struct LocationHot));
+}
+
 struct LocationTable *LocationTable_create()
 {
     struct LocationTable *table = (struct LocationTable *)calloc(1, sizeof(struct LocationTable));
-    for (int i = 1; i < MAX_LOCATIONS; i++)
-    {
-        table->locations[i] = (struct LocationRecord)
-        {
-            .id = 0,
-            .set = 0,
-            .name = {0},
-            .descriptionID = 0,
-            .exitIDs = {0},
-            .itemIDs = {0},
-            .characterIDs = {0}
-        };
-    }
+    check_mem(table);
+    table->locations = calloc(MAX_LOCATIONS, sizeof(struct LocationRecord));
+    check_mem(table->locations);
+    check(TableMeta_init(&table->meta, table->locations, sizeof(struct LocationRecord), MAX_LOCATIONS) == MORK_OK,
+          "Failed to initialize table meta");
+    LocationTable_setColumns(table);
+    table->meta.zeroed = 1; // calloc'd, so every row starts unset
     return table;
+
+error:
+    if (table) { free(table); }
+    return NULL;
+}
+
+/**
+ * @brief Create a LocationTable on top of existing row storage, such as a region of
+ *        a mapped database file. The rows are used as they are and are not
+ *        freed when the table is destroyed.
+ *
+ * @param locations Storage for MAX_LOCATIONS rows
+ * @return struct LocationTable*
+ */
+struct LocationTable *LocationTable_createMapped(struct LocationRecord *locations)
+{
+    struct LocationTable *table = NULL;
+    check(locations != NULL, "Expected row storage, got NULL");
+    table = calloc(1, sizeof(struct LocationTable));
+    check_mem(table);
+    table->locations = locations;
+    check(TableMeta_init(&table->meta, table->locations, sizeof(struct LocationRecord), MAX_LOCATIONS) == MORK_OK,
+          "Failed to initialize table meta");
+    LocationTable_setColumns(table);
+    table->meta.borrowed = 1;
+    return table;
+
+error:
+    if (table) { free(table); }
+    return NULL;
 }
 
 enum MorkResult LocationTable_destroy(struct LocationTable *table)
 {
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    TableMeta_destroy(&table->meta);
+    if (!table->meta.borrowed) { free(table->locations); }
     free(table);
     return MORK_OK;
 }
@@ -232,9 +278,11 @@ enum MorkResult LocationTable_add(struct LocationTable *table, struct LocationRe
     if (record == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
     record->set = 1;
-    int next_idx = findNextRowToFill(table->locations, MAX_LOCATIONS);
+    int next_idx = findNextRowToFill(&table->meta);
+    if (next_idx == 0) { return MORK_ERROR_DB_TABLE_FULL; }
     memcpy(&table->locations[next_idx], record, sizeof(struct LocationRecord));
     table->locations[next_idx].set = 1;
+    TableMeta_markRow(&table->meta, next_idx);
 
     return MORK_OK;
 }
@@ -244,30 +292,40 @@ enum MorkResult LocationTable_update(struct LocationTable *table, struct Locatio
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
     if (record == NULL) { return MORK_ERROR_DB_RECORD_NULL; }
 
-    for (int i = 0; i < MAX_LOCATIONS; i++)
+    int idx = TableMeta_lookup(&table->meta, record->id);
+    if (idx >= 0)
     {
-        if (table->locations[i].set == 1 && table->locations[i].id == record->id)
-        {
-            memcpy(&table->locations[i], record, sizeof(struct LocationRecord));
-            table->locations[i].set = 1;
-            return MORK_OK;
-        }
+        memcpy(&table->locations[idx], record, sizeof(struct LocationRecord));
+        table->locations[idx].set = 1;
+        TableMeta_markRow(&table->meta, idx);
+        return MORK_OK;
     }
 
     return LocationTable_add(table, record);
 }
 
+/**
+ * @brief Get the hot columns of every row, indexed like the rows. Check set
+ *        before using a row.
+ *
+ * @param table The table
+ * @return const struct LocationHot* MAX_LOCATIONS hot rows, or NULL
+ */
+const struct LocationHot *LocationTable_hotRows(struct LocationTable *table)
+{
+    if (table == NULL) { return NULL; }
+    return TableMeta_hotRows(&table->meta);
+}
+
 struct LocationRecord *LocationTable_get(struct LocationTable *table, unsigned short id)
 {
     check(table != NULL, "Expected a valid table");
     check(id != 0, "Invalid ID given: 0");
 
-    for (int i = 0; i < MAX_LOCATIONS; i++)
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0)
     {
-        if (table->locations[i].set == 1 && table->locations[i].id == id)
-        {
-            return &table->locations[i];
-        }
+        return &table->locations[idx];
     }
 
     log_err("Location not found (by ID).");
@@ -281,13 +339,12 @@ enum MorkResult LocationTable_remove(struct LocationTable *table, unsigned short
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
     if (id == 0) { return MORK_ERROR_DB_INVALID_ID; }
 
-    for (int i = 0; i < MAX_LOCATIONS; i++)
+    int idx = TableMeta_lookup(&table->meta, id);
+    if (idx >= 0)
     {
-        if (table->locations[i].id == id && table->locations[i].set == 1)
-        {
-            table->locations[i].set = 0;
-            return MORK_OK;
-        }
+        table->locations[idx].set = 0;
+        TableMeta_markRow(&table->meta, idx);
+        return MORK_OK;
     }
 
     return MORK_ERROR_DB_NOT_FOUND;
@@ -298,12 +355,10 @@ struct LocationRecord *LocationTable_getByName(struct LocationTable *table, char
     check(table != NULL, "Expected a valid table, got NULL");
     check(name != NULL && strcmp(name, "") != 0, "Expected a name");
 
-    for (int i = 0; i < MAX_LOCATIONS; i++)
+    int idx = TableMeta_lookupName(&table->meta, name);
+    if (idx >= 0)
     {
-        if (table->locations[i].set == 1 && strcmp(table->locations[i].name, name) == 0)
-        {
-            return &table->locations[i];
-        }
+        return &table->locations[idx];
     }
 
     log_err("Location not found (by name).");
@@ -316,13 +371,9 @@ enum MorkResult LocationTable_print(struct LocationTable *table)
 {
     if (table == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
 
-    for (int i = 0; i < MAX_LOCATIONS; i++)
-    {
+    for (int i = TableMeta_nextLive(&table->meta, 0); i >= 0; i = TableMeta_nextLive(&table->meta, i + 1)) {
         struct LocationRecord *record = &table->locations[i];
-        if (record->id != 0)
-        {
-            log_info("ID: %d, Name: %s, Description ID: %d", record->id, record->name, record->descriptionID);
-        }
+        log_info("ID: %d, Name: %s, Description ID: %d", record->id, record->name, record->descriptionID);
     }
 
     return MORK_OK;
@@ -15,7 +15,9 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#pragma once
 #include "../../utils/error.h"
+#include "row.h"
 
 #define MAX_EXITS 6
 #define MAX_ITEMS 10
@@ -24,7 +26,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define MAX_NAME 124
 
 struct LocationRecord {
-    unsigned char id;
+    unsigned short id;
     unsigned char set;
     char name[MAX_NAME];
     unsigned short descriptionID;
@@ -33,8 +35,19 @@ struct LocationRecord {
     unsigned short characterIDs[MAX_CHARACTERS];
 };
 
+// Everything a walk over the map reads, packed without the name: 58 bytes
+// a row against the record's 182. See LocationTable_hotRows.
+struct LocationHot {
+    unsigned short id;
+    unsigned char set;
+    unsigned short descriptionID;
+    unsigned short exitIDs[MAX_EXITS];
+    unsigned short itemIDs[MAX_ITEMS];
+    unsigned short characterIDs[MAX_CHARACTERS];
+};
+
 struct LocationRecord *LocationRecord_create(
-    unsigned char id,
+    unsigned short id,
     char *name,
     unsigned short descriptionID
 );
@@ -53,14 +66,17 @@ enum MorkResult LocationRecord_removeItemID(struct LocationRecord *record, unsig
 enum MorkResult LocationRecord_removeCharacterID(struct LocationRecord *record, unsigned short characterID);
 
 struct LocationTable {
-    struct LocationRecord locations[MAX_LOCATIONS];
+    struct TableMeta meta;
+    struct LocationRecord *locations;
 };
 
 struct LocationTable *LocationTable_create();
+struct LocationTable *LocationTable_createMapped(struct LocationRecord *locations);
 enum MorkResult LocationTable_destroy(struct LocationTable *table);
 
 enum MorkResult LocationTable_add(struct LocationTable *table, struct LocationRecord *record);
 enum MorkResult LocationTable_update(struct LocationTable *table, struct LocationRecord *record);
+const struct LocationHot *LocationTable_hotRows(struct LocationTable *table);
 struct LocationRecord *LocationTable_get(struct LocationTable *table, unsigned short id);
 enum MorkResult LocationTable_remove(struct LocationTable *table, unsigned short id);
 struct LocationRecord *LocationTable_getByName(struct LocationTable *table, char *name);
@@ -1,25 +1,1046 @@
 #include "row.h"
 
-unsigned short findNextRowToFill(void *rows, int search_depth)
-{
-    struct GenericRow *grows = (struct GenericRow *)rows;
-    unsigned short idx = 0;
-    for (int i = 1; i < search_depth; i++) {
-        if (grows[i].set == 0) {
-            idx = i;
-            grows[i].set = 1;
-            break;
-        }
-    }
-    if (idx == 0) {
-        // No empty rows, so find oldest and overwrite
-        int min_id = 65535;
-        for (int i = 1; i < search_depth; i++) {
-            if (grows[i].id < min_id) {
-                min_id = grows[i].id;
-                idx = i;
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief Describe a table's row storage and allocate its dirty page bitmap.
+ *
+ * @param meta      The meta to initialize
+ * @param rows      Base of the row array
+ * @param row_size  Size of a single row in bytes
+ * @param capacity  Number of rows in the array
+ * @return enum MorkResult
+ */
+enum MorkResult TableMeta_init(struct TableMeta *meta, void *rows, size_t row_size, unsigned int capacity)
+{
+    if (meta == NULL || rows == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+
+    meta->rows = rows;
+    meta->row_size = row_size;
+    meta->capacity = capacity;
+    meta->borrowed = 0;
+
+    meta->page_count = (row_size * capacity + ROW_PAGE_SIZE - 1) / ROW_PAGE_SIZE;
+    meta->dirty = calloc((meta->page_count + 7) / 8, 1);
+    if (meta->dirty == NULL) { return MORK_ERROR_DB; }
+    meta->dirty_count = 0;
+
+    meta->live = NULL;
+    meta->live_ids = NULL;
+    meta->live_words = (capacity + 63) / 64;
+    meta->live_count = 0;
+    meta->live_built = 0;
+
+    meta->slot_by_id = NULL;
+    meta->indexed = 0;
+
+    meta->key_offset = 0;
+    meta->has_key = 0;
+    meta->slot_by_key = NULL;
+    meta->keys_indexed = 0;
+
+    meta->name_offset = 0;
+    meta->name_size = 0;
+    meta->name_buckets = 0;
+    meta->name_heads = NULL;
+    meta->name_next = NULL;
+    meta->name_filed = NULL;
+    meta->names_indexed = 0;
+
+    meta->sort_offset = 0;
+    meta->sort_size = 0;
+    meta->sorted = NULL;
+    meta->sorted_count = 0;
+    meta->sort_pos = NULL;
+    meta->sort_moves = 0;
+    meta->sort_built = 0;
+
+    meta->hot_columns = NULL;
+    meta->hot_column_count = 0;
+    meta->hot_size = 0;
+    meta->hot = NULL;
+    meta->hot_built = 0;
+
+    meta->free_slots = NULL;
+    meta->free_count = 0;
+    meta->in_free = NULL;
+    meta->free_built = 0;
+    meta->zeroed = 0;
+
+    meta->on_change = NULL;
+    meta->on_change_ctx = NULL;
+
+    return MORK_OK;
+}
+
+void TableMeta_destroy(struct TableMeta *meta)
+{
+    if (meta == NULL) { return; }
+    free(meta->dirty);
+    meta->dirty = NULL;
+    free(meta->live);
+    free(meta->live_ids);
+    meta->live = NULL;
+    meta->live_ids = NULL;
+    meta->live_count = 0;
+    meta->live_built = 0;
+    free(meta->slot_by_id);
+    meta->slot_by_id = NULL;
+    meta->indexed = 0;
+    free(meta->slot_by_key);
+    meta->slot_by_key = NULL;
+    meta->keys_indexed = 0;
+    free(meta->name_heads);
+    free(meta->name_next);
+    free(meta->name_filed);
+    meta->name_heads = NULL;
+    meta->name_next = NULL;
+    meta->name_filed = NULL;
+    meta->names_indexed = 0;
+    free(meta->sorted);
+    free(meta->sort_pos);
+    meta->sorted = NULL;
+    meta->sort_pos = NULL;
+    meta->sorted_count = 0;
+    meta->sort_built = 0;
+    free(meta->hot);
+    meta->hot = NULL;
+    meta->hot_built = 0;
+    free(meta->free_slots);
+    free(meta->in_free);
+    meta->free_slots = NULL;
+    meta->in_free = NULL;
+    meta->free_count = 0;
+    meta->free_built = 0;
+    meta->page_count = 0;
+    meta->dirty_count = 0;
+}
+
+/**
+ * @brief Size in bytes of the row array, which is also its size on disk.
+ */
+size_t TableMeta_size(struct TableMeta *meta)
+{
+    if (meta == NULL) { return 0; }
+    return meta->row_size * meta->capacity;
+}
+
+static struct GenericRow *TableMeta_row(struct TableMeta *meta, unsigned int idx)
+{
+    return (struct GenericRow *)((unsigned char *)meta->rows + (size_t)idx * meta->row_size);
+}
+
+static unsigned short TableMeta_key(struct TableMeta *meta, unsigned int idx)
+{
+    unsigned short key;
+    memcpy(&key, (unsigned char *)TableMeta_row(meta, idx) + meta->key_offset, sizeof(key));
+    return key;
+}
+
+static const char *TableMeta_name(struct TableMeta *meta, unsigned int idx)
+{
+    return (const char *)TableMeta_row(meta, idx) + meta->name_offset;
+}
+
+// FNV-1a over the name, stopping at the terminator or the column width
+static unsigned int TableMeta_nameBucket(struct TableMeta *meta, const char *name)
+{
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < meta->name_size && name[i] != '\0'; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash & (meta->name_buckets - 1);
+}
+
+static void TableMeta_unfileName(struct TableMeta *meta, unsigned int idx)
+{
+    int bucket = meta->name_filed[idx];
+    if (bucket < 0) { return; }
+
+    int *link = &meta->name_heads[bucket];
+    while (*link != -1 && *link != (int)idx) {
+        link = &meta->name_next[*link];
+    }
+    if (*link == (int)idx) {
+        *link = meta->name_next[idx];
+    }
+    meta->name_next[idx] = -1;
+    meta->name_filed[idx] = -1;
+}
+
+static void TableMeta_fileName(struct TableMeta *meta, unsigned int idx)
+{
+    struct GenericRow *grow = TableMeta_row(meta, idx);
+    const char *name = TableMeta_name(meta, idx);
+    if (grow->set != 1 || name[0] == '\0') { return; }
+
+    unsigned int bucket = TableMeta_nameBucket(meta, name);
+    meta->name_next[idx] = meta->name_heads[bucket];
+    meta->name_heads[bucket] = idx;
+    meta->name_filed[idx] = bucket;
+}
+
+static const char *TableMeta_sortKey(struct TableMeta *meta, unsigned int idx)
+{
+    return (const char *)TableMeta_row(meta, idx) + meta->sort_offset;
+}
+
+static int TableMeta_sortCompare(struct TableMeta *meta, unsigned int a, unsigned int b)
+{
+    int cmp = strncmp(TableMeta_sortKey(meta, a), TableMeta_sortKey(meta, b), meta->sort_size);
+    if (cmp != 0) { return cmp; }
+    return (a > b) - (a < b);
+}
+
+// Position among the other sorted rows of the first that does not order
+// before row idx, skipping row idx's own entry at skip (if it has one)
+static unsigned int TableMeta_sortPosition(struct TableMeta *meta, unsigned int idx, unsigned int skip)
+{
+    unsigned int lo = 0;
+    unsigned int hi = meta->sorted_count - (skip < meta->sorted_count ? 1 : 0);
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        unsigned int at = mid < skip ? mid : mid + 1;
+        if (TableMeta_sortCompare(meta, meta->sorted[at], idx) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void TableMeta_placeSorted(struct TableMeta *meta, unsigned int first, unsigned int end)
+{
+    for (unsigned int i = first; i < end; i++) {
+        meta->sort_pos[meta->sorted[i]] = i + 1;
+    }
+    meta->sort_moves += end - first;
+}
+
+static void TableMeta_resortRow(struct TableMeta *meta, unsigned int idx)
+{
+    unsigned int was = meta->sort_pos[idx];
+    int keep = TableMeta_row(meta, idx)->set == 1 && TableMeta_sortKey(meta, idx)[0] != '\0';
+    if (was == 0 && !keep) { return; }
+
+    unsigned int from = was != 0 ? was - 1 : meta->sorted_count;
+    if (!keep) {
+        memmove(&meta->sorted[from], &meta->sorted[from + 1], (meta->sorted_count - from - 1) * sizeof(unsigned short));
+        meta->sorted_count--;
+        meta->sort_pos[idx] = 0;
+        TableMeta_placeSorted(meta, from, meta->sorted_count);
+    } else if (was == 0) {
+        unsigned int to = TableMeta_sortPosition(meta, idx, from);
+        memmove(&meta->sorted[to + 1], &meta->sorted[to], (meta->sorted_count - to) * sizeof(unsigned short));
+        meta->sorted[to] = idx;
+        meta->sorted_count++;
+        TableMeta_placeSorted(meta, to, meta->sorted_count);
+    } else {
+        // Only the entries between the old and new place shift; an update
+        // that leaves the text's order alone moves nothing
+        unsigned int to = TableMeta_sortPosition(meta, idx, from);
+        if (to < from) {
+            memmove(&meta->sorted[to + 1], &meta->sorted[to], (from - to) * sizeof(unsigned short));
+            meta->sorted[to] = idx;
+            TableMeta_placeSorted(meta, to, from + 1);
+        } else if (to > from) {
+            memmove(&meta->sorted[from], &meta->sorted[from + 1], (to - from) * sizeof(unsigned short));
+            meta->sorted[to] = idx;
+            TableMeta_placeSorted(meta, from, to + 1);
+        }
+    }
+
+    // A bulk load or replay inserting rows one by one would shift most of the
+    // index each time; past what a sort costs, drop it and sort once instead
+    if (meta->sort_moves > (unsigned long)meta->sorted_count * SORT_MOVES_PER_ROW) {
+        meta->sort_built = 0;
+    }
+}
+
+static void TableMeta_pushFree(struct TableMeta *meta, unsigned int idx)
+{
+    unsigned char bit = 1 << (idx % 8);
+    if ((meta->in_free[idx / 8] & bit) == 0) {
+        meta->in_free[idx / 8] |= bit;
+        meta->free_slots[meta->free_count++] = idx;
+    }
+}
+
+static void TableMeta_gatherHot(struct TableMeta *meta, unsigned int idx)
+{
+    const unsigned char *row = (const unsigned char *)TableMeta_row(meta, idx);
+    unsigned char *hot = meta->hot + (size_t)idx * meta->hot_size;
+    for (unsigned int c = 0; c < meta->hot_column_count; c++) {
+        const struct HotColumn *col = &meta->hot_columns[c];
+        memcpy(hot + col->hot_offset, row + col->row_offset, col->size);
+    }
+}
+
+static void TableMeta_markPage(struct TableMeta *meta, unsigned int page)
+{
+    unsigned char bit = 1 << (page % 8);
+    if ((meta->dirty[page / 8] & bit) == 0) {
+        meta->dirty[page / 8] |= bit;
+        meta->dirty_count++;
+    }
+}
+
+/**
+ * @brief Record that a row changed: mark every page it lives on as needing a
+ *        write and bring its index entries and free slot up to date.
+ *
+ * @param meta The table's meta
+ * @param idx  Index of the row that changed
+ */
+void TableMeta_markRow(struct TableMeta *meta, unsigned int idx)
+{
+    if (meta == NULL || meta->dirty == NULL || idx >= meta->capacity) { return; }
+
+    // Building from zeroed rows is free, and doing it before the first
+    // change means no later build ever has to scan for it
+    if (meta->zeroed) {
+        if (!meta->live_built) { TableMeta_reindexLive(meta); }
+        if (!meta->indexed) { TableMeta_reindex(meta); }
+        if (!meta->keys_indexed && meta->has_key) { TableMeta_reindexKeys(meta); }
+        if (!meta->names_indexed && meta->name_size != 0) { TableMeta_reindexNames(meta); }
+        if (!meta->hot_built && meta->hot_size != 0) { TableMeta_reindexHot(meta); }
+        if (!meta->free_built) { TableMeta_rebuildFreeSlots(meta); }
+    }
+
+    if (meta->live_built) {
+        struct GenericRow *grow = TableMeta_row(meta, idx);
+        unsigned long long bit = 1ULL << (idx % 64);
+        unsigned long long *word = &meta->live[idx / 64];
+        if (grow->set == 1) {
+            if ((*word & bit) == 0) { meta->live_count++; }
+            *word |= bit;
+            meta->live_ids[idx] = grow->id;
+        } else {
+            if ((*word & bit) != 0) { meta->live_count--; }
+            *word &= ~bit;
+            meta->live_ids[idx] = 0;
+        }
+    }
+
+    if (meta->indexed) {
+        struct GenericRow *grow = TableMeta_row(meta, idx);
+        if (grow->set == 1 && grow->id != 0) {
+            // Keep the lowest row for duplicate ids, matching TableMeta_reindex
+            unsigned int current = meta->slot_by_id[grow->id];
+            if (current == 0 || current - 1 > idx || TableMeta_row(meta, current - 1)->id != grow->id ||
+                TableMeta_row(meta, current - 1)->set != 1) {
+                meta->slot_by_id[grow->id] = idx + 1;
             }
+        } else if (meta->slot_by_id[grow->id] == idx + 1) {
+            meta->slot_by_id[grow->id] = 0;
+        }
+    }
+
+    if (meta->keys_indexed) {
+        struct GenericRow *grow = TableMeta_row(meta, idx);
+        unsigned short key = TableMeta_key(meta, idx);
+        if (grow->set == 1 && key != 0) {
+            unsigned int current = meta->slot_by_key[key];
+            if (current == 0 || current - 1 > idx || TableMeta_key(meta, current - 1) != key ||
+                TableMeta_row(meta, current - 1)->set != 1) {
+                meta->slot_by_key[key] = idx + 1;
+            }
+        } else if (meta->slot_by_key[key] == idx + 1) {
+            meta->slot_by_key[key] = 0;
+        }
+    }
+
+    if (meta->names_indexed) {
+        TableMeta_unfileName(meta, idx);
+        TableMeta_fileName(meta, idx);
+    }
+
+    if (meta->sort_built) {
+        TableMeta_resortRow(meta, idx);
+    }
+
+    if (meta->hot_built) {
+        TableMeta_gatherHot(meta, idx);
+    }
+
+    if (meta->free_built && idx != 0 && TableMeta_row(meta, idx)->set != 1) {
+        TableMeta_pushFree(meta, idx);
+    }
+
+    size_t start = idx * meta->row_size;
+    size_t end = start + meta->row_size - 1;
+    for (size_t page = start / ROW_PAGE_SIZE; page <= end / ROW_PAGE_SIZE; page++) {
+        TableMeta_markPage(meta, page);
+    }
+
+    if (meta->on_change) {
+        meta->on_change(meta->on_change_ctx, meta, idx);
+    }
+}
+
+void TableMeta_markAll(struct TableMeta *meta)
+{
+    if (meta == NULL || meta->dirty == NULL) { return; }
+    memset(meta->dirty, 0xFF, (meta->page_count + 7) / 8);
+    meta->dirty_count = meta->page_count;
+}
+
+void TableMeta_clearDirty(struct TableMeta *meta)
+{
+    if (meta == NULL || meta->dirty == NULL) { return; }
+    memset(meta->dirty, 0, (meta->page_count + 7) / 8);
+    meta->dirty_count = 0;
+}
+
+/**
+ * @brief Find the next run of consecutive dirty pages at or after start.
+ *
+ * @param meta  The table's meta
+ * @param start The page to start searching from
+ * @param first Set to the first page of the run
+ * @return unsigned int The number of pages in the run, 0 if there are none left
+ */
+unsigned int TableMeta_nextDirtyRun(struct TableMeta *meta, unsigned int start, unsigned int *first)
+{
+    if (meta == NULL || meta->dirty == NULL || meta->dirty_count == 0) { return 0; }
+
+    unsigned int page = start;
+    while (page < meta->page_count && (meta->dirty[page / 8] & (1 << (page % 8))) == 0) {
+        // Skip clean bytes wholesale
+        if (page % 8 == 0 && meta->dirty[page / 8] == 0) {
+            page += 8;
+        } else {
+            page++;
+        }
+    }
+    if (page >= meta->page_count) { return 0; }
+
+    *first = page;
+    while (page < meta->page_count && (meta->dirty[page / 8] & (1 << (page % 8))) != 0) {
+        page++;
+    }
+    return page - *first;
+}
+
+/**
+ * @brief Rebuild the occupancy bitmap and packed ids. This is the one build
+ *        that has to visit every row; the others then only visit live ones.
+ *
+ * @param meta The table's meta
+ * @return enum MorkResult
+ */
+enum MorkResult TableMeta_reindexLive(struct TableMeta *meta)
+{
+    if (meta == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+
+    size_t padded = (size_t)meta->live_words * 64;
+    if (meta->live == NULL) {
+        meta->live = malloc(meta->live_words * sizeof(unsigned long long));
+        meta->live_ids = malloc(padded * sizeof(unsigned short));
+        if (meta->live == NULL || meta->live_ids == NULL) { return MORK_ERROR_DB; }
+    }
+    memset(meta->live, 0, meta->live_words * sizeof(unsigned long long));
+    memset(meta->live_ids, 0, padded * sizeof(unsigned short));
+    meta->live_count = 0;
+
+    for (unsigned int i = 0; !meta->zeroed && i < meta->capacity; i++) {
+        struct GenericRow *grow = TableMeta_row(meta, i);
+        if (grow->set == 1) {
+            meta->live[i / 64] |= 1ULL << (i % 64);
+            meta->live_ids[i] = grow->id;
+            meta->live_count++;
+        }
+    }
+    meta->live_built = 1;
+
+    return MORK_OK;
+}
+
+/**
+ * @brief Find the first live row at or after start.
+ *
+ * @param meta  The table's meta
+ * @param start Row to start from
+ * @return int The row index, -1 if there are no more live rows
+ */
+int TableMeta_nextLive(struct TableMeta *meta, unsigned int start)
+{
+    if (meta == NULL || start >= meta->capacity) { return -1; }
+    if (!meta->live_built && TableMeta_reindexLive(meta) != MORK_OK) { return -1; }
+
+    unsigned int w = start / 64;
+    unsigned long long bits = meta->live[w] & (~0ULL << (start % 64));
+    while (bits == 0) {
+        if (++w >= meta->live_words) { return -1; }
+        bits = meta->live[w];
+    }
+    return (int)(w * 64 + __builtin_ctzll(bits));
+}
+
+/**
+ * @brief Count the live rows.
+ */
+unsigned int TableMeta_liveCount(struct TableMeta *meta)
+{
+    if (meta == NULL) { return 0; }
+    if (!meta->live_built && TableMeta_reindexLive(meta) != MORK_OK) { return 0; }
+    return meta->live_count;
+}
+
+/**
+ * @brief Find the first live row holding an id without the primary key
+ *        index. Empty rows have id 0 in the packed column, so a match is
+ *        always live; words with no live rows are skipped outright and the
+ *        rest are compared sixteen ids at a time where SSE2 is available.
+ *
+ * @param meta The table's meta
+ * @param id   The id to look for
+ * @return int The row index, -1 if no live row has that id
+ */
+int TableMeta_scanId(struct TableMeta *meta, unsigned int id)
+{
+    if (meta == NULL || id == 0 || id > ROW_MAX_ID) { return -1; }
+    if (!meta->live_built && TableMeta_reindexLive(meta) != MORK_OK) { return -1; }
+
+#ifdef __SSE2__
+    const __m128i needle = _mm_set1_epi16((short)id);
+#endif
+    for (unsigned int w = 0; w < meta->live_words; w++) {
+        if (meta->live[w] == 0) { continue; }
+
+        const unsigned short *ids = meta->live_ids + (size_t)w * 64;
+#ifdef __SSE2__
+        for (unsigned int off = 0; off < 64; off += 16) {
+            __m128i lo = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(ids + off)), needle);
+            __m128i hi = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(ids + off + 8)), needle);
+            int mask = _mm_movemask_epi8(_mm_packs_epi16(lo, hi));
+            if (mask != 0) { return (int)(w * 64 + off + __builtin_ctz(mask)); }
+        }
+#else
+        for (unsigned long long bits = meta->live[w]; bits != 0; bits &= bits - 1) {
+            unsigned int i = __builtin_ctzll(bits);
+            if (ids[i] == id) { return (int)(w * 64 + i); }
+        }
+#endif
+    }
+    return -1;
+}
+
+/**
+ * @brief Rebuild the primary key index from the live rows. Called lazily,
+ *        so opening a table never pays for it up front.
+ *
+ * @param meta The table's meta
+ * @return enum MorkResult
+ */
+enum MorkResult TableMeta_reindex(struct TableMeta *meta)
+{
+    if (meta == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+
+    if (meta->slot_by_id == NULL) {
+        meta->slot_by_id = calloc(ROW_MAX_ID + 1, sizeof(unsigned short));
+        if (meta->slot_by_id == NULL) { return MORK_ERROR_DB; }
+    } else {
+        memset(meta->slot_by_id, 0, (ROW_MAX_ID + 1) * sizeof(unsigned short));
+    }
+
+    if (!meta->zeroed) {
+        if (!meta->live_built && TableMeta_reindexLive(meta) != MORK_OK) { return MORK_ERROR_DB; }
+
+        // Rows come in order, so the first of any duplicate ids wins, as a scan would
+        for (int i = TableMeta_nextLive(meta, 0); i >= 0; i = TableMeta_nextLive(meta, i + 1)) {
+            unsigned short id = meta->live_ids[i];
+            if (id != 0 && meta->slot_by_id[id] == 0) {
+                meta->slot_by_id[id] = i + 1;
+            }
+        }
+    }
+    meta->indexed = 1;
+
+    return MORK_OK;
+}
+
+/**
+ * @brief Forget everything derived from the rows (indexes and free slots),
+ *        e.g. after the rows were replaced wholesale from disk. Each is
+ *        rebuilt the next time it is needed.
+ */
+void TableMeta_invalidate(struct TableMeta *meta)
+{
+    if (meta == NULL) { return; }
+    meta->live_built = 0;
+    meta->indexed = 0;
+    meta->keys_indexed = 0;
+    meta->names_indexed = 0;
+    meta->sort_built = 0;
+    meta->hot_built = 0;
+    meta->free_built = 0;
+    meta->zeroed = 0;
+}
+
+/**
+ * @brief Whether the indexes a lookup needs are built, so that it only reads.
+ *        A table without the index asked for has nothing to build for it.
+ *
+ * @param meta  The table's meta
+ * @param index The index the lookup reads
+ * @return int 1 if the lookup will not write to the meta
+ */
+int TableMeta_isPrepared(struct TableMeta *meta, enum TableIndex index)
+{
+    if (meta == NULL) { return 0; }
+    if (!meta->live_built || !meta->indexed) { return 0; }
+
+    switch (index) {
+        case INDEX_KEY:
+            return !meta->has_key || meta->keys_indexed;
+        case INDEX_NAME:
+            return meta->name_size == 0 || meta->names_indexed;
+        case INDEX_SORTED:
+            return meta->sort_size == 0 || meta->sort_built;
+        case INDEX_HOT:
+            return meta->hot_size == 0 || meta->hot_built;
+        default:
+            return 1;
+    }
+}
+
+/**
+ * @brief Build the indexes a lookup needs, if they are missing, so that it
+ *        no longer writes to the meta and can run under a shared lock. The
+ *        other indexes are left for the lookups that need them, so an id
+ *        lookup never pages in a whole table to sort its descriptions.
+ *
+ * @param meta  The table's meta
+ * @param index The index the lookup reads
+ * @return enum MorkResult
+ */
+enum MorkResult TableMeta_prepare(struct TableMeta *meta, enum TableIndex index)
+{
+    if (meta == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+
+    enum MorkResult res = MORK_OK;
+    if (!meta->live_built) { res = TableMeta_reindexLive(meta); }
+    if (res == MORK_OK && !meta->indexed) { res = TableMeta_reindex(meta); }
+    if (res != MORK_OK || TableMeta_isPrepared(meta, index)) { return res; }
+
+    switch (index) {
+        case INDEX_KEY:
+            return TableMeta_reindexKeys(meta);
+        case INDEX_NAME:
+            return TableMeta_reindexNames(meta);
+        case INDEX_SORTED:
+            return TableMeta_reindexSorted(meta);
+        case INDEX_HOT:
+            return TableMeta_reindexHot(meta);
+        default:
+            return MORK_OK;
+    }
+}
+
+/**
+ * @brief Find the row holding the given id.
+ *
+ * @param meta The table's meta
+ * @param id   The id to look up
+ * @return int The row index, -1 if no live row has that id
+ */
+int TableMeta_lookup(struct TableMeta *meta, unsigned int id)
+{
+    if (meta == NULL || id == 0 || id > ROW_MAX_ID) { return -1; }
+    if (!meta->indexed) { return TableMeta_scanId(meta, id); }
+
+    unsigned int slot = meta->slot_by_id[id];
+    if (slot == 0) { return -1; }
+
+    // A row whose id changed without going through markRow leaves its old
+    // entry behind. It is left in place, so a lookup never writes.
+    struct GenericRow *grow = TableMeta_row(meta, slot - 1);
+    if (grow->set != 1 || grow->id != id) { return -1; }
+    return slot - 1;
+}
+
+/**
+ * @brief Declare an unsigned short column to index, such as an owner id.
+ *
+ * @param meta   The table's meta
+ * @param offset Offset of the column within a row
+ */
+void TableMeta_setKeyColumn(struct TableMeta *meta, size_t offset)
+{
+    if (meta == NULL) { return; }
+    meta->key_offset = offset;
+    meta->has_key = 1;
+    meta->keys_indexed = 0;
+}
+
+/**
+ * @brief Rebuild the secondary key index from the rows, on first lookup.
+ *
+ * @param meta The table's meta
+ * @return enum MorkResult
+ */
+enum MorkResult TableMeta_reindexKeys(struct TableMeta *meta)
+{
+    if (meta == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    if (!meta->has_key) { return MORK_ERROR_DB_INVALID_DATA; }
+
+    if (meta->slot_by_key == NULL) {
+        meta->slot_by_key = calloc(ROW_MAX_ID + 1, sizeof(unsigned short));
+        if (meta->slot_by_key == NULL) { return MORK_ERROR_DB; }
+    } else {
+        memset(meta->slot_by_key, 0, (ROW_MAX_ID + 1) * sizeof(unsigned short));
+    }
+
+    if (!meta->zeroed) {
+        if (!meta->live_built && TableMeta_reindexLive(meta) != MORK_OK) { return MORK_ERROR_DB; }
+
+        for (int i = TableMeta_nextLive(meta, 0); i >= 0; i = TableMeta_nextLive(meta, i + 1)) {
+            unsigned short key = TableMeta_key(meta, i);
+            if (key != 0 && meta->slot_by_key[key] == 0) {
+                meta->slot_by_key[key] = i + 1;
+            }
+        }
+    }
+    meta->keys_indexed = 1;
+
+    return MORK_OK;
+}
+
+/**
+ * @brief Find the first row whose key column holds the given value.
+ *
+ * @param meta The table's meta
+ * @param key  The value to look up
+ * @return int The row index, -1 if no live row has that key
+ */
+int TableMeta_lookupKey(struct TableMeta *meta, unsigned int key)
+{
+    if (meta == NULL || !meta->has_key || key == 0 || key > ROW_MAX_ID) { return -1; }
+    if (!meta->keys_indexed && TableMeta_reindexKeys(meta) != MORK_OK) { return -1; }
+
+    unsigned int slot = meta->slot_by_key[key];
+    if (slot == 0) { return -1; }
+
+    // The key may have been changed since, so check rather than trust it
+    if (TableMeta_row(meta, slot - 1)->set != 1 || TableMeta_key(meta, slot - 1) != key) { return -1; }
+    return slot - 1;
+}
+
+/**
+ * @brief Declare the table's name column so it can be looked up by hash.
+ *
+ * @param meta   The table's meta
+ * @param offset Offset of the name within a row
+ * @param size   Width of the name column in bytes
+ */
+void TableMeta_setNameColumn(struct TableMeta *meta, size_t offset, size_t size)
+{
+    if (meta == NULL) { return; }
+    meta->name_offset = offset;
+    meta->name_size = size;
+
+    // Keep chains short: at least one bucket per row, as a power of two
+    meta->name_buckets = 1;
+    while (meta->name_buckets < meta->capacity) {
+        meta->name_buckets <<= 1;
+    }
+    meta->names_indexed = 0;
+}
+
+/**
+ * @brief Rebuild the name index from the rows. Like the primary key index,
+ *        this happens on the first lookup rather than on open.
+ *
+ * @param meta The table's meta
+ * @return enum MorkResult
+ */
+enum MorkResult TableMeta_reindexNames(struct TableMeta *meta)
+{
+    if (meta == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    if (meta->name_size == 0) { return MORK_ERROR_DB_INVALID_DATA; }
+
+    if (meta->name_heads == NULL) {
+        meta->name_heads = malloc(meta->name_buckets * sizeof(int));
+        meta->name_next = malloc(meta->capacity * sizeof(int));
+        meta->name_filed = malloc(meta->capacity * sizeof(int));
+        if (meta->name_heads == NULL || meta->name_next == NULL || meta->name_filed == NULL) {
+            return MORK_ERROR_DB;
+        }
+    }
+    memset(meta->name_heads, 0xFF, meta->name_buckets * sizeof(int));
+    memset(meta->name_next, 0xFF, meta->capacity * sizeof(int));
+    memset(meta->name_filed, 0xFF, meta->capacity * sizeof(int));
+
+    if (!meta->zeroed) {
+        if (!meta->live_built && TableMeta_reindexLive(meta) != MORK_OK) { return MORK_ERROR_DB; }
+
+        for (int i = TableMeta_nextLive(meta, 0); i >= 0; i = TableMeta_nextLive(meta, i + 1)) {
+            TableMeta_fileName(meta, i);
+        }
+    }
+    meta->names_indexed = 1;
+
+    return MORK_OK;
+}
+
+/**
+ * @brief Find the row whose name column matches the given name exactly.
+ *
+ * @param meta The table's meta
+ * @param name The name to look up
+ * @return int The row index, -1 if no live row has that name
+ */
+int TableMeta_lookupName(struct TableMeta *meta, const char *name)
+{
+    if (meta == NULL || name == NULL || meta->name_size == 0) { return -1; }
+    if (!meta->names_indexed && TableMeta_reindexNames(meta) != MORK_OK) { return -1; }
+
+    // Rows are re-filed at the head of their chain when they change, so walk
+    // the whole chain and prefer the lowest row, as a scan would
+    int found = -1;
+    for (int i = meta->name_heads[TableMeta_nameBucket(meta, name)]; i != -1; i = meta->name_next[i]) {
+        if ((found == -1 || i < found) && strncmp(TableMeta_name(meta, i), name, meta->name_size) == 0) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief Declare a text column to keep the rows ordered by, for prefix searches.
+ *
+ * @param meta   The table's meta
+ * @param offset Offset of the text within a row
+ * @param size   Width of the text column in bytes
+ */
+void TableMeta_setSortColumn(struct TableMeta *meta, size_t offset, size_t size)
+{
+    if (meta == NULL) { return; }
+    meta->sort_offset = offset;
+    meta->sort_size = size;
+    meta->sort_built = 0;
+}
+
+/**
+ * @brief Rebuild the ordered index from the rows with a bottom-up merge sort.
+ *        Unlike the other indexes this always reads the rows, so it is only
+ *        ever built by the first prefix search.
+ *
+ * @param meta The table's meta
+ * @return enum MorkResult
+ */
+enum MorkResult TableMeta_reindexSorted(struct TableMeta *meta)
+{
+    if (meta == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    if (meta->sort_size == 0) { return MORK_ERROR_DB_INVALID_DATA; }
+
+    if (meta->sorted == NULL) {
+        meta->sorted = malloc(meta->capacity * sizeof(unsigned short));
+        meta->sort_pos = malloc(meta->capacity * sizeof(unsigned short));
+        if (meta->sorted == NULL || meta->sort_pos == NULL) { return MORK_ERROR_DB; }
+    }
+    memset(meta->sort_pos, 0, meta->capacity * sizeof(unsigned short));
+    meta->sorted_count = 0;
+
+    if (!meta->live_built && TableMeta_reindexLive(meta) != MORK_OK) { return MORK_ERROR_DB; }
+    for (int i = TableMeta_nextLive(meta, 0); i >= 0; i = TableMeta_nextLive(meta, i + 1)) {
+        if (TableMeta_sortKey(meta, i)[0] != '\0') {
+            meta->sorted[meta->sorted_count++] = i;
+        }
+    }
+
+    unsigned int count = meta->sorted_count;
+    unsigned short *scratch = malloc((count ? count : 1) * sizeof(unsigned short));
+    if (scratch == NULL) { return MORK_ERROR_DB; }
+
+    unsigned short *from = meta->sorted;
+    unsigned short *to = scratch;
+    for (unsigned int width = 1; width < count; width *= 2) {
+        for (unsigned int lo = 0; lo < count; lo += 2 * width) {
+            unsigned int mid = lo + width < count ? lo + width : count;
+            unsigned int hi = lo + 2 * width < count ? lo + 2 * width : count;
+            unsigned int a = lo, b = mid, out = lo;
+            while (a < mid && b < hi) {
+                to[out++] = TableMeta_sortCompare(meta, from[a], from[b]) <= 0 ? from[a++] : from[b++];
+            }
+            while (a < mid) { to[out++] = from[a++]; }
+            while (b < hi) { to[out++] = from[b++]; }
+        }
+        unsigned short *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != meta->sorted) {
+        memcpy(meta->sorted, from, count * sizeof(unsigned short));
+    }
+    free(scratch);
+
+    TableMeta_placeSorted(meta, 0, count);
+    meta->sort_moves = 0;
+    meta->sort_built = 1;
+    return MORK_OK;
+}
+
+/**
+ * @brief Find the run of rows whose sort column starts with the prefix.
+ *
+ * @param meta   The table's meta
+ * @param prefix The prefix to match
+ * @param first  Set to the position of the run in meta->sorted
+ * @return unsigned int The number of matching rows
+ */
+unsigned int TableMeta_prefixRange(struct TableMeta *meta, const char *prefix, unsigned int *first)
+{
+    if (meta == NULL || prefix == NULL || first == NULL || meta->sort_size == 0) { return 0; }
+    if (!meta->sort_built && TableMeta_reindexSorted(meta) != MORK_OK) { return 0; }
+
+    size_t len = strnlen(prefix, meta->sort_size);
+    unsigned int lo = 0;
+    unsigned int hi = meta->sorted_count;
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (strncmp(TableMeta_sortKey(meta, meta->sorted[mid]), prefix, len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    unsigned int end = lo;
+    while (end < meta->sorted_count && strncmp(TableMeta_sortKey(meta, meta->sorted[end]), prefix, len) == 0) {
+        end++;
+    }
+    *first = lo;
+    return end - lo;
+}
+
+/**
+ * @brief Declare the table's hot columns. The columns list must outlive the
+ *        table; tables keep theirs in static storage.
+ *
+ * @param meta     The table's meta
+ * @param columns  Where each column sits in a row and in a hot row
+ * @param count    Number of columns
+ * @param hot_size Size of one packed hot row in bytes
+ */
+void TableMeta_setHotColumns(struct TableMeta *meta, const struct HotColumn *columns, unsigned int count, size_t hot_size)
+{
+    if (meta == NULL) { return; }
+    meta->hot_columns = columns;
+    meta->hot_column_count = count;
+    meta->hot_size = hot_size;
+    meta->hot_built = 0;
+}
+
+/**
+ * @brief Rebuild the hot rows by copying the hot columns out of every row.
+ *
+ * @param meta The table's meta
+ * @return enum MorkResult
+ */
+enum MorkResult TableMeta_reindexHot(struct TableMeta *meta)
+{
+    if (meta == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+    if (meta->hot_size == 0) { return MORK_ERROR_DB_INVALID_DATA; }
+
+    if (meta->hot == NULL) {
+        meta->hot = malloc(meta->capacity * meta->hot_size);
+        if (meta->hot == NULL) { return MORK_ERROR_DB; }
+    }
+
+    // Empty rows stay zero, set flag included, so only live rows are copied
+    memset(meta->hot, 0, meta->capacity * meta->hot_size);
+    if (!meta->zeroed) {
+        if (!meta->live_built && TableMeta_reindexLive(meta) != MORK_OK) { return MORK_ERROR_DB; }
+        for (int i = TableMeta_nextLive(meta, 0); i >= 0; i = TableMeta_nextLive(meta, i + 1)) {
+            TableMeta_gatherHot(meta, i);
+        }
+    }
+    meta->hot_built = 1;
+
+    return MORK_OK;
+}
+
+/**
+ * @brief Get the packed hot rows, one per row of the table and in the same
+ *        order, building them if need be.
+ *
+ * @param meta The table's meta
+ * @return const void* capacity hot rows of hot_size bytes, or NULL
+ */
+const void *TableMeta_hotRows(struct TableMeta *meta)
+{
+    if (meta == NULL || meta->hot_size == 0) { return NULL; }
+    if (!meta->hot_built && TableMeta_reindexHot(meta) != MORK_OK) { return NULL; }
+    return meta->hot;
+}
+
+/**
+ * @brief Rebuild the stack of empty rows. Row 0 is never handed out.
+ *
+ * @param meta The table's meta
+ * @return enum MorkResult
+ */
+enum MorkResult TableMeta_rebuildFreeSlots(struct TableMeta *meta)
+{
+    if (meta == NULL) { return MORK_ERROR_DB_TABLE_NULL; }
+
+    if (meta->free_slots == NULL) {
+        meta->free_slots = malloc(meta->capacity * sizeof(unsigned short));
+        meta->in_free = malloc((meta->capacity + 7) / 8);
+        if (meta->free_slots == NULL || meta->in_free == NULL) { return MORK_ERROR_DB; }
+    }
+    memset(meta->in_free, 0, (meta->capacity + 7) / 8);
+    meta->free_count = 0;
+
+    if (!meta->zeroed && !meta->live_built && TableMeta_reindexLive(meta) != MORK_OK) { return MORK_ERROR_DB; }
+
+    // Push from the top down so the lowest empty row is filled first. Full
+    // words have no empty rows, so they are passed over without a look.
+    for (unsigned int w = meta->live_words; w > 0; w--) {
+        unsigned long long empty = meta->zeroed ? ~0ULL : ~meta->live[w - 1];
+        while (empty != 0) {
+            unsigned int i = (w - 1) * 64 + 63 - __builtin_clzll(empty);
+            empty &= ~(1ULL << (i % 64));
+            if (i != 0 && i < meta->capacity) {
+                TableMeta_pushFree(meta, i);
+            }
+        }
+    }
+    meta->free_built = 1;
+
+    return MORK_OK;
+}
+
+/**
+ * @brief Claim an empty row for an insert. The row is marked as set so it
+ *        cannot be handed out twice.
+ *
+ * @param meta The table's meta
+ * @return unsigned short The row index, 0 if the table is full
+ */
+unsigned short findNextRowToFill(struct TableMeta *meta)
+{
+    if (meta == NULL) { return 0; }
+    if (!meta->free_built && TableMeta_rebuildFreeSlots(meta) != MORK_OK) { return 0; }
+
+    while (meta->free_count > 0) {
+        unsigned short idx = meta->free_slots[--meta->free_count];
+        meta->in_free[idx / 8] &= ~(1 << (idx % 8));
+
+        struct GenericRow *grow = TableMeta_row(meta, idx);
+        if (grow->set != 1) {
+            grow->set = 1;
+            return idx;
         }
     }
-    return idx;
-}
\ No newline at end of file
+    return 0;
+}
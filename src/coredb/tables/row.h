@@ -1,8 +1,175 @@
 #pragma once
 
+#include "../../utils/error.h"
+
+#include <stddef.h>
+
+// Dirty tracking granularity, in bytes of a table's on-disk row array
+#define ROW_PAGE_SIZE 4096
+
+// Row ids are unsigned shorts, so the primary key index has one slot per id
+#define ROW_MAX_ID 65535
+
+// Entries of the ordered index a run of changes may shift, per sorted row,
+// before the index is dropped and re-sorted by the next prefix search instead
+#define SORT_MOVES_PER_ROW 16
+
 struct GenericRow {
     unsigned short id;
     unsigned char set;
 };
 
-unsigned short findNextRowToFill(void *rows, int search_depth);
\ No newline at end of file
+// One column of a hot column group: where it sits in a row and where its copy
+// sits in the packed hot row.
+struct HotColumn {
+    size_t row_offset;
+    size_t hot_offset;
+    size_t size;
+};
+
+// The index a lookup reads, so that only that one has to be built before it
+// runs. Every lookup also needs the live rows and the primary key index.
+enum TableIndex {
+    INDEX_ID = 0, // Lookups by id, and walks over the live rows
+    INDEX_KEY,    // TableMeta_lookupKey
+    INDEX_NAME,   // TableMeta_lookupName
+    INDEX_SORTED, // TableMeta_prefixRange
+    INDEX_HOT     // TableMeta_hotRows
+};
+
+// Bookkeeping shared by every table. Each table struct embeds one of these as
+// its first member, so generic code can treat any table as a TableMeta.
+// The meta only describes the row storage (base, stride, capacity); it does
+// not own it.
+struct TableMeta {
+    void *rows;
+    size_t row_size;
+    unsigned int capacity;
+    unsigned char borrowed; // Rows belong to someone else, e.g. a file mapping
+
+    // One bit per ROW_PAGE_SIZE page of the row array, set when a row on that
+    // page changes and cleared once the page has been written out.
+    unsigned char *dirty;
+    unsigned int page_count;
+    unsigned int dirty_count;
+
+    // Occupancy: one bit per live row, 64 rows to a word, plus a packed copy
+    // of each row's id (0 for empty rows, padded to whole words). Scans walk
+    // the set bits and step over empty words whole, so they never stride
+    // through the rows themselves. Built on first use, kept current by markRow.
+    unsigned long long *live;
+    unsigned short *live_ids;
+    unsigned int live_words;
+    unsigned int live_count;
+    unsigned char live_built;
+
+    // Primary key index: row index + 1 by id, 0 when the id has no live row.
+    // Built by TableMeta_prepare (or by the first change to a fresh table)
+    // and kept current by markRow; until then lookups scan the packed ids.
+    unsigned short *slot_by_id;
+    unsigned char indexed;
+
+    // Optional secondary index on an unsigned short column, such as an owner
+    // id (has_key is 0 when the table has none). Works like the primary key
+    // index: row index + 1 by key, lowest row wins, validated on lookup.
+    size_t key_offset;
+    unsigned char has_key;
+    unsigned short *slot_by_key;
+    unsigned char keys_indexed;
+
+    // Optional hash index on a fixed-size name column (name_size is 0 when the
+    // table has none). Rows in a bucket are chained through name_next, and
+    // name_filed remembers which bucket a row is in (-1 when it is in none),
+    // so a row can be unlinked after its name has already been overwritten.
+    size_t name_offset;
+    size_t name_size;
+    unsigned int name_buckets;
+    int *name_heads;
+    int *name_next;
+    int *name_filed;
+    unsigned char names_indexed;
+
+    // Optional ordered index on a text column (sort_size is 0 when the table
+    // has none): the live rows sorted by that text, then by row, so every
+    // row starting with a given prefix sits in one run. sort_pos has each
+    // row's position in the run + 1 (0 when it is not in it), so a row whose
+    // text was already overwritten is still found without a scan. sort_moves
+    // counts the entries shifted since the last sort. Always built lazily, as
+    // it has to read text.
+    size_t sort_offset;
+    size_t sort_size;
+    unsigned short *sorted;
+    unsigned int sorted_count;
+    unsigned short *sort_pos;
+    unsigned long sort_moves;
+    unsigned char sort_built;
+
+    // Optional hot column group (hot_size is 0 when the table has none): the
+    // columns read every turn, copied out of each row into a packed array so
+    // a sweep over them never pulls the wide text columns into the cache.
+    // The rows stay the record of truth; the copy is built on first use and
+    // kept current by markRow.
+    const struct HotColumn *hot_columns;
+    unsigned int hot_column_count;
+    size_t hot_size;
+    unsigned char *hot;
+    unsigned char hot_built;
+
+    // Stack of empty rows for inserts, lowest on top. in_free has a bit per
+    // row that is on the stack, so a row is never pushed twice; a row that was
+    // filled some other way is skipped when it comes off the stack.
+    unsigned short *free_slots;
+    unsigned int free_count;
+    unsigned char *in_free;
+    unsigned char free_built;
+
+    // Set by tables that start from freshly zeroed rows. Until the rows are
+    // replaced from outside, every live row has been through markRow, so the
+    // indexes and free slots can be built without reading (and faulting in)
+    // the rows.
+    unsigned char zeroed;
+
+    // Called at the end of every markRow, so an owner (the database's
+    // write-ahead log) can see each row change as it happens
+    void (*on_change)(void *ctx, struct TableMeta *meta, unsigned int idx);
+    void *on_change_ctx;
+};
+
+enum MorkResult TableMeta_init(struct TableMeta *meta, void *rows, size_t row_size, unsigned int capacity);
+void TableMeta_destroy(struct TableMeta *meta);
+
+size_t TableMeta_size(struct TableMeta *meta);
+void TableMeta_markRow(struct TableMeta *meta, unsigned int idx);
+void TableMeta_markAll(struct TableMeta *meta);
+void TableMeta_clearDirty(struct TableMeta *meta);
+unsigned int TableMeta_nextDirtyRun(struct TableMeta *meta, unsigned int start, unsigned int *first);
+
+enum MorkResult TableMeta_reindexLive(struct TableMeta *meta);
+int TableMeta_nextLive(struct TableMeta *meta, unsigned int start);
+unsigned int TableMeta_liveCount(struct TableMeta *meta);
+int TableMeta_scanId(struct TableMeta *meta, unsigned int id);
+
+enum MorkResult TableMeta_reindex(struct TableMeta *meta);
+void TableMeta_invalidate(struct TableMeta *meta);
+int TableMeta_isPrepared(struct TableMeta *meta, enum TableIndex index);
+enum MorkResult TableMeta_prepare(struct TableMeta *meta, enum TableIndex index);
+int TableMeta_lookup(struct TableMeta *meta, unsigned int id);
+
+void TableMeta_setKeyColumn(struct TableMeta *meta, size_t offset);
+enum MorkResult TableMeta_reindexKeys(struct TableMeta *meta);
+int TableMeta_lookupKey(struct TableMeta *meta, unsigned int key);
+
+void TableMeta_setNameColumn(struct TableMeta *meta, size_t offset, size_t size);
+enum MorkResult TableMeta_reindexNames(struct TableMeta *meta);
+int TableMeta_lookupName(struct TableMeta *meta, const char *name);
+
+void TableMeta_setSortColumn(struct TableMeta *meta, size_t offset, size_t size);
+enum MorkResult TableMeta_reindexSorted(struct TableMeta *meta);
+unsigned int TableMeta_prefixRange(struct TableMeta *meta, const char *prefix, unsigned int *first);
+
+void TableMeta_setHotColumns(struct TableMeta *meta, const struct HotColumn *columns, unsigned int count, size_t hot_size);
+enum MorkResult TableMeta_reindexHot(struct TableMeta *meta);
+const void *TableMeta_hotRows(struct TableMeta *meta);
+
+enum MorkResult TableMeta_rebuildFreeSlots(struct TableMeta *meta);
+unsigned short findNextRowToFill(struct TableMeta *meta);
@@ -0,0 +1,473 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "wal.h"
+
+#include <fcntl.h>
+#include <lcthw/dbg.h>
+#include <libgen.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static unsigned int Wal_checksum(const struct WalEntryHeader *header, const void *payload)
+{
+    // FNV-1a over the header (with the checksum field zeroed) and the payload
+    struct WalEntryHeader copy = *header;
+    copy.checksum = 0;
+
+    unsigned int hash = 2166136261u;
+    const unsigned char *bytes = (const unsigned char *)&copy;
+    for (size_t i = 0; i < sizeof(copy); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    bytes = payload;
+    for (size_t i = 0; i < header->length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Build the log path for a database file.
+ *
+ * @param db_path Path to the database file
+ * @return char* Newly allocated path, or NULL
+ */
+char *Wal_pathFor(const char *db_path)
+{
+    if (db_path == NULL) { return NULL; }
+
+    size_t len = strlen(db_path) + strlen(WAL_SUFFIX) + 1;
+    char *path = malloc(len);
+    check_mem(path);
+    snprintf(path, len, "%s%s", db_path, WAL_SUFFIX);
+    return path;
+
+error:
+    return NULL;
+}
+
+/**
+ * @brief Sync the directory a file lives in, so that creating the file or
+ *        renaming another over it survives a power loss. Until then the
+ *        directory may still point at the old file, or at none.
+ *
+ * @param path Path to the file
+ * @return enum MorkResult
+ */
+enum MorkResult Wal_syncDir(const char *path)
+{
+    if (path == NULL) { return MORK_ERROR_DB_INVALID_PATH; }
+
+    // dirname may write to its argument
+    char *copy = strdup(path);
+    if (copy == NULL) { return MORK_ERROR_DB; }
+    int fd = open(dirname(copy), O_RDONLY | O_DIRECTORY);
+    free(copy);
+    if (fd < 0) { return MORK_ERROR_DB_FILE_FLUSH; }
+
+    enum MorkResult res = fsync(fd) == 0 ? MORK_OK : MORK_ERROR_DB_FILE_FLUSH;
+    close(fd);
+    return res;
+}
+
+/**
+ * @brief Open (or create) a log. Nothing is read until Wal_replay.
+ *
+ * @param path Path to the log file
+ * @return struct Wal*
+ */
+struct Wal *Wal_open(const char *path)
+{
+    struct Wal *wal = calloc(1, sizeof(struct Wal));
+    check_mem(wal);
+    wal->fd = -1;
+
+    wal->path = strdup(path);
+    check_mem(wal->path);
+    wal->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    check(wal->fd >= 0, "Failed to open log: %s", path);
+    // A log created here must not vanish with the batches committed to it
+    check(Wal_syncDir(path) == MORK_OK, "Failed to sync the log's directory: %s", path);
+
+    struct stat st;
+    check(fstat(wal->fd, &st) == 0, "Failed to stat log: %s", path);
+    wal->size = (size_t)st.st_size;
+
+    return wal;
+
+error:
+    Wal_close(wal);
+    return NULL;
+}
+
+/**
+ * @brief Close a log. Uncommitted entries are dropped.
+ */
+void Wal_close(struct Wal *wal)
+{
+    if (wal == NULL) { return; }
+    if (wal->fd >= 0) { close(wal->fd); }
+    free(wal->path);
+    free(wal->pending);
+    free(wal->writing);
+    free(wal);
+}
+
+/**
+ * @brief Grow one of the log's buffers to hold at least needed bytes.
+ */
+static enum MorkResult Wal_reserve(unsigned char **buf, size_t *cap, size_t needed)
+{
+    if (needed <= *cap) { return MORK_OK; }
+    size_t grown_cap = *cap ? *cap : 4096;
+    while (grown_cap < needed) { grown_cap *= 2; }
+    unsigned char *grown = realloc(*buf, grown_cap);
+    if (grown == NULL) { return MORK_ERROR_DB; }
+    *buf = grown;
+    *cap = grown_cap;
+    return MORK_OK;
+}
+
+/**
+ * @brief Queue an entry for the next commit. Nothing touches the disk here,
+ *        so logging a change costs a copy of the row.
+ *
+ * @param wal     The log
+ * @param op      What happened to the row
+ * @param table   Table the row belongs to
+ * @param row     Index of the row within its table
+ * @param id      Id of the record in the row
+ * @param payload Row image for WAL_OP_ROW, otherwise NULL
+ * @param length  Size of the payload in bytes
+ * @return enum MorkResult
+ */
+enum MorkResult Wal_append(struct Wal *wal, enum WalOp op, unsigned char table, unsigned short row,
+                           unsigned short id, const void *payload, unsigned int length)
+{
+    if (wal == NULL) { return MORK_ERROR_DB_FILE_NULL; }
+    if (payload == NULL) { length = 0; }
+
+    size_t needed = wal->pending_len + sizeof(struct WalEntryHeader) + length;
+    if (Wal_reserve(&wal->pending, &wal->pending_cap, needed) != MORK_OK) { return MORK_ERROR_DB; }
+
+    struct WalEntryHeader header = {
+        .length = length,
+        .checksum = 0,
+        .id = id,
+        .row = row,
+        .op = (unsigned char)op,
+        .table = table,
+        .reserved = 0
+    };
+    header.checksum = Wal_checksum(&header, payload);
+
+    memcpy(wal->pending + wal->pending_len, &header, sizeof(header));
+    if (length != 0) {
+        memcpy(wal->pending + wal->pending_len + sizeof(header), payload, length);
+    }
+    wal->pending_len = needed;
+    wal->pending_count++;
+    return MORK_OK;
+}
+
+/**
+ * @brief End the entries appended so far as one batch, e.g. at the end of a
+ *        turn. Sealed batches are what Wal_take hands to the next write, so
+ *        changes appended after this, maybe halfway through another turn,
+ *        wait for the next seal.
+ *
+ * @param wal The log
+ * @return enum MorkResult
+ */
+enum MorkResult Wal_seal(struct Wal *wal)
+{
+    if (wal == NULL) { return MORK_ERROR_DB_FILE_NULL; }
+    if (wal->pending_count == wal->sealed_count) { return MORK_OK; }
+
+    enum MorkResult res = Wal_append(wal, WAL_OP_COMMIT, 0, 0, 0, NULL, 0);
+    if (res != MORK_OK) { return res; }
+    wal->sealed_len = wal->pending_len;
+    wal->sealed_count = wal->pending_count;
+    return MORK_OK;
+}
+
+/**
+ * @brief Move the sealed batches out of the pending buffer for Wal_write.
+ *        Only this touches both buffers, so the caller can append to the log
+ *        again while the taken batches are written.
+ *
+ * @param wal The log
+ * @return enum MorkResult
+ */
+enum MorkResult Wal_take(struct Wal *wal)
+{
+    if (wal == NULL) { return MORK_ERROR_DB_FILE_NULL; }
+    if (wal->writing_len != 0) { return MORK_ERROR_DB; }
+    if (wal->sealed_len == 0) { return MORK_OK; }
+
+    if (Wal_reserve(&wal->writing, &wal->writing_cap, wal->sealed_len) != MORK_OK) { return MORK_ERROR_DB; }
+    memcpy(wal->writing, wal->pending, wal->sealed_len);
+    wal->writing_len = wal->sealed_len;
+    wal->writing_count = wal->sealed_count;
+
+    memmove(wal->pending, wal->pending + wal->sealed_len, wal->pending_len - wal->sealed_len);
+    wal->pending_len -= wal->sealed_len;
+    wal->pending_count -= wal->sealed_count;
+    wal->sealed_len = 0;
+    wal->sealed_count = 0;
+    return MORK_OK;
+}
+
+/**
+ * @brief Append the batches taken by Wal_take to the log, with a single write
+ *        and a single fdatasync however many rows and turns they hold. On
+ *        failure whatever was written is cut off the file again, so
+ *        wal->size matches it, and the batches stay taken for Wal_untake.
+ *
+ * @param wal The log
+ * @return enum MorkResult
+ */
+enum MorkResult Wal_write(struct Wal *wal)
+{
+    if (wal == NULL) { return MORK_ERROR_DB_FILE_NULL; }
+    if (wal->writing_len == 0) { return MORK_OK; }
+
+    enum MorkResult res = MORK_OK;
+    size_t written = 0;
+    while (written < wal->writing_len) {
+        ssize_t n = write(wal->fd, wal->writing + written, wal->writing_len - written);
+        if (n < 0) {
+            res = MORK_ERROR_DB_FILE_WRITE;
+            break;
+        }
+        written += (size_t)n;
+    }
+    // Written but not known to be durable is dropped too; otherwise the
+    // retry would append the batches a second time
+    if (res == MORK_OK && fdatasync(wal->fd) != 0) { res = MORK_ERROR_DB_FILE_FLUSH; }
+    if (res != MORK_OK) {
+        if (ftruncate(wal->fd, wal->size) != 0) { log_err("Failed to trim log after a failed commit"); }
+        return res;
+    }
+
+    wal->size += wal->writing_len;
+    wal->writing_len = 0;
+    wal->writing_count = 0;
+    return MORK_OK;
+}
+
+/**
+ * @brief Put batches that failed to write back in front of the pending
+ *        entries, still sealed, so the next commit writes them again first.
+ *
+ * @param wal The log
+ */
+void Wal_untake(struct Wal *wal)
+{
+    if (wal == NULL || wal->writing_len == 0) { return; }
+
+    if (Wal_reserve(&wal->pending, &wal->pending_cap, wal->pending_len + wal->writing_len) != MORK_OK) {
+        // Nowhere to keep them; they stay taken and the next take fails
+        log_err("Failed to keep uncommitted log entries");
+        return;
+    }
+    memmove(wal->pending + wal->writing_len, wal->pending, wal->pending_len);
+    memcpy(wal->pending, wal->writing, wal->writing_len);
+    wal->pending_len += wal->writing_len;
+    wal->pending_count += wal->writing_count;
+    wal->sealed_len += wal->writing_len;
+    wal->sealed_count += wal->writing_count;
+    wal->writing_len = 0;
+    wal->writing_count = 0;
+}
+
+/**
+ * @brief Write everything queued since the last commit as one batch, with a
+ *        single write and a single fdatasync however many rows changed.
+ *
+ * @param wal The log
+ * @return enum MorkResult
+ */
+enum MorkResult Wal_commit(struct Wal *wal)
+{
+    if (wal == NULL) { return MORK_ERROR_DB_FILE_NULL; }
+
+    enum MorkResult res = Wal_seal(wal);
+    if (res == MORK_OK) { res = Wal_take(wal); }
+    if (res != MORK_OK) { return res; }
+
+    res = Wal_write(wal);
+    if (res != MORK_OK) { Wal_untake(wal); }
+    return res;
+}
+
+/**
+ * @brief Apply every complete batch in the log, in order. Anything after the
+ *        last commit entry (a torn or corrupt tail) is cut off the file.
+ *
+ * @param wal   The log
+ * @param apply Called for each row entry
+ * @param ctx   Passed through to apply
+ * @return enum MorkResult
+ */
+enum MorkResult Wal_replay(struct Wal *wal, Wal_applyFn apply, void *ctx)
+{
+    if (wal == NULL) { return MORK_ERROR_DB_FILE_NULL; }
+
+    struct stat st;
+    if (fstat(wal->fd, &st) != 0) { return MORK_ERROR_DB_FILE_READ; }
+    size_t size = (size_t)st.st_size;
+    if (size == 0) {
+        wal->size = 0;
+        return MORK_OK;
+    }
+
+    unsigned char *buf = malloc(size);
+    if (buf == NULL) { return MORK_ERROR_DB; }
+
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = pread(wal->fd, buf + got, size - got, got);
+        if (n <= 0) { break; }
+        got += (size_t)n;
+    }
+
+    // First find where the last intact batch ends
+    size_t committed = 0;
+    size_t pos = 0;
+    while (pos + sizeof(struct WalEntryHeader) <= got) {
+        struct WalEntryHeader header;
+        memcpy(&header, buf + pos, sizeof(header));
+        if (header.length > got - pos - sizeof(header)) { break; }
+        if (Wal_checksum(&header, buf + pos + sizeof(header)) != header.checksum) { break; }
+        pos += sizeof(header) + header.length;
+        if (header.op == WAL_OP_COMMIT) { committed = pos; }
+    }
+
+    enum MorkResult res = MORK_OK;
+    pos = 0;
+    while (pos < committed) {
+        struct WalEntryHeader header;
+        memcpy(&header, buf + pos, sizeof(header));
+        if (header.op != WAL_OP_COMMIT) {
+            res = apply(ctx, &header, buf + pos + sizeof(header));
+            if (res != MORK_OK) { break; }
+        }
+        pos += sizeof(header) + header.length;
+    }
+    free(buf);
+    if (res != MORK_OK) { return res; }
+
+    if (committed < size && ftruncate(wal->fd, committed) != 0) { return MORK_ERROR_DB_FILE_WRITE; }
+    wal->size = committed;
+    return MORK_OK;
+}
+
+/**
+ * @brief Empty the log once its changes are safely in the database file.
+ *
+ * @param wal The log
+ * @return enum MorkResult
+ */
+enum MorkResult Wal_reset(struct Wal *wal)
+{
+    if (wal == NULL) { return MORK_ERROR_DB_FILE_NULL; }
+
+    wal->pending_len = 0;
+    wal->pending_count = 0;
+    wal->sealed_len = 0;
+    wal->sealed_count = 0;
+    if (wal->size == 0) { return MORK_OK; }
+
+    if (ftruncate(wal->fd, 0) != 0) { return MORK_ERROR_DB_FILE_WRITE; }
+    if (fdatasync(wal->fd) != 0) { return MORK_ERROR_DB_FILE_FLUSH; }
+    wal->size = 0;
+    return MORK_OK;
+}
+
+/**
+ * @brief Drop the committed batches that a checkpoint has made redundant,
+ *        keeping anything committed after it. Entries appended since the last
+ *        commit are untouched. The surviving tail is written to a sibling
+ *        file that is renamed over the log, so a crash leaves either the old
+ *        log or the new one, and replaying either is correct.
+ *
+ * @param wal  The log
+ * @param upto Size of the log when the checkpoint's snapshot was taken
+ * @return enum MorkResult
+ */
+enum MorkResult Wal_discard(struct Wal *wal, size_t upto)
+{
+    if (wal == NULL) { return MORK_ERROR_DB_FILE_NULL; }
+    if (upto == 0 || wal->size == 0) { return MORK_OK; }
+
+    if (upto >= wal->size) {
+        if (ftruncate(wal->fd, 0) != 0) { return MORK_ERROR_DB_FILE_WRITE; }
+        if (fdatasync(wal->fd) != 0) { return MORK_ERROR_DB_FILE_FLUSH; }
+        wal->size = 0;
+        return MORK_OK;
+    }
+
+    size_t keep = wal->size - upto;
+    size_t len = strlen(wal->path) + 5;
+    char *tmp = malloc(len);
+    unsigned char *buf = malloc(keep);
+    enum MorkResult res = MORK_ERROR_DB;
+    int fd = -1;
+    if (tmp == NULL || buf == NULL) { goto done; }
+    snprintf(tmp, len, "%s.tmp", wal->path);
+
+    res = MORK_ERROR_DB_FILE_READ;
+    size_t got = 0;
+    while (got < keep) {
+        ssize_t n = pread(wal->fd, buf + got, keep - got, upto + got);
+        if (n <= 0) { goto done; }
+        got += (size_t)n;
+    }
+
+    res = MORK_ERROR_DB_FILE_WRITE;
+    fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) { goto done; }
+    size_t written = 0;
+    while (written < keep) {
+        ssize_t n = write(fd, buf + written, keep - written);
+        if (n < 0) { goto done; }
+        written += (size_t)n;
+    }
+    if (fdatasync(fd) != 0 || rename(tmp, wal->path) != 0) { goto done; }
+
+    // The new log is in place from here on, so it is kept even if the rename
+    // cannot be made durable
+    close(wal->fd);
+    wal->fd = fd;
+    fd = -1;
+    wal->size = keep;
+    res = Wal_syncDir(wal->path);
+
+done:
+    if (fd >= 0) {
+        close(fd);
+        remove(tmp);
+    }
+    free(buf);
+    free(tmp);
+    return res;
+}
@@ -0,0 +1,93 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../utils/error.h"
+
+#include <stddef.h>
+
+// The write-ahead log sits next to the database file as "<path>-wal" and holds
+// every row change made since the file was last checkpointed. Each entry is
+//
+//   u32 payload length | u32 checksum | u16 id | u16 row | u8 op | u8 table | u16 0
+//
+// followed by the payload (a full row image for WAL_OP_ROW, nothing otherwise).
+// Entries are appended in batches that end with a WAL_OP_COMMIT entry and are
+// written with a single fdatasync; replay only applies whole batches, so a
+// batch torn by a crash is dropped as a unit. The log is local to the machine
+// that wrote it, so integers are in native byte order.
+#define WAL_SUFFIX "-wal"
+
+// Once the log grows past this, Database_commit folds it back into the file
+#define WAL_CHECKPOINT_SIZE (1024 * 1024)
+
+enum WalOp {
+    WAL_OP_ROW = 1, // The row now holds the payload
+    WAL_OP_CLEAR,   // The row was deleted
+    WAL_OP_COMMIT   // End of a batch
+};
+
+struct WalEntryHeader {
+    unsigned int length;
+    unsigned int checksum;
+    unsigned short id;
+    unsigned short row;
+    unsigned char op;
+    unsigned char table;
+    unsigned short reserved;
+};
+
+struct Wal {
+    int fd;
+    char *path;
+    size_t size; // Bytes of whole batches on disk
+
+    // Entries appended since the last commit. The first sealed_len bytes
+    // are whole batches, each ended by its commit entry, ready to be written.
+    unsigned char *pending;
+    size_t pending_len;
+    size_t pending_cap;
+    unsigned int pending_count;
+    size_t sealed_len;
+    unsigned int sealed_count;
+
+    // Sealed batches taken out by Wal_take, until Wal_write puts them on disk
+    unsigned char *writing;
+    size_t writing_len;
+    size_t writing_cap;
+    unsigned int writing_count;
+};
+
+typedef enum MorkResult (*Wal_applyFn)(void *ctx, const struct WalEntryHeader *entry, const void *payload);
+
+char *Wal_pathFor(const char *db_path);
+enum MorkResult Wal_syncDir(const char *path);
+struct Wal *Wal_open(const char *path);
+void Wal_close(struct Wal *wal);
+
+enum MorkResult Wal_append(struct Wal *wal, enum WalOp op, unsigned char table, unsigned short row,
+                           unsigned short id, const void *payload, unsigned int length);
+enum MorkResult Wal_seal(struct Wal *wal);
+enum MorkResult Wal_take(struct Wal *wal);
+enum MorkResult Wal_write(struct Wal *wal);
+void Wal_untake(struct Wal *wal);
+enum MorkResult Wal_commit(struct Wal *wal);
+enum MorkResult Wal_replay(struct Wal *wal, Wal_applyFn apply, void *ctx);
+enum MorkResult Wal_reset(struct Wal *wal);
+enum MorkResult Wal_discard(struct Wal *wal, size_t upto);
@@ -14,8 +14,6 @@ struct Action *Action_create(const char *input)
     action->kind = ACTION_NONE;
     action->target_kind = TARGET_NONE;
 
-    action->parser = NULL;
-
     return action;
 
 error:
@@ -27,9 +25,6 @@ enum MorkResult Action_destroy(struct Action *action)
     if (action == NULL) {
         return MORK_ERROR_MODEL_ACTION_NULL;
     }
-    if (action->parser != NULL) {
-        ActionParser_destroy(action->parser);
-    }
     if (action->noun != NULL) {
         bdestroy(action->noun);
     }
@@ -41,37 +36,52 @@ enum MorkResult Action_destroy(struct Action *action)
 }
 
 enum MorkResult Action_parse(struct Action *action, struct Database *db)
+{
+    ActionParser parser;
+    if (ActionParser_init(&parser, db) != MORK_OK) {
+        return MORK_ERROR_MODEL_ACTION_PARSE;
+    }
+
+    enum MorkResult res = Action_parseWith(action, &parser);
+    ActionParser_reset(&parser);
+    return res;
+}
+
+/**
+ * @brief Parse an action with a parser the caller keeps, so a session can
+ *        reuse one parser for every line it reads. The parser is left holding
+ *        this input's tokens until it is next loaded or reset.
+ *
+ * @param action The action to fill in
+ * @param parser The parser
+ * @return enum MorkResult
+ */
+enum MorkResult Action_parseWith(struct Action *action, ActionParser *parser)
 {
     if (action == NULL) {
         return MORK_ERROR_MODEL_ACTION_NULL;
     }
+    check(parser != NULL, "Expected a parser.");
 
-    action->parser = ActionParser_create(db);
-    check(action->parser != NULL, "Failed to create action parser.");
-    ActionParser_preload(action->parser);
-
-    if (ActionParser_load(action->parser, action->raw_input) != MORK_OK) {
+    if (ActionParser_load(parser, action->raw_input) != MORK_OK) {
         return MORK_ERROR_MODEL_ACTION_PARSE;
     }
 
-    if (ActionParser_isLoaded(action->parser) == 0) {
+    if (ActionParser_isLoaded(parser) == 0) {
         return MORK_ERROR_MODEL_ACTION_PARSE;
     }
 
-    enum MorkResult res = ActionParser_parse(action->parser, &action->kind, &action->target_kind);
-    log_err("Result of parsing action: %d", res);
+    enum MorkResult res = ActionParser_parse(parser, &action->kind, &action->target_kind);
+    debug("Result of parsing action: %d", res);
     check(res == MORK_OK, "Failed to parse action.");
 
     if (action->noun != NULL) {
         bdestroy(action->noun);
     }
-    action->noun = bstrcpy(action->parser->noun);
-    
-    ActionParser_destroy(action->parser);
-    action->parser = NULL;
+    action->noun = bstrcpy(parser->noun);
 
     return MORK_OK;
 
 error:
     return MORK_ERROR_MODEL_ACTION_PARSE;
-}
\ No newline at end of file
+}
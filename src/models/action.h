@@ -18,10 +18,10 @@ struct Action {
     enum ActionKind kind;
     enum ActionTargetKind target_kind;
     int target_id;
-    ActionParser *parser;
 };
 
 struct Action *Action_create(const char *input);
 enum MorkResult Action_destroy(struct Action *action);
 
 enum MorkResult Action_parse(struct Action *action, struct Database *db);
+enum MorkResult Action_parseWith(struct Action *action, ActionParser *parser);
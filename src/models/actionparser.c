@@ -3,30 +3,7 @@
 #include "../coredb/tables/items.h"
 #include "../utils/error.h"
 
-static struct tagbstring move_cmd = bsStatic("move");
-static struct tagbstring look_cmd = bsStatic("look");
-static struct tagbstring take_cmd = bsStatic("take");
-static struct tagbstring drop_cmd = bsStatic("drop");
-static struct tagbstring inventory_cmd = bsStatic("inventory");
-static struct tagbstring help_cmd = bsStatic("help");
-struct tagbstring quit_cmd = bsStatic("quit");
-
-static struct tagbstring north_target = bsStatic("north");
-static enum ActionTargetKind north_kind = TARGET_NORTH;
-static struct tagbstring south_target = bsStatic("south");
-static enum ActionTargetKind south_kind = TARGET_SOUTH;
-static struct tagbstring east_target = bsStatic("east");
-static enum ActionTargetKind east_kind = TARGET_EAST;
-static struct tagbstring west_target = bsStatic("west");
-static enum ActionTargetKind west_kind = TARGET_WEST;
-static struct tagbstring up_target = bsStatic("up");
-static enum ActionTargetKind up_kind = TARGET_UP;
-static struct tagbstring down_target = bsStatic("down");
-static enum ActionTargetKind down_kind = TARGET_DOWN;
-static struct tagbstring room_target = bsStatic("room");
-static enum ActionTargetKind room_kind = TARGET_ROOM;
-static struct tagbstring self_target = bsStatic("self");
-static enum ActionTargetKind self_kind = TARGET_SELF;
+#include <string.h>
 
 enum ActionKind *ActionKind_allocd(enum ActionKind kind)
 {
@@ -59,15 +36,7 @@ ActionParser *ActionParser_create(struct Database *db)
     ActionParser *parser = malloc(sizeof(ActionParser));
     check_mem(parser);
 
-    parser->verbs = Hashmap_create(NULL, NULL);
-    check_mem(parser->verbs);
-
-    parser->input = NULL;
-    parser->verb = NULL;
-    parser->noun = NULL;
-    parser->db = db;
-
-    ActionParser_preload(parser);
+    check(ActionParser_init(parser, db) == MORK_OK, "Failed to initialize action parser.");
 
     return parser;
 
@@ -79,6 +48,32 @@ error:
     return NULL;
 }
 
+/**
+ * @brief Set up a parser in place, e.g. one on the stack. Nothing is allocated
+ *        until input is loaded.
+ *
+ * @param parser The parser
+ * @param db     Where item and character names are looked up; may be NULL
+ * @return enum MorkResult
+ */
+enum MorkResult ActionParser_init(ActionParser *parser, struct Database *db)
+{
+    check(parser, "ActionParser is NULL");
+
+    parser->verbs = ActionParser_vocabulary();
+    check(parser->verbs, "Failed to build vocabulary");
+
+    parser->input = NULL;
+    parser->verb = NULL;
+    parser->noun = NULL;
+    parser->db = db;
+
+    return MORK_OK;
+
+error:
+    return MORK_ERROR_MODEL_ACTION_PARSE;
+}
+
 ActionVerbEntry *ActionVerbEntry_create(enum ActionKind kind)
 {
     ActionVerbEntry *verbEntry = malloc(sizeof(ActionVerbEntry));
@@ -111,78 +106,106 @@ void ActionVerbEntry_destroy(ActionVerbEntry *verbEntry)
     }
 }
 
-void ActionParser_preload(ActionParser *parser)
+/**
+ * @brief Verbs beyond the built-in ones, and the nouns each of them takes.
+ *        The map is created on first use and shared by every parser for the
+ *        life of the process. Built-in words never reach it.
+ *
+ * @return Hashmap* The verbs, keyed by name
+ */
+Hashmap *ActionParser_vocabulary()
 {
-    check(parser, "ActionParser is NULL");
-    
-    // Load verbs
-    Hashmap_set(parser->verbs, &move_cmd, ActionVerbEntry_create(ACTION_MOVE));
-    Hashmap_set(parser->verbs, &look_cmd, ActionVerbEntry_create(ACTION_LOOK));
-    Hashmap_set(parser->verbs, &take_cmd, ActionVerbEntry_create(ACTION_TAKE));
-    Hashmap_set(parser->verbs, &drop_cmd, ActionVerbEntry_create(ACTION_DROP));
-    Hashmap_set(parser->verbs, &inventory_cmd, ActionVerbEntry_create(ACTION_INVENTORY));
-    Hashmap_set(parser->verbs, &help_cmd, ActionVerbEntry_create(ACTION_HELP));
-    Hashmap_set(parser->verbs, &quit_cmd, ActionVerbEntry_create(ACTION_QUIT));
-
-    // Load nouns
-    ActionVerbEntry *move = Hashmap_get(parser->verbs, &move_cmd);
-    Hashmap_set(move->nouns, &north_target, &north_kind);
-    Hashmap_set(move->nouns, &south_target, &south_kind);
-    Hashmap_set(move->nouns, &east_target, &east_kind);
-    Hashmap_set(move->nouns, &west_target, &west_kind);
-    Hashmap_set(move->nouns, &up_target, &up_kind);
-    Hashmap_set(move->nouns, &down_target, &down_kind);
-    
-    ActionVerbEntry *look = Hashmap_get(parser->verbs, &look_cmd);
-    Hashmap_set(look->nouns, &north_target, &north_kind);
-    Hashmap_set(look->nouns, &south_target, &south_kind);
-    Hashmap_set(look->nouns, &east_target, &east_kind);
-    Hashmap_set(look->nouns, &west_target, &west_kind);
-    Hashmap_set(look->nouns, &up_target, &up_kind);
-    Hashmap_set(look->nouns, &down_target, &down_kind);
-    Hashmap_set(look->nouns, &room_target, &room_kind);
-    Hashmap_set(look->nouns, &self_target, &self_kind);
-
-    return;
+    static Hashmap *verbs = NULL;
+
+    if (verbs == NULL) {
+        verbs = Hashmap_create(NULL, NULL);
+        check_mem(verbs);
+    }
+    return verbs;
 
 error:
-    return;
+    return NULL;
 }
 
-int hashmap_cleanup_verbs(HashmapNode *node)
+/**
+ * @brief Classify a built-in verb. The vocabulary is fixed, so this is a
+ *        switch on length and first letter with one compare to confirm.
+ *
+ * @param word The word
+ * @param len  Its length
+ * @return enum ActionKind The verb, or ACTION_NONE if it is not built in
+ */
+enum ActionKind ActionParser_builtinVerb(const char *word, int len)
 {
-    if (node->data) {
-        ActionVerbEntry_destroy(node->data);
+    if (word == NULL) { return ACTION_NONE; }
+
+    switch (len) {
+        case 4:
+            switch (word[0]) {
+                case 'm': return memcmp(word, "move", 4) == 0 ? ACTION_MOVE : ACTION_NONE;
+                case 'l': return memcmp(word, "look", 4) == 0 ? ACTION_LOOK : ACTION_NONE;
+                case 't': return memcmp(word, "take", 4) == 0 ? ACTION_TAKE : ACTION_NONE;
+                case 'd': return memcmp(word, "drop", 4) == 0 ? ACTION_DROP : ACTION_NONE;
+                case 'h': return memcmp(word, "help", 4) == 0 ? ACTION_HELP : ACTION_NONE;
+                case 'q': return memcmp(word, "quit", 4) == 0 ? ACTION_QUIT : ACTION_NONE;
+                default: return ACTION_NONE;
+            }
+        case 9:
+            return memcmp(word, "inventory", 9) == 0 ? ACTION_INVENTORY : ACTION_NONE;
+        default:
+            return ACTION_NONE;
     }
-
-    return 0;
 }
 
-void ActionParser_destroy(ActionParser *parser)
+/**
+ * @brief Classify a built-in noun for a verb: the six directions for moving
+ *        and looking, and the room and yourself for looking.
+ *
+ * @param kind The verb the noun follows
+ * @param word The word
+ * @param len  Its length
+ * @return enum ActionTargetKind The target, or TARGET_NONE if it is not built in
+ */
+enum ActionTargetKind ActionParser_builtinNoun(enum ActionKind kind, const char *word, int len)
 {
-    if (parser) {
-        if (parser->verbs) {
-            // First, go through and free the associated hashmaps
-            Hashmap_traverse(parser->verbs, hashmap_cleanup_verbs);
-            Hashmap_destroy(parser->verbs);
-            parser->verbs = NULL;
-        }
-
-        if (parser->input) {
-            bdestroy(parser->input);
-            parser->input = NULL;
-        }
+    if (word == NULL || (kind != ACTION_MOVE && kind != ACTION_LOOK)) { return TARGET_NONE; }
 
-        if (parser->verb) {
-            bdestroy(parser->verb);
-            parser->verb = NULL;
-        }
+    enum ActionTargetKind target = TARGET_NONE;
+    switch (len) {
+        case 2:
+            target = memcmp(word, "up", 2) == 0 ? TARGET_UP : TARGET_NONE;
+            break;
+        case 4:
+            switch (word[0]) {
+                case 'e': target = memcmp(word, "east", 4) == 0 ? TARGET_EAST : TARGET_NONE; break;
+                case 'w': target = memcmp(word, "west", 4) == 0 ? TARGET_WEST : TARGET_NONE; break;
+                case 'd': target = memcmp(word, "down", 4) == 0 ? TARGET_DOWN : TARGET_NONE; break;
+                case 'r': target = memcmp(word, "room", 4) == 0 ? TARGET_ROOM : TARGET_NONE; break;
+                case 's': target = memcmp(word, "self", 4) == 0 ? TARGET_SELF : TARGET_NONE; break;
+                default: break;
+            }
+            break;
+        case 5:
+            switch (word[0]) {
+                case 'n': target = memcmp(word, "north", 5) == 0 ? TARGET_NORTH : TARGET_NONE; break;
+                case 's': target = memcmp(word, "south", 5) == 0 ? TARGET_SOUTH : TARGET_NONE; break;
+                default: break;
+            }
+            break;
+        default:
+            break;
+    }
 
-        if (parser->noun) {
-            bdestroy(parser->noun);
-            parser->noun = NULL;
-        }
+    // You can look at the room you're in, but not walk into it
+    if (kind == ACTION_MOVE && (target == TARGET_ROOM || target == TARGET_SELF)) { return TARGET_NONE; }
+    return target;
+}
 
+void ActionParser_destroy(ActionParser *parser)
+{
+    if (parser) {
+        // The vocabulary is shared, so only our own tokens go
+        ActionParser_reset(parser);
         free(parser);
     }
 }
@@ -193,6 +216,9 @@ enum MorkResult ActionParser_load(ActionParser *parser, bstring raw_input) {
 
     debug("Raw input: %s", bdata(raw_input));
 
+    // Drop whatever was parsed last, so the parser can be reused
+    ActionParser_reset(parser);
+
     btrimws(raw_input);
     debug("Trimmed input: %s", bdata(raw_input));
 
@@ -251,11 +277,6 @@ void ActionParser_reset(ActionParser *parser)
         bdestroy(parser->noun);
         parser->noun = NULL;
     }
-
-    if (parser->verbs) {
-        Hashmap_destroy(parser->verbs);
-        parser->verbs = NULL;
-    }
 }
 
 enum MorkResult ActionParser_parse(ActionParser *parser, enum ActionKind *kind, enum ActionTargetKind *targetKind)
@@ -269,26 +290,36 @@ enum MorkResult ActionParser_parse(ActionParser *parser, enum ActionKind *kind,
         return MORK_ERROR_MODEL_ACTION_PARSE;
     }
 
-    // Find verb in hashmap
-    ActionVerbEntry *verbEntry = Hashmap_get(parser->verbs, parser->verb);
-    check(verbEntry, "Verb not found");
+    // Built-in verbs never touch the map; only game-defined ones are looked up there
+    enum ActionKind verbKind = ActionParser_builtinVerb(bdata(parser->verb), blength(parser->verb));
+    Hashmap *nouns = NULL;
+    if (verbKind == ACTION_NONE) {
+        ActionVerbEntry *verbEntry = Hashmap_get(parser->verbs, parser->verb);
+        check(verbEntry, "Verb not found");
+        verbKind = verbEntry->kind;
+        nouns = verbEntry->nouns;
+    }
 
     // Check if verb should have a noun
-    if (verbEntry->kind == ACTION_INVENTORY || verbEntry->kind == ACTION_HELP || verbEntry->kind == ACTION_QUIT) {
-        *kind = verbEntry->kind;
+    if (verbKind == ACTION_INVENTORY || verbKind == ACTION_HELP || verbKind == ACTION_QUIT) {
+        *kind = verbKind;
         *targetKind = TARGET_NONE;
 
         return MORK_OK;
     }
 
-    // Find noun in hashmap
-    enum ActionTargetKind *nounEntry = Hashmap_get(verbEntry->nouns, parser->noun);
+    enum ActionTargetKind target = ActionParser_builtinNoun(verbKind, bdata(parser->noun), blength(parser->noun));
+    if (target == TARGET_NONE && nouns != NULL && parser->noun != NULL) {
+        enum ActionTargetKind *nounEntry = Hashmap_get(nouns, parser->noun);
+        if (nounEntry) { target = *nounEntry; }
+    }
+
     // If no noun is found, it could still be an item or character
-    if (!nounEntry) {
+    if (target == TARGET_NONE) {
         // Check if noun is an item
         struct ItemRecord *item = Database_getItemByName(parser->db, bdata(parser->noun));
         if (item) {
-            *kind = verbEntry->kind;
+            *kind = verbKind;
             *targetKind = TARGET_ITEM;
 
             return MORK_OK;
@@ -297,22 +328,25 @@ enum MorkResult ActionParser_parse(ActionParser *parser, enum ActionKind *kind,
         // Check if noun is a character
         struct CharacterRecord *character = Database_getCharacterByName(parser->db, bdata(parser->noun));
         if (character) {
-            *kind = verbEntry->kind;
+            *kind = verbKind;
             *targetKind = TARGET_CHARACTER;
 
             return MORK_OK;
         }
 
+        // A game's own commands decide for themselves what their noun means
+        if (verbKind >= ACTION_CUSTOM) {
+            *kind = verbKind;
+            *targetKind = TARGET_NONE;
+
+            return MORK_OK;
+        }
+
         return MORK_ERROR_MODEL_ACTION_PARSE;
     }
 
-    *kind = verbEntry->kind;
-    *targetKind = *nounEntry;
-
-    bdestroy(parser->input);
-    parser->input = NULL;
-    bdestroy(parser->verb);
-    parser->verb = NULL;
+    *kind = verbKind;
+    *targetKind = target;
 
     return MORK_OK;
 
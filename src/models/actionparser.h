@@ -14,9 +14,12 @@ enum ActionKind {
     ACTION_DROP,
     ACTION_INVENTORY,
     ACTION_HELP,
-    ACTION_QUIT
+    ACTION_QUIT,
+    ACTION_CUSTOM // First kind handed out to game-defined commands
 };
 
+#define MAX_ACTION_KINDS 64
+
 enum ActionKind *ActionKind_allocd(enum ActionKind kind);
 
 enum ActionTargetKind {
@@ -35,13 +38,16 @@ enum ActionTargetKind {
 
 enum ActionTargetKind *ActionTargetKind_allocd(enum ActionTargetKind kind);
 
+// A parser holds the tokens of one input at a time and is reset between
+// inputs, so one parser can serve a whole session. The vocabulary it matches
+// against is shared and never changes once built.
 typedef struct ActionParser {
-    Hashmap *verbs;
     bstring input;
     bstring verb;
     bstring noun;
 
     // Not owned
+    Hashmap *verbs;
     struct Database *db;
 } ActionParser;
 
@@ -53,8 +59,12 @@ typedef struct ActionVerbEntry {
 ActionVerbEntry *ActionVerbEntry_create(enum ActionKind kind);
 void ActionVerbEntry_destroy(ActionVerbEntry *verbEntry);
 
+Hashmap *ActionParser_vocabulary();
+enum ActionKind ActionParser_builtinVerb(const char *word, int len);
+enum ActionTargetKind ActionParser_builtinNoun(enum ActionKind kind, const char *word, int len);
+
 ActionParser *ActionParser_create(struct Database *db);
-void ActionParser_preload(ActionParser *parser);
+enum MorkResult ActionParser_init(ActionParser *parser, struct Database *db);
 void ActionParser_destroy(ActionParser *parser);
 
 enum MorkResult ActionParser_load(ActionParser *parser, bstring raw_input);
@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "character.h"
 #include "inventory.h"
+#include "../coredb/cache.h"
 
 #include <lcthw/dbg.h>
 
@@ -66,6 +67,7 @@ struct Character *Character_create(
     check_mem(character->name);
     character->name[MAX_NAME_LEN - 1] = '\0';
     character->id = 0;
+    character->refs = 1;
 
     character->level = level;
     character->experience = 0;
@@ -113,8 +115,20 @@ error:
     return NULL;
 }
 
+struct Character *Character_retain(struct Character *character)
+{
+    if (character != NULL) {
+        __atomic_add_fetch(&character->refs, 1, __ATOMIC_RELAXED);
+    }
+    return character;
+}
+
 void Character_destroy(struct Character *character)
 {
+    // Whoever drops the last reference frees it, whichever thread that is
+    if (character != NULL && __atomic_sub_fetch(&character->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
     if (character != NULL) {
         if (character->inventory != NULL) {
             Inventory_destroy(character->inventory);
@@ -134,6 +148,7 @@ int Character_save(struct Database *db, struct Character *character)
         
         enum MorkResult res = Database_createCharacter(db, characterRecord);
         check(res == MORK_OK, "Failed to create character record");
+        character->id = characterRecord->id;
     } else {
         enum MorkResult res = Database_updateCharacter(db, characterRecord);
         check(res == MORK_OK, "Failed to update character record");
@@ -150,8 +165,24 @@ error:
     return -1;
 }
 
+static void *Character_cacheRetain(void *character)
+{
+    return Character_retain(character);
+}
+
+static void Character_release(void *character)
+{
+    Character_destroy(character);
+}
+
 struct Character *Character_fromRecord(struct Database *db, struct CharacterRecord rec)
 {
+    // Characters are shared by id, so an NPC met in several rooms is loaded once
+    struct Character *cached = Database_cacheGet(db, CACHE_CHARACTERS, rec.id, Character_cacheRetain);
+    if (cached != NULL) {
+        return cached;
+    }
+
     unsigned char *stats = (unsigned char *)calloc(rec.numStats, sizeof(unsigned char));
     for (int i = 0; i < rec.numStats; i++) {
         stats[i] = GET_STAT(rec.stats, i);
@@ -163,6 +194,7 @@ struct Character *Character_fromRecord(struct Database *db, struct CharacterReco
     strncpy(character->name, rec.name, MAX_NAME_LEN);
 
     character->id = rec.id;
+    character->refs = 1;
     character->level = rec.level;
     character->experience = rec.experience;
     character->health = GET_HEALTH(rec.health_and_mana);
@@ -176,6 +208,10 @@ struct Character *Character_fromRecord(struct Database *db, struct CharacterReco
     Inventory_destroy(character->inventory);
     character->inventory = Inventory_load(db, rec.id);
 
+    if (Database_cachePut(db, CACHE_CHARACTERS, character->id, Character_retain(character), Character_release) != MORK_OK) {
+        Character_destroy(character);
+    }
+
     return character;
 
 error:
@@ -23,6 +23,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 struct Character {
     unsigned short id;
+    unsigned int refs; // Holders of this character, including the database's model cache, atomic
     char name[MAX_NAME_LEN];
     unsigned char level;
     unsigned long experience;
@@ -42,6 +43,8 @@ struct Character *Character_create(
     unsigned char *stats,
     unsigned char numStats
 );
+struct Character *Character_retain(struct Character *character);
+// Drops one reference; the character is freed with the last
 void Character_destroy(struct Character *character);
 
 struct Character *Character_clone(struct Character *source);
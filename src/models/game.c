@@ -1,9 +1,12 @@
 #include "game.h"
 #include "../ui/terminal.h"
+#include "../coredb/roomgraph.h"
 
 #include <lcthw/dbg.h>
 #include <sys/types.h>
 
+static const BaseGame_handler BaseGame_builtinHandlers[ACTION_CUSTOM];
+
 struct BaseGame *BaseGame_create(struct Character *player)
 {
 
@@ -26,6 +29,11 @@ struct BaseGame *BaseGame_create(struct Character *player)
         game->history[i] = NULL;
     }
 
+    memcpy(game->handlers, BaseGame_builtinHandlers, sizeof(BaseGame_builtinHandlers));
+    game->action_kinds = ACTION_CUSTOM;
+    game->verbs = Hashmap_create(NULL, NULL);
+    check_mem(game->verbs);
+
     return game;
 
 error:
@@ -44,6 +52,22 @@ enum MorkResult BaseGame_refreshScreen(struct BaseGame *game)
     return MORK_OK;
 }
 
+/**
+ * @brief Push an action onto the history, which owns it from then on. The
+ *        oldest entry is freed once the history is full.
+ *
+ * @param game   The game
+ * @param action The action just carried out
+ */
+static void BaseGame_record(struct BaseGame *game, struct Action *action)
+{
+    if (game->history[MAX_HISTORY - 1] != NULL) {
+        Action_destroy(game->history[MAX_HISTORY - 1]);
+    }
+    memmove(&game->history[1], &game->history[0], (MAX_HISTORY - 1) * sizeof(struct Action *));
+    game->history[0] = action;
+}
+
 enum MorkResult BaseGame_executeAction(struct Database *db, struct BaseGame *game, struct Action *action)
 {
     if (game == NULL) {
@@ -51,7 +75,8 @@ enum MorkResult BaseGame_executeAction(struct Database *db, struct BaseGame *gam
     }
 
     struct TerminalSegment *result = BaseGame_execute(db, game, action);
-    
+    BaseGame_record(game, action);
+
     if (result != NULL) {
         // This adds to the text onscreen, not overwriting context lines
         ScreenState_textReplace(game->screen, result);
@@ -65,12 +90,6 @@ enum MorkResult BaseGame_executeAction(struct Database *db, struct BaseGame *gam
         struct TerminalSegment *green = TS_setGreen(TS_new());
         ScreenState_statusBarAppendInline(game->screen, TS_concatText(green, playerHealth));
         free(playerHealth);
-
-        // Append to history
-        for (int i = MAX_HISTORY - 1; i > 0; i--) {
-            game->history[i] = game->history[i - 1];
-        }
-        game->history[0] = action;
     }
 
     return MORK_OK;
@@ -79,6 +98,13 @@ error:
     return MORK_ERROR_MODEL_GAME_NULL;
 }
 
+static int BaseGame_destroyVerb(HashmapNode *node)
+{
+    bdestroy(node->key);
+    ActionVerbEntry_destroy(node->data);
+    return 0;
+}
+
 enum MorkResult BaseGame_destroy(struct BaseGame *game)
 {
     if (game == NULL) {
@@ -98,6 +124,12 @@ enum MorkResult BaseGame_destroy(struct BaseGame *game)
         }
     }
 
+    if (game->verbs) {
+        Hashmap_traverse(game->verbs, BaseGame_destroyVerb);
+        Hashmap_destroy(game->verbs);
+        game->verbs = NULL;
+    }
+
     free(game);
     return MORK_OK;
 }
@@ -125,6 +157,10 @@ enum MorkResult BaseGame_setLocation(struct BaseGame *game, struct Location *loc
     if (game == NULL) {
         return MORK_ERROR_MODEL_GAME_NULL;
     }
+    // The game holds one reference to where the player is
+    if (game->current_location != NULL && game->current_location != location) {
+        Location_destroy(game->current_location);
+    }
     game->current_location = location;
     return MORK_OK;
 }
@@ -145,6 +181,116 @@ struct Location *BaseGame_getLocation(struct BaseGame *game)
     return game->current_location;
 }
 
+/**
+ * @brief Teach the game a new word for an action, e.g. "grab" for ACTION_TAKE,
+ *        or the word for a command added with BaseGame_registerAction.
+ *
+ * @param game The game
+ * @param word The verb as the player types it
+ * @param kind What it does
+ * @return enum MorkResult
+ */
+enum MorkResult BaseGame_registerVerb(struct BaseGame *game, const char *word, enum ActionKind kind)
+{
+    if (game == NULL) {
+        return MORK_ERROR_MODEL_GAME_NULL;
+    }
+    if (word == NULL || word[0] == '\0' || strchr(word, ' ') != NULL) {
+        return MORK_ERROR_MODEL_ACTION_PARSE_VERB;
+    }
+    if (kind == ACTION_NONE || kind >= game->action_kinds) {
+        return MORK_ERROR_MODEL_ACTION_KIND;
+    }
+    if (ActionParser_builtinVerb(word, strlen(word)) != ACTION_NONE) {
+        // Built-in words are matched before the map is ever consulted
+        return MORK_ERROR_MODEL_ACTION_PARSE_VERB;
+    }
+
+    bstring key = bfromcstr(word);
+    check_mem(key);
+
+    ActionVerbEntry *entry = Hashmap_get(game->verbs, key);
+    if (entry != NULL) {
+        entry->kind = kind;
+        bdestroy(key);
+        return MORK_OK;
+    }
+
+    entry = ActionVerbEntry_create(kind);
+    check(entry != NULL, "Failed to create verb entry.");
+    if (Hashmap_set(game->verbs, key, entry) != 0) {
+        ActionVerbEntry_destroy(entry);
+        goto error;
+    }
+    return MORK_OK;
+
+error:
+    bdestroy(key);
+    return MORK_ERROR_MODEL;
+}
+
+/**
+ * @brief Add a command of the game's own. Give it words with
+ *        BaseGame_registerVerb.
+ *
+ * @param game    The game
+ * @param handler Carries the command out
+ * @return enum ActionKind The new kind, or ACTION_NONE if there is no room for it
+ */
+enum ActionKind BaseGame_registerAction(struct BaseGame *game, BaseGame_handler handler)
+{
+    if (game == NULL || handler == NULL || game->action_kinds >= MAX_ACTION_KINDS) {
+        return ACTION_NONE;
+    }
+
+    enum ActionKind kind = game->action_kinds++;
+    game->handlers[kind] = handler;
+    return kind;
+}
+
+/**
+ * @brief Replace what an action does, built-in ones included.
+ *
+ * @param game    The game
+ * @param kind    The action
+ * @param handler Carries it out, or NULL to make it do nothing
+ * @return enum MorkResult
+ */
+enum MorkResult BaseGame_setHandler(struct BaseGame *game, enum ActionKind kind, BaseGame_handler handler)
+{
+    if (game == NULL) {
+        return MORK_ERROR_MODEL_GAME_NULL;
+    }
+    if (kind == ACTION_NONE || kind >= game->action_kinds) {
+        return MORK_ERROR_MODEL_ACTION_KIND;
+    }
+
+    game->handlers[kind] = handler;
+    return MORK_OK;
+}
+
+/**
+ * @brief Set up a parser that knows this game's verbs as well as the built-in ones.
+ *
+ * @param db     Where item and character names are looked up
+ * @param game   The game
+ * @param parser The parser
+ * @return enum MorkResult
+ */
+enum MorkResult BaseGame_initParser(struct Database *db, struct BaseGame *game, ActionParser *parser)
+{
+    if (game == NULL) {
+        return MORK_ERROR_MODEL_GAME_NULL;
+    }
+
+    enum MorkResult res = ActionParser_init(parser, db);
+    if (res != MORK_OK) {
+        return res;
+    }
+    parser->verbs = game->verbs;
+    return MORK_OK;
+}
+
 enum MorkResult BaseGame_save(struct Database *db, struct BaseGame *game)
 {
     if (game == NULL) {
@@ -236,52 +382,53 @@ error:
     return NULL;
 }
 
-struct TerminalSegment *BaseGame_move(struct Database *db, struct BaseGame *game, enum ActionTargetKind target)
+/**
+ * @brief Which exit a direction names.
+ *
+ * @param target The target of a move or look
+ * @return int Index into the exits, in ExitDirection order, or -1 if the target is not a direction
+ */
+static int BaseGame_exitDirection(enum ActionTargetKind target)
 {
-    if (game == NULL) {
-        return NULL;
-    }
-
-    struct Location *location = game->current_location;
-    struct TerminalSegment *ts = TS_new();
-    // Exit mapping is [NORTH, SOUTH, EAST, WEST, UP, DOWN]
-
-    int exit_position = -1;
-
     switch (target) {
         case TARGET_NORTH:
-            exit_position = 1;
-            break;
+            return NORTH;
         case TARGET_SOUTH:
-            exit_position = 2;
-            break;
+            return SOUTH;
         case TARGET_EAST:
-            exit_position = 3;
-            break;
+            return EAST;
         case TARGET_WEST:
-            exit_position = 4;
-            break;
+            return WEST;
         case TARGET_UP:
-            exit_position = 5;
-            break;
+            return UP;
         case TARGET_DOWN:
-            exit_position = 6;
-            break;
+            return DOWN;
         default:
-            break;
+            return -1;
+    }
+}
+
+struct TerminalSegment *BaseGame_move(struct Database *db, struct BaseGame *game, enum ActionTargetKind target)
+{
+    if (game == NULL) {
+        return NULL;
     }
 
-    if (exit_position == -1) {
+    struct Location *location = game->current_location;
+    int direction = BaseGame_exitDirection(target);
+    if (direction == -1) {
         return NULL;
     }
 
-    int exit_id = location->exitIDs[exit_position];
-    if (exit_id == 0) {
+    struct TerminalSegment *ts = TS_new();
+    struct Room room;
+    if (Database_copyRoomExit(db, location->id, direction, &room) != MORK_OK) {
         TS_concatText(ts, "You can't go that way.");
         return ts;
     }
 
-    struct Location *new_location = Location_load(db, exit_id);
+    // Only now that we're going in does the room get loaded, with its contents
+    struct Location *new_location = Location_load(db, room.id);
     if (new_location == NULL) {
         TS_concatText(ts, "Whoa, something real weird happened. You sure that place exists?");
         return ts;
@@ -316,9 +463,9 @@ struct TerminalSegment *BaseGame_take(struct Database *db, struct BaseGame *game
             break;
         case TARGET_ITEM:
             for (int i = 0; i < MAX_ITEMS; i++) {
-                if (strcmp(location->items[i]->name, target) == 0) {
+                if (location->items[i] != NULL && strcmp(location->items[i]->name, target) == 0) {
                     // Add item to player inventory
-                    Inventory_addItem(player->inventory, location->items[i]);
+                    Inventory_addItem(player->inventory, Item_retain(location->items[i]));
                     TS_concatText(ts, "You take the ");
                     TS_concatText(TS_setBold(TS_setYellow(ts)), location->items[i]->name);
                     TS_concatText(TS_setNormal(TS_setWhite(ts)), ".");
@@ -352,20 +499,20 @@ struct TerminalSegment *BaseGame_drop(struct Database *db, struct BaseGame *game
         case TARGET_CHARACTER:
         case TARGET_ROOM:
             break;
-        case TARGET_ITEM:
-            for (int i = 0; i < MAX_ITEMS; i++) {
-                if (strcmp(player->inventory->items[i]->name, target) == 0) {
-                    // Remove item from player inventory
-                    Inventory_removeItem(player->inventory, player->inventory->items[i]);
-                    TS_concatText(ts, "You drop the ");
-                    TS_concatText(TS_setBold(TS_setYellow(ts)), player->inventory->items[i]->name);
-                    TS_concatText(TS_setNormal(TS_setWhite(ts)), ".");
-
-                    Character_save(db, player);
-                    return ts;
-                }
+        case TARGET_ITEM: {
+            struct Item *item = Inventory_getItemByName(player->inventory, target);
+            if (item != NULL) {
+                TS_concatText(ts, "You drop the ");
+                TS_concatText(TS_setBold(TS_setYellow(ts)), item->name);
+                TS_concatText(TS_setNormal(TS_setWhite(ts)), ".");
+
+                // Remove item from player inventory, which frees it
+                Inventory_removeItem(player->inventory, item);
+                Character_save(db, player);
+                return ts;
             }
             return TS_concatText(ts, "I don't think you're holding one of those.");
+        }
     }   
     return TS_concatText(ts, "What are you talking about? You sound crazy right now.");
 }
@@ -383,86 +530,28 @@ struct TerminalSegment *BaseGame_look(struct Database *db, struct BaseGame *game
         case TARGET_NONE:
             break;
         case TARGET_NORTH:
-            // Look at the north exit
-            if (location->exitIDs[0] != 0) {
-                struct Location *new_location = Location_load(db, location->exitIDs[0]);
-                if (new_location != NULL) {
-                    TS_concatText(ts, new_location->description);
-                } else {
-                    TS_concatText(ts, "There's nothing over there.");
-                }
-            } else {
-                TS_concatText(ts, "There's nothing over there.");
-            }
-            return ts;
         case TARGET_SOUTH:
-            // Look at the south exit
-            if (location->exitIDs[1] != 0) {
-                struct Location *new_location = Location_load(db, location->exitIDs[1]);
-                if (new_location != NULL) {
-                    TS_concatText(ts, new_location->description);
-                } else {
-                    TS_concatText(ts, "There's nothing over there.");
-                }
-            } else {
-                TS_concatText(ts, "There's nothing over there.");
-            }
-            return ts;
         case TARGET_EAST:
-            // Look at the east exit
-            if (location->exitIDs[2] != 0) {
-                struct Location *new_location = Location_load(db, location->exitIDs[2]);
-                if (new_location != NULL) {
-                    TS_concatText(ts, new_location->description);
-                } else {
-                    TS_concatText(ts, "There's nothing over there.");
-                }
-            } else {
-                TS_concatText(ts, "There's nothing over there.");
-            }
-            return ts;
         case TARGET_WEST:
-            // Look at the west exit
-            if (location->exitIDs[3] != 0) {
-                struct Location *new_location = Location_load(db, location->exitIDs[3]);
-                if (new_location != NULL) {
-                    TS_concatText(ts, new_location->description);
-                } else {
-                    TS_concatText(ts, "There's nothing over there.");
-                }
-            } else {
-                TS_concatText(ts, "There's nothing over there.");
-            }
-            return ts;
         case TARGET_UP:
-            // Look at the up exit
-            if (location->exitIDs[4] != 0) {
-                struct Location *new_location = Location_load(db, location->exitIDs[4]);
-                if (new_location != NULL) {
-                    TS_concatText(ts, new_location->description);
-                } else {
-                    TS_concatText(ts, "There's nothing up there.");
-                }
-            } else {
+        case TARGET_DOWN: {
+            // Looking through an exit only needs the room's description, not the room
+            struct Room room;
+            if (Database_copyRoomExit(db, location->id, BaseGame_exitDirection(targetKind), &room) == MORK_OK &&
+                room.description[0] != '\0') {
+                TS_concatText(ts, room.description);
+            } else if (targetKind == TARGET_UP) {
                 TS_concatText(ts, "There's nothing up there.");
-            }
-            return ts;
-        case TARGET_DOWN:
-            // Look at the down exit
-            if (location->exitIDs[5] != 0) {
-                struct Location *new_location = Location_load(db, location->exitIDs[5]);
-                if (new_location != NULL) {
-                    TS_concatText(ts, new_location->description);
-                } else {
-                    TS_concatText(ts, "There's nothing down there.");
-                }
-            } else {
+            } else if (targetKind == TARGET_DOWN) {
                 TS_concatText(ts, "There's nothing down there.");
+            } else {
+                TS_concatText(ts, "There's nothing over there.");
             }
             return ts;
+        }
         case TARGET_ITEM:
             for (int i = 0; i < MAX_ITEMS; i++) {
-                if (strcmp(location->items[i]->name, target) == 0) {
+                if (location->items[i] != NULL && strcmp(location->items[i]->name, target) == 0) {
                     return TS_concatText(ts, location->items[i]->description);
                 }
             }
@@ -497,11 +586,9 @@ struct TerminalSegment *BaseGame_inventory(struct BaseGame *game)
 
     struct Character *player = game->player;
 
-    for (int i = 0; i < MAX_ITEMS; i++) {
-        if (player->inventory->items[i] != NULL) {
-            TS_concatText(TS_setYellow(TS_setBold(ts)), player->inventory->items[i]->name);
-            TS_concatText(TS_setNormal(ts), "\n");
-        }
+    for (int i = 0; i < Inventory_getItemCount(player->inventory); i++) {
+        TS_concatText(TS_setYellow(TS_setBold(ts)), Inventory_getItem(player->inventory, i)->name);
+        TS_concatText(TS_setNormal(ts), "\n");
     }
     return ts;
 
@@ -541,6 +628,61 @@ void BaseGame_quit(struct Database *db, struct BaseGame *game)
     exit(0);
 }
 
+static struct TerminalSegment *BaseGame_handleMove(struct Database *db, struct BaseGame *game, struct Action *action)
+{
+    return BaseGame_move(db, game, action->target_kind);
+}
+
+// The handlers below take the noun as C text, so a command without one
+// compares against an empty name
+static struct TerminalSegment *BaseGame_handleTake(struct Database *db, struct BaseGame *game, struct Action *action)
+{
+    return BaseGame_take(db, game, action->target_kind, bdatae(action->noun, ""));
+}
+
+static struct TerminalSegment *BaseGame_handleDrop(struct Database *db, struct BaseGame *game, struct Action *action)
+{
+    return BaseGame_drop(db, game, action->target_kind, bdatae(action->noun, ""));
+}
+
+static struct TerminalSegment *BaseGame_handleLook(struct Database *db, struct BaseGame *game, struct Action *action)
+{
+    return BaseGame_look(db, game, action->target_kind, bdatae(action->noun, ""));
+}
+
+static struct TerminalSegment *BaseGame_handleInventory(struct Database *db, struct BaseGame *game, struct Action *action)
+{
+    (void)db;
+    (void)action;
+    return BaseGame_inventory(game);
+}
+
+static struct TerminalSegment *BaseGame_handleHelp(struct Database *db, struct BaseGame *game, struct Action *action)
+{
+    (void)db;
+    (void)action;
+    return BaseGame_help(game);
+}
+
+static struct TerminalSegment *BaseGame_handleQuit(struct Database *db, struct BaseGame *game, struct Action *action)
+{
+    (void)action;
+    BaseGame_quit(db, game);
+    return NULL;
+}
+
+// Every game starts from these; BaseGame_create copies them into its own table
+static const BaseGame_handler BaseGame_builtinHandlers[ACTION_CUSTOM] = {
+    [ACTION_NONE] = NULL,
+    [ACTION_MOVE] = BaseGame_handleMove,
+    [ACTION_LOOK] = BaseGame_handleLook,
+    [ACTION_TAKE] = BaseGame_handleTake,
+    [ACTION_DROP] = BaseGame_handleDrop,
+    [ACTION_INVENTORY] = BaseGame_handleInventory,
+    [ACTION_HELP] = BaseGame_handleHelp,
+    [ACTION_QUIT] = BaseGame_handleQuit
+};
+
 struct TerminalSegment *BaseGame_execute(struct Database *db, struct BaseGame *game, struct Action *action)
 {
     if (game == NULL) {
@@ -558,30 +700,8 @@ struct TerminalSegment *BaseGame_execute(struct Database *db, struct BaseGame *g
     TS_concatText(TS_setBold(frame), game->current_location->name);
 
     // Execute the action
-    switch (action->kind) {
-        case ACTION_MOVE:
-            TS_append(frame, BaseGame_move(db, game, action->target_kind));
-            break;
-        case ACTION_TAKE:
-            TS_append(frame, BaseGame_take(db, game, action->target_kind, action->noun));
-            break;
-        case ACTION_DROP:
-            TS_append(frame, BaseGame_drop(db, game, action->target_kind, action->noun));
-            break;
-        case ACTION_LOOK:
-            TS_append(frame, BaseGame_look(db, game, action->target_kind, action->noun));
-            break;
-        case ACTION_INVENTORY:
-            TS_append(frame, BaseGame_inventory(game));
-            break;
-        case ACTION_HELP:
-            TS_append(frame, BaseGame_help(game));
-            break;
-        case ACTION_QUIT:
-            BaseGame_quit(db, game);
-            break;
-        default:
-            break;
+    if (action->kind < game->action_kinds && game->handlers[action->kind] != NULL) {
+        TS_append(frame, game->handlers[action->kind](db, game, action));
     }
 
     return frame;
@@ -612,16 +732,22 @@ enum MorkResult BaseGame_run(struct Database *db, struct BaseGame *game)
     ScreenState_statusBarAppendInline(game->screen, TS_concatText(green, playerHealth));
     free(playerHealth);
 
+    // One parser and one line buffer serve every turn
+    ActionParser parser;
+    check(BaseGame_initParser(db, game, &parser) == MORK_OK, "Failed to create action parser.");
+    char *input = NULL;
+    size_t len = 0;
+    enum MorkResult res = MORK_OK;
+
     // Run the game loop
     while (1) {
         BaseGame_refreshScreen(game);
 
         // Read and parse player input
-        char *input = NULL;
-        size_t len = 0;
         ssize_t read = getline(&input, &len, stdin);
         if (read == -1) {
-            return MORK_ERROR_MODEL_GAME_INPUT;
+            res = MORK_ERROR_MODEL_GAME_INPUT;
+            break;
         }
         if (input[read - 1] == '\n') {
             input[read - 1] = '\0';
@@ -636,35 +762,213 @@ enum MorkResult BaseGame_run(struct Database *db, struct BaseGame *game)
         // Parse the input
         struct Action *action = Action_create(input);
         if (action == NULL) {
-            return MORK_ERROR_MODEL_ACTION_NULL;
+            res = MORK_ERROR_MODEL_ACTION_NULL;
+            break;
         }
-        enum MorkResult res = Action_parse(action, db);
+        res = Action_parseWith(action, &parser);
         if (res != MORK_OK) {
             Action_destroy(action);
             action = NULL;
+            res = MORK_OK;
             continue;
         }
 
-        // Execute the action
+        // Execute the action; the history keeps it from here on
         res = BaseGame_executeAction(db, game, action);
         if (res != MORK_OK) {
-            return res;
+            break;
+        }
+
+        // Autosave the turn; this only appends to the database's log
+        res = Database_commit(db);
+        if (res != MORK_OK) {
+            break;
         }
 
         // Check for game over
         if (game->player->health <= 0) {
             break;
         }
+    }
+
+    ActionParser_reset(&parser);
+    free(input);
+    return res;
+
+error:
+    return MORK_ERROR_MODEL_GAME_NULL;
+}
+
+// The command on a script line, or NULL for a blank line or comment
+static const char *BaseGame_commandText(const char *line)
+{
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    if (*line == '\0' || *line == '#') {
+        return NULL;
+    }
+    return line;
+}
+
+/**
+ * @brief Run one command with no screen involved: parse it, carry it out and
+ *        write what the player would have seen. Blank lines and lines
+ *        starting with '#' do nothing.
+ *
+ * @param db     The database
+ * @param game   The game
+ * @param parser Parser kept across commands, set up with BaseGame_initParser
+ * @param line   The command
+ * @param out    Where output goes, or NULL to discard it
+ * @param stop   Set when the player quit or the game is over
+ * @return enum MorkResult
+ */
+enum MorkResult BaseGame_runCommand(struct Database *db, struct BaseGame *game, ActionParser *parser,
+                                    const char *line, FILE *out, unsigned char *stop)
+{
+    if (game == NULL) {
+        return MORK_ERROR_MODEL_GAME_NULL;
+    }
+    if (line == NULL || parser == NULL || stop == NULL) {
+        return MORK_ERROR_MODEL_GAME_INPUT;
+    }
+
+    line = BaseGame_commandText(line);
+    if (line == NULL) {
+        return MORK_OK;
+    }
+
+    struct Action *action = Action_create(line);
+    if (action == NULL) {
+        return MORK_ERROR_MODEL_ACTION_NULL;
+    }
+
+    if (Action_parseWith(action, parser) != MORK_OK) {
+        // Same as at the prompt: a command we don't understand is skipped
+        if (out) {
+            fprintf(out, "I don't understand that.\n");
+        }
+        Action_destroy(action);
+        return MORK_OK;
+    }
 
-        // Cleanup
+    if (action->kind == ACTION_QUIT) {
+        // Quitting ends the session, not the process
         Action_destroy(action);
-        action = NULL;
+        *stop = 1;
+        return MORK_OK;
+    }
+
+    struct TerminalSegment *frame = BaseGame_execute(db, game, action);
+    BaseGame_record(game, action);
+    if (frame != NULL) {
+        if (out) {
+            TS_writePlain(frame, out);
+            fputc('\n', out);
+        }
+        TS_destroy(frame);
     }
 
+    if (game->player->health <= 0) {
+        *stop = 1;
+    }
     return MORK_OK;
+}
 
-error:
-    return MORK_ERROR_MODEL_GAME_NULL;
+static enum MorkResult BaseGame_runScriptLine(struct Database *db, struct BaseGame *game, ActionParser *parser,
+                                              const char *line, FILE *transcript, unsigned char *stop)
+{
+    const char *command = BaseGame_commandText(line);
+    if (command != NULL && transcript != NULL) {
+        fprintf(transcript, "> %s\n", command);
+    }
+    return BaseGame_runCommand(db, game, parser, line, transcript, stop);
+}
+
+/**
+ * @brief Play a list of commands back to back without drawing anything,
+ *        e.g. to check a world build. The turns are committed together once
+ *        the list is done, rather than one at a time as at the prompt.
+ *
+ * @param db         The database
+ * @param game       The game
+ * @param commands   The commands, as the player would type them
+ * @param count      How many there are
+ * @param transcript Where each command and its output go, or NULL
+ * @return enum MorkResult
+ */
+enum MorkResult BaseGame_runCommands(struct Database *db, struct BaseGame *game, const char **commands, unsigned int count,
+                                     FILE *transcript)
+{
+    if (game == NULL) {
+        return MORK_ERROR_MODEL_GAME_NULL;
+    }
+    if (commands == NULL && count > 0) {
+        return MORK_ERROR_MODEL_GAME_INPUT;
+    }
+
+    ActionParser parser;
+    enum MorkResult res = BaseGame_initParser(db, game, &parser);
+    if (res != MORK_OK) {
+        return res;
+    }
+
+    unsigned char stop = 0;
+    for (unsigned int i = 0; i < count && !stop && res == MORK_OK; i++) {
+        res = BaseGame_runScriptLine(db, game, &parser, commands[i], transcript, &stop);
+    }
+    ActionParser_reset(&parser);
+
+    if (res == MORK_OK && db != NULL) {
+        res = Database_commit(db);
+    }
+    return res;
+}
+
+/**
+ * @brief Play a script of commands, one per line, the same way as
+ *        BaseGame_runCommands. Blank lines and lines starting with '#' are
+ *        skipped.
+ *
+ * @param db         The database
+ * @param game       The game
+ * @param script     The script
+ * @param transcript Where each command and its output go, or NULL
+ * @return enum MorkResult
+ */
+enum MorkResult BaseGame_runScript(struct Database *db, struct BaseGame *game, FILE *script, FILE *transcript)
+{
+    if (game == NULL) {
+        return MORK_ERROR_MODEL_GAME_NULL;
+    }
+    if (script == NULL) {
+        return MORK_ERROR_MODEL_GAME_INPUT;
+    }
+
+    ActionParser parser;
+    enum MorkResult res = BaseGame_initParser(db, game, &parser);
+    if (res != MORK_OK) {
+        return res;
+    }
+
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t read = 0;
+    unsigned char stop = 0;
+    while (!stop && res == MORK_OK && (read = getline(&line, &len, script)) != -1) {
+        while (read > 0 && (line[read - 1] == '\n' || line[read - 1] == '\r')) {
+            line[--read] = '\0';
+        }
+        res = BaseGame_runScriptLine(db, game, &parser, line, transcript, &stop);
+    }
+    free(line);
+    ActionParser_reset(&parser);
+
+    if (res == MORK_OK && db != NULL) {
+        res = Database_commit(db);
+    }
+    return res;
 }
 
 char *BaseGame_getScreenDisplay(struct BaseGame *game)
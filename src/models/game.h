@@ -9,12 +9,22 @@
 
 #define MAX_HISTORY 100
 
+struct BaseGame;
+
+// Carries out one kind of action and returns what to show the player
+typedef struct TerminalSegment *(*BaseGame_handler)(struct Database *db, struct BaseGame *game, struct Action *action);
+
 struct BaseGame {
     unsigned short id;
     struct ScreenState *screen;
     struct Action *history[MAX_HISTORY];
     struct Character *player;
     struct Location *current_location;
+
+    // Dispatch table by action kind, and the verbs this game added
+    BaseGame_handler handlers[MAX_ACTION_KINDS];
+    unsigned int action_kinds;
+    Hashmap *verbs;
 };
 
 struct BaseGame *BaseGame_create(struct Character *player);
@@ -30,6 +40,11 @@ enum MorkResult BaseGame_setLocation(struct BaseGame *game, struct Location *loc
 struct Character *BaseGame_getPlayer(struct BaseGame *game);
 struct Location *BaseGame_getLocation(struct BaseGame *game);
 
+enum MorkResult BaseGame_registerVerb(struct BaseGame *game, const char *word, enum ActionKind kind);
+enum ActionKind BaseGame_registerAction(struct BaseGame *game, BaseGame_handler handler);
+enum MorkResult BaseGame_setHandler(struct BaseGame *game, enum ActionKind kind, BaseGame_handler handler);
+enum MorkResult BaseGame_initParser(struct Database *db, struct BaseGame *game, ActionParser *parser);
+
 enum MorkResult BaseGame_save(struct Database *db, struct BaseGame *game);
 struct BaseGame *BaseGame_load(struct Database *db, int id);
 
@@ -37,6 +52,13 @@ struct BaseGame *BaseGame_load(struct Database *db, int id);
 struct TerminalSegment *BaseGame_execute(struct Database *db, struct BaseGame *game, struct Action *action);
 enum MorkResult BaseGame_run(struct Database *db, struct BaseGame *game);
 
+// Headless play: no screen, each command and its output go to the transcript
+enum MorkResult BaseGame_runCommand(struct Database *db, struct BaseGame *game, ActionParser *parser,
+                                    const char *line, FILE *out, unsigned char *stop);
+enum MorkResult BaseGame_runCommands(struct Database *db, struct BaseGame *game, const char **commands, unsigned int count,
+                                     FILE *transcript);
+enum MorkResult BaseGame_runScript(struct Database *db, struct BaseGame *game, FILE *script, FILE *transcript);
+
 // Lower level methods
 
 enum MorkResult BaseGame_executeAction(struct Database *db, struct BaseGame *game, struct Action *action);
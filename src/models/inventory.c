@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "item.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <lcthw/dbg.h>
 
 struct Inventory *Inventory_create()
@@ -28,10 +29,9 @@ struct Inventory *Inventory_create()
     check_mem(inventory);
 
     inventory->id = 0;
-
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        inventory->items[i] = NULL;
-    }
+    inventory->count = 0;
+    inventory->capacity = 0;
+    inventory->items = NULL;
 
     return inventory;
 
@@ -40,6 +40,32 @@ error:
     return NULL;
 }
 
+static enum MorkResult Inventory_reserve(struct Inventory *inventory, int capacity)
+{
+    if (capacity <= inventory->capacity) {
+        return MORK_OK;
+    }
+    if (capacity > MAX_INVENTORY_ITEMS) {
+        return MORK_ERROR_MODEL_INVENTORY_FULL;
+    }
+
+    int grown = inventory->capacity ? inventory->capacity : 4;
+    while (grown < capacity) {
+        grown *= 2;
+    }
+    if (grown > MAX_INVENTORY_ITEMS) {
+        grown = MAX_INVENTORY_ITEMS;
+    }
+
+    struct Item **items = realloc(inventory->items, grown * sizeof(struct Item *));
+    if (items == NULL) {
+        return MORK_ERROR_MODEL;
+    }
+    inventory->items = items;
+    inventory->capacity = grown;
+    return MORK_OK;
+}
+
 struct Inventory *Inventory_clone(struct Inventory *source)
 {
     check(source != NULL, "Expected a non-null source inventory.");
@@ -49,10 +75,9 @@ struct Inventory *Inventory_clone(struct Inventory *source)
 
     inventory->id = source->id;
 
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        if (source->items[i] != NULL) {
-            inventory->items[i] = Item_clone(source->items[i]);
-        }
+    check(Inventory_reserve(inventory, source->count) == MORK_OK, "Failed to size inventory.");
+    for (int i = 0; i < source->count; i++) {
+        inventory->items[inventory->count++] = Item_clone(source->items[i]);
     }
 
     return inventory;
@@ -66,34 +91,35 @@ enum MorkResult Inventory_destroy(struct Inventory *inventory)
     if (inventory == NULL) {
         return MORK_OK;
     }
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        if (inventory->items[i] != NULL) {
-            Item_destroy(inventory->items[i]);
-        }
+    for (int i = 0; i < inventory->count; i++) {
+        Item_destroy(inventory->items[i]);
     }
 
+    free(inventory->items);
     free(inventory);
     return MORK_OK;
 }
 
 enum MorkResult Inventory_addItem(struct Inventory *inventory, struct Item *item)
 {
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        if (inventory->items[i] == NULL) {
-            inventory->items[i] = item;
-            return MORK_OK;
-        }
+    enum MorkResult res = Inventory_reserve(inventory, inventory->count + 1);
+    if (res != MORK_OK) {
+        return res;
     }
 
-    return MORK_ERROR_MODEL_INVENTORY_FULL;
+    inventory->items[inventory->count++] = item;
+    return MORK_OK;
 }
 
 enum MorkResult Inventory_removeItem(struct Inventory *inventory, struct Item *item)
 {
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
+    for (int i = 0; i < inventory->count; i++) {
         if (strncmp(inventory->items[i]->name, item->name, MAX_NAME - 1) == 0) {
             Item_destroy(inventory->items[i]);
-            inventory->items[i] = NULL;
+            // Keep the rest in the order they were picked up
+            memmove(&inventory->items[i], &inventory->items[i + 1],
+                    (inventory->count - i - 1) * sizeof(struct Item *));
+            inventory->count--;
             return MORK_OK;
         }
     }
@@ -103,7 +129,7 @@ enum MorkResult Inventory_removeItem(struct Inventory *inventory, struct Item *i
 
 int Inventory_hasItem(struct Inventory *inventory, struct Item *item)
 {
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
+    for (int i = 0; i < inventory->count; i++) {
         if (inventory->items[i] == item) {
             return 1;
         }
@@ -114,41 +140,22 @@ int Inventory_hasItem(struct Inventory *inventory, struct Item *item)
 
 int Inventory_isFull(struct Inventory *inventory)
 {
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        if (inventory->items[i] == NULL) {
-            return 0;
-        }
-    }
-
-    return 1;
+    return inventory->count >= MAX_INVENTORY_ITEMS;
 }
 
 int Inventory_isEmpty(struct Inventory *inventory)
 {
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        if (inventory->items[i] != NULL) {
-            return 0;
-        }
-    }
-
-    return 1;
+    return inventory->count == 0;
 }
 
 int Inventory_getItemCount(struct Inventory *inventory)
 {
-    int count = 0;
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        if (inventory->items[i] != NULL) {
-            count++;
-        }
-    }
-
-    return count;
+    return inventory->count;
 }
 
 struct Item *Inventory_getItem(struct Inventory *inventory, int index)
 {
-    if (index < 0 || index >= MAX_INVENTORY_ITEMS) {
+    if (index < 0 || index >= inventory->count) {
         return NULL;
     }
 
@@ -157,8 +164,8 @@ struct Item *Inventory_getItem(struct Inventory *inventory, int index)
 
 struct Item *Inventory_getItemByName(struct Inventory *inventory, const char *name)
 {
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        if (inventory->items[i] != NULL && strncmp(inventory->items[i]->name, name, MAX_NAME) == 0) {
+    for (int i = 0; i < inventory->count; i++) {
+        if (strncmp(inventory->items[i]->name, name, MAX_NAME) == 0) {
             return inventory->items[i];
         }
     }
@@ -168,10 +175,8 @@ struct Item *Inventory_getItemByName(struct Inventory *inventory, const char *na
 
 enum MorkResult Inventory_print(struct Inventory *inventory)
 {
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        if (inventory->items[i] != NULL) {
-            printf("%s\n", inventory->items[i]->name);
-        }
+    for (int i = 0; i < inventory->count; i++) {
+        printf("%s\n", inventory->items[i]->name);
     }
     return MORK_OK;
 }
@@ -187,9 +192,10 @@ struct InventoryRecord *Inventory_asInventoryRecord(struct Database *db, struct
     record->id = inventory->id;
     record->owner_id = owner_id;
 
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        if (inventory->items[i] != NULL) {
-            record->item_ids[i] = Item_save(db, inventory->items[i]);
+    for (int i = 0; i < inventory->count; i++) {
+        int item_id = Item_save(db, inventory->items[i]);
+        if (item_id > 0) {
+            record->item_ids[record->item_count++] = item_id;
         }
     }
 
@@ -207,9 +213,20 @@ int Inventory_save(struct Database *db, unsigned short owner, struct Inventory *
     check(record != NULL, "Failed to create inventory record.");
 
     if (record->id == 0) {
-        record->id = Database_getNextIndex(db, INVENTORY);
-        enum MorkResult res = Database_createInventory(db, owner_record->name);
-        check(res == MORK_OK, "Failed to create inventory record.");
+        // Reuse the owner's row if there is one, otherwise start an empty one
+        struct InventoryRecord *existing = Database_getInventoryByOwner(db, owner_record->name);
+        if (existing == NULL) {
+            enum MorkResult res = Database_createInventory(db, owner_record->name);
+            check(res == MORK_OK, "Failed to create inventory record.");
+            existing = Database_getInventoryByOwner(db, owner_record->name);
+            check(existing != NULL, "Failed to find created inventory record.");
+        }
+
+        // Then fill it with what is being held
+        record->id = existing->id;
+        inventory->id = existing->id;
+        enum MorkResult res = Database_updateInventory(db, record);
+        check(res == MORK_OK, "Failed to fill inventory record.");
     } else {
         enum MorkResult res = Database_updateInventory(db, record);
         check(res == MORK_OK, "Failed to update inventory record.");
@@ -235,9 +252,10 @@ struct Inventory *Inventory_load(struct Database *db, int owner_id)
     struct Inventory *inventory = Inventory_create();
     inventory->id = record->id;
 
-    for (int i = 0; i < MAX_INVENTORY_ITEMS; i++) {
-        if (record->item_ids[i] != 0) {
-            inventory->items[i] = Item_load(db, record->item_ids[i]);
+    for (int i = 0; i < record->item_count; i++) {
+        struct Item *item = Item_load(db, record->item_ids[i]);
+        if (item != NULL) {
+            Inventory_addItem(inventory, item);
         }
     }
 
@@ -22,9 +22,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../utils/error.h"
 #include "../coredb/db.h"
 
+// Items are held in a packed array that grows as it fills, up to
+// MAX_INVENTORY_ITEMS, so an empty bag costs nothing
 struct Inventory {
     unsigned short id;
-    struct Item *items[MAX_INVENTORY_ITEMS];
+    int count;
+    int capacity;
+    struct Item **items;
 };
 
 struct Inventory *Inventory_create();
@@ -16,6 +16,7 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "../coredb/cache.h"
 #include "../coredb/db.h"
 #include "item.h"
 
@@ -33,6 +34,7 @@ struct Item *Item_create(const char *name, const char *description)
     check_mem(item);
 
     item->id = 0;
+    item->refs = 1;
 
     strncpy(item->name, name, MAX_NAME);
     item->name[MAX_NAME - 1] = '\0';
@@ -57,40 +59,45 @@ error:
     return NULL;
 }
 
+struct Item *Item_retain(struct Item *item)
+{
+    if (item != NULL) {
+        __atomic_add_fetch(&item->refs, 1, __ATOMIC_RELAXED);
+    }
+    return item;
+}
+
 enum MorkResult Item_destroy(struct Item *item)
 {
     if (item == NULL) {
         return MORK_ERROR_MODEL_ITEM_NULL;
     }
+    // Whoever drops the last reference frees it, whichever thread that is
+    if (__atomic_sub_fetch(&item->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return MORK_OK;
+    }
     free(item);
     return MORK_OK;
 }
 
+static void *Item_cacheRetain(void *item)
+{
+    return Item_retain(item);
+}
+
+static void Item_release(void *item)
+{
+    Item_destroy(item);
+}
+
 struct DescriptionRecord *Item_getDescriptionRecord(struct Database *db, struct Item *item)
 {
     check(db != NULL, "Database is NULL");
     check(item != NULL, "Item is NULL");
 
-    // See if item description exists in database
-    struct DescriptionRecord *descriptionRecord = Database_getDescriptionByPrefix(db, item->description);
-
-    if (descriptionRecord == NULL) {
-        // Description does not exist in DB, create it.
-        int nextDescriptionID = Database_getNextIndex(db, DESCRIPTION);
-        descriptionRecord = DescriptionRecord_create(nextDescriptionID, item->description, 0);
-        check(descriptionRecord != NULL, "Failed to create description record.");
-
-        descriptionRecord->id = nextDescriptionID;
-        enum MorkResult res = Database_createDescription(db, descriptionRecord);
-        if (res != MORK_OK) {
-            log_err("Failed to create description record.");
-            free(descriptionRecord);
-            return NULL;
-        }
-
-        free(descriptionRecord);
-        descriptionRecord = Database_getDescription(db, nextDescriptionID);
-    }
+    // Identical descriptions share one record, created the first time it is seen
+    struct DescriptionRecord *descriptionRecord = Database_getOrCreateDescription(db, item->description);
+    check(descriptionRecord != NULL, "Failed to create description record.");
 
     return descriptionRecord;
 
@@ -198,15 +205,26 @@ struct Item* Item_load(struct Database* db, int id)
     check(id > 0, "Invalid ID given: %d", id);
     check(db != NULL, "Database is NULL");
 
+    // Hand out the item already loaded from this record, if there is one
+    struct Item *item = Database_cacheGet(db, CACHE_ITEMS, id, Item_cacheRetain);
+    if (item != NULL) {
+        return item;
+    }
+
     struct ItemRecord *record = Database_getItem(db, id);
     check(record != NULL, "Failed to load item.");
 
     struct DescriptionRecord *description = Database_getDescription(db, record->description_id);
     check(description != NULL, "Failed to load description.");
 
-    struct Item *item = Item_create(record->name, description->description);
+    item = Item_create(record->name, description->description);
+    check(item != NULL, "Failed to create item.");
     item->id = record->id;
 
+    if (Database_cachePut(db, CACHE_ITEMS, item->id, Item_retain(item), Item_release) != MORK_OK) {
+        Item_destroy(item);
+    }
+
     return item;
 
 error:
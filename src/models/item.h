@@ -23,10 +23,13 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 struct Item {
     unsigned short id;
+    unsigned int refs; // Holders of this item, including the database's model cache, atomic
     char name[MAX_NAME], description[MAX_DESCRIPTION];
 };
 
 struct Item *Item_create(const char* name, const char* description);
+struct Item *Item_retain(struct Item *item);
+// Drops one reference; the item is freed with the last
 enum MorkResult Item_destroy(struct Item* item);
 
 struct Item *Item_clone(struct Item *source);
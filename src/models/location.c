@@ -1,4 +1,5 @@
 #include "location.h"
+#include "../coredb/cache.h"
 
 #include <lcthw/dbg.h>
 
@@ -28,6 +29,7 @@ struct Location *Location_create(char *name, char *description)
     struct Location *location = (struct Location *)calloc(1, sizeof(struct Location));
 
     location->id = 0;
+    location->refs = 1;
     location->name = strdup(name);
 
     location->description = strdup(description);
@@ -45,11 +47,23 @@ struct Location *Location_create(char *name, char *description)
     return location;
 }
 
+struct Location *Location_retain(struct Location *location)
+{
+    if (location != NULL) {
+        __atomic_add_fetch(&location->refs, 1, __ATOMIC_RELAXED);
+    }
+    return location;
+}
+
 enum MorkResult Location_destroy(struct Location *location)
 {
     if (location == NULL) {
         return MORK_ERROR_MODEL_LOCATION_NULL;
     }
+    // Whoever drops the last reference frees it, whichever thread that is
+    if (__atomic_sub_fetch(&location->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return MORK_OK;
+    }
     free(location->name);
     free(location->description);
     free(location);
@@ -62,25 +76,11 @@ struct LocationRecord *Location_asRecord(struct Database *db, struct Location *l
         return NULL;
     }
 
-    // Get description record
-    struct DescriptionRecord *description = Database_getDescriptionByPrefix(db, location->description);
+    // Get description record, shared with anything else that has the same text
+    struct DescriptionRecord *description = Database_getOrCreateDescription(db, location->description);
     if (description == NULL) {
-        // Create it
-        description = DescriptionRecord_create(Database_getNextIndex(db, DESCRIPTION), location->description, 0);
-        // Make sure to add to DB
-        enum MorkResult res = Database_createDescription(db, description);
-        if (res != MORK_OK) {
-            log_err("Failed to create description record.");
-            return NULL;
-        }
-
-        // Reload it
-        free(description);
-        description = Database_getDescriptionByPrefix(db, location->description);
-        if (description == NULL) {
-            log_err("Failed to reload description record.");
-            return NULL;
-        }
+        log_err("Failed to create description record.");
+        return NULL;
     }
 
     struct LocationRecord *record = LocationRecord_create(
@@ -137,8 +137,24 @@ enum MorkResult Location_save(struct Database *db, struct Location *location)
     }
 }
 
+static void *Location_cacheRetain(void *location)
+{
+    return Location_retain(location);
+}
+
+static void Location_release(void *location)
+{
+    Location_destroy(location);
+}
+
 struct Location *Location_load(struct Database *db, int id)
 {
+    // Walking back into a room hands out the location already loaded for it
+    struct Location *cached = Database_cacheGet(db, CACHE_LOCATIONS, id, Location_cacheRetain);
+    if (cached != NULL) {
+        return cached;
+    }
+
     struct LocationRecord *record = Database_getLocation(db, id);
     if (record == NULL) {
         log_err("Failed to load location record.");
@@ -186,6 +202,10 @@ struct Location *Location_load(struct Database *db, int id)
         }
     }
 
+    if (Database_cachePut(db, CACHE_LOCATIONS, location->id, Location_retain(location), Location_release) != MORK_OK) {
+        Location_destroy(location);
+    }
+
     return location;
 }
 
@@ -194,7 +214,13 @@ enum MorkResult Location_setName(struct Location *location, char *name)
     if (location == NULL) {
         return MORK_ERROR_MODEL_LOCATION_NULL;
     }
-    strncpy(location->name, name, MAX_NAME - 1);
+    // The old string was sized for the old text, so replace it outright
+    char *copy = strndup(name, MAX_NAME - 1);
+    if (copy == NULL) {
+        return MORK_ERROR_MODEL;
+    }
+    free(location->name);
+    location->name = copy;
     return MORK_OK;
 }
 
@@ -203,7 +229,13 @@ enum MorkResult Location_setDescription(struct Location *location, char *descrip
     if (location == NULL) {
         return MORK_ERROR_MODEL_LOCATION_NULL;
     }
-    strncpy(location->description, description, MAX_DESCRIPTION - 1);
+    // The old string was sized for the old text, so replace it outright
+    char *copy = strndup(description, MAX_DESCRIPTION - 1);
+    if (copy == NULL) {
+        return MORK_ERROR_MODEL;
+    }
+    free(location->description);
+    location->description = copy;
     return MORK_OK;
 }
 
@@ -21,6 +21,7 @@ enum ExitDirection oppositeDirection(enum ExitDirection direction);
 
 struct Location {
     unsigned short id;
+    unsigned int refs; // Holders of this location, including the database's model cache, atomic
     char *name;
     char *description;
     int exitIDs[MAX_EXITS];
@@ -29,6 +30,8 @@ struct Location {
 };
 
 struct Location *Location_create(char *name, char *description);
+struct Location *Location_retain(struct Location *location);
+// Drops one reference; the location is freed with the last
 enum MorkResult Location_destroy(struct Location *location);
 
 enum MorkResult Location_setName(struct Location *location, char *name);
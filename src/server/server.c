@@ -0,0 +1,597 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE // accept4
+
+#include "server.h"
+
+#include <errno.h>
+#include <lcthw/dbg.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const char *SERVER_GREETING = "Welcome to Mork. What is your name?\n";
+
+// Starting stats for a new character, in enum order
+static unsigned char SERVER_START_STATS[6] = {5, 5, 5, 5, 5, 10};
+
+struct Server *Server_create(struct Database *db, const char *start_location, unsigned int workers)
+{
+    struct Server *server = NULL;
+    check(db != NULL, "Expected a database.");
+    check(start_location != NULL, "Expected a start location.");
+
+    server = calloc(1, sizeof(struct Server));
+    check_mem(server);
+
+    server->db = db;
+    server->listen_fd = -1;
+    server->wake_fd = -1;
+    server->epoll_fd = -1;
+    server->worker_count = workers > 0 ? workers : SERVER_DEFAULT_WORKERS;
+    pthread_mutex_init(&server->world_lock, NULL);
+    pthread_mutex_init(&server->queue_lock, NULL);
+    pthread_cond_init(&server->queue_ready, NULL);
+    pthread_mutex_init(&server->sessions_lock, NULL);
+
+    server->start_location = strdup(start_location);
+    check_mem(server->start_location);
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    check(server->epoll_fd >= 0, "Failed to create epoll instance.");
+
+    server->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    check(server->wake_fd >= 0, "Failed to create wake fd.");
+
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = &server->wake_fd };
+    check(epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->wake_fd, &event) == 0, "Failed to watch wake fd.");
+
+    return server;
+
+error:
+    Server_destroy(server);
+    return NULL;
+}
+
+void Server_destroy(struct Server *server)
+{
+    if (server == NULL) { return; }
+
+    if (server->listen_fd >= 0) { close(server->listen_fd); }
+    if (server->socket_path) { unlink(server->socket_path); }
+    if (server->wake_fd >= 0) { close(server->wake_fd); }
+    if (server->epoll_fd >= 0) { close(server->epoll_fd); }
+
+    pthread_mutex_destroy(&server->world_lock);
+    pthread_mutex_destroy(&server->queue_lock);
+    pthread_cond_destroy(&server->queue_ready);
+    pthread_mutex_destroy(&server->sessions_lock);
+
+    free(server->socket_path);
+    free(server->start_location);
+    free(server->workers);
+    free(server);
+}
+
+static enum MorkResult Server_watchListener(struct Server *server)
+{
+    if (listen(server->listen_fd, SOMAXCONN) != 0) { return MORK_ERROR_SERVER_SOCKET; }
+
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = &server->listen_fd };
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &event) != 0) { return MORK_ERROR_SERVER_SOCKET; }
+    return MORK_OK;
+}
+
+/**
+ * @brief Accept players on a Unix socket. Any file already at the path is
+ *        replaced.
+ *
+ * @param server The server
+ * @param path   Where to create the socket
+ * @return enum MorkResult
+ */
+enum MorkResult Server_listenUnix(struct Server *server, const char *path)
+{
+    if (server == NULL) { return MORK_ERROR_SERVER_NULL; }
+    if (server->listen_fd >= 0) { return MORK_ERROR_SERVER_SOCKET; }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (path == NULL || strlen(path) >= sizeof(addr.sun_path)) { return MORK_ERROR_DB_INVALID_PATH; }
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    check(server->listen_fd >= 0, "Failed to create socket.");
+
+    unlink(path);
+    check(bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0, "Failed to bind %s", path);
+    server->socket_path = strdup(path);
+    check_mem(server->socket_path);
+
+    return Server_watchListener(server);
+
+error:
+    if (server->listen_fd >= 0) { close(server->listen_fd); }
+    server->listen_fd = -1;
+    return MORK_ERROR_SERVER_SOCKET;
+}
+
+/**
+ * @brief Accept players over TCP on every interface.
+ *
+ * @param server The server
+ * @param port   Port to listen on
+ * @return enum MorkResult
+ */
+enum MorkResult Server_listenTcp(struct Server *server, unsigned short port)
+{
+    if (server == NULL) { return MORK_ERROR_SERVER_NULL; }
+    if (server->listen_fd >= 0) { return MORK_ERROR_SERVER_SOCKET; }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+
+    server->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    check(server->listen_fd >= 0, "Failed to create socket.");
+
+    int on = 1;
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    check(bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0, "Failed to bind port %hu", port);
+
+    return Server_watchListener(server);
+
+error:
+    if (server->listen_fd >= 0) { close(server->listen_fd); }
+    server->listen_fd = -1;
+    return MORK_ERROR_SERVER_SOCKET;
+}
+
+/**
+ * @brief Queue output for a player. It is sent by Server_flushOutput.
+ *
+ * @return int 0, or -1 if it could not be queued
+ */
+static int Server_queueOutput(struct ServerSession *session, const char *text, size_t len)
+{
+    if (session->output_sent == session->output_len) {
+        session->output_len = 0;
+        session->output_sent = 0;
+    }
+    size_t needed = session->output_len + len;
+    if (needed > session->output_cap) {
+        size_t cap = session->output_cap ? session->output_cap : SERVER_READ_SIZE;
+        while (cap < needed) { cap *= 2; }
+        char *grown = realloc(session->output, cap);
+        if (grown == NULL) { return -1; }
+        session->output = grown;
+        session->output_cap = cap;
+    }
+    memcpy(session->output + session->output_len, text, len);
+    session->output_len = needed;
+    return 0;
+}
+
+/**
+ * @brief Send as much queued output as the socket takes without blocking.
+ *
+ * @return int 0, or -1 if the player is gone
+ */
+static int Server_flushOutput(struct ServerSession *session)
+{
+    while (session->output_sent < session->output_len) {
+        ssize_t n = send(session->fd, session->output + session->output_sent,
+                         session->output_len - session->output_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { return 0; }
+        if (n <= 0) { return -1; }
+        session->output_sent += (size_t)n;
+    }
+    return 0;
+}
+
+static size_t Server_pendingOutput(struct ServerSession *session)
+{
+    return session->output_len - session->output_sent;
+}
+
+/**
+ * @brief Watch a session's socket again, for input unless too much output is
+ *        waiting, and for the socket taking output if any is.
+ *
+ * @return int 0, or -1 if it could not be watched
+ */
+static int Server_watchSession(struct Server *server, struct ServerSession *session, int op)
+{
+    uint32_t events = EPOLLRDHUP | EPOLLONESHOT;
+    if (Server_pendingOutput(session) < SERVER_OUTPUT_MAX) { events |= EPOLLIN; }
+    if (Server_pendingOutput(session) > 0) { events |= EPOLLOUT; }
+
+    struct epoll_event event = { .events = events, .data.ptr = session };
+    return epoll_ctl(server->epoll_fd, op, session->fd, &event) == 0 ? 0 : -1;
+}
+
+static void Server_openSession(struct Server *server, int fd)
+{
+    struct ServerSession *session = calloc(1, sizeof(struct ServerSession));
+    if (session == NULL) {
+        close(fd);
+        return;
+    }
+    session->fd = fd;
+
+    pthread_mutex_lock(&server->sessions_lock);
+    session->next = server->sessions;
+    if (server->sessions) { server->sessions->prev = session; }
+    server->sessions = session;
+    server->session_count++;
+    pthread_mutex_unlock(&server->sessions_lock);
+
+    if (Server_queueOutput(session, SERVER_GREETING, strlen(SERVER_GREETING)) != 0 || Server_flushOutput(session) != 0) {
+        log_err("Failed to greet player.");
+    }
+    if (Server_watchSession(server, session, EPOLL_CTL_ADD) != 0) {
+        log_err("Failed to watch session socket.");
+    }
+}
+
+static void Server_closeSession(struct Server *server, struct ServerSession *session)
+{
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, session->fd, NULL);
+    close(session->fd);
+
+    if (session->game) {
+        pthread_mutex_lock(&server->world_lock);
+        ActionParser_reset(&session->parser);
+        BaseGame_destroy(session->game);
+        session->game = NULL;
+        pthread_mutex_unlock(&server->world_lock);
+    }
+
+    pthread_mutex_lock(&server->sessions_lock);
+    if (session->prev) { session->prev->next = session->next; }
+    else { server->sessions = session->next; }
+    if (session->next) { session->next->prev = session->prev; }
+    server->session_count--;
+    pthread_mutex_unlock(&server->sessions_lock);
+
+    free(session->output);
+    free(session);
+}
+
+/**
+ * @brief Turn the first line a player sends into their game: load the
+ *        character with that name, or create it in the start location.
+ *
+ * @return int 1 to keep the session open, 0 to close it
+ */
+static int Server_login(struct Server *server, struct ServerSession *session, const char *name, FILE *out)
+{
+    struct Database *db = server->db;
+
+    if (name[0] == '\0' || strlen(name) >= MAX_NAME_LEN) {
+        fprintf(out, "That's not a name. What is your name?\n");
+        return 1;
+    }
+
+    struct Character *player = Character_load(db, (char *)name);
+    if (player == NULL) {
+        player = Character_create((char *)name, 1, SERVER_START_STATS, 6);
+        if (player == NULL || Character_save(db, player) <= 0) {
+            Character_destroy(player);
+            fprintf(out, "Something went wrong making your character.\n");
+            return 0;
+        }
+    }
+
+    struct Location *location = Location_loadByName(db, server->start_location);
+    if (location == NULL) {
+        Character_destroy(player);
+        fprintf(out, "There's nowhere to start.\n");
+        return 0;
+    }
+
+    session->game = BaseGame_create(player);
+    if (session->game == NULL) {
+        Character_destroy(player);
+        Location_destroy(location);
+        return 0;
+    }
+    BaseGame_setLocation(session->game, location);
+    if (BaseGame_initParser(db, session->game, &session->parser) != MORK_OK) { return 0; }
+
+    fprintf(out, "Welcome, %s. You are in %s.\n", player->name, location->name);
+    return 1;
+}
+
+/**
+ * @brief Handle one line from a player, holding the world lock for the turn
+ *        but not while it is committed.
+ *
+ * @return int 1 to keep the session open, 0 to close it
+ */
+static int Server_handleLine(struct Server *server, struct ServerSession *session, char *line, FILE *out)
+{
+    size_t len = strlen(line);
+    if (len > 0 && line[len - 1] == '\r') { line[len - 1] = '\0'; }
+
+    int open = 1;
+    pthread_mutex_lock(&server->world_lock);
+    if (session->game == NULL) {
+        open = Server_login(server, session, line, out);
+    } else {
+        unsigned char stop = 0;
+        if (BaseGame_runCommand(server->db, session->game, &session->parser, line, out, &stop) != MORK_OK) {
+            fprintf(out, "Something went wrong.\n");
+        }
+        open = !stop;
+    }
+    // Sealed while no other turn is half done, so the turn is logged whole
+    enum MorkResult res = Database_seal(server->db);
+    pthread_mutex_unlock(&server->world_lock);
+
+    // Other turns run while this one is written, and are written with it
+    // when they finish first
+    if (res == MORK_OK) { res = Database_commitSealed(server->db); }
+    if (res != MORK_OK) {
+        log_err("Failed to commit turn.");
+    }
+
+    if (!open) { fprintf(out, "Goodbye.\n"); }
+    return open;
+}
+
+static void Server_enqueue(struct Server *server, struct ServerSession *session)
+{
+    pthread_mutex_lock(&server->queue_lock);
+    session->queue_next = NULL;
+    if (server->queue_tail) { server->queue_tail->queue_next = session; }
+    else { server->queue_head = session; }
+    server->queue_tail = session;
+    pthread_cond_signal(&server->queue_ready);
+    pthread_mutex_unlock(&server->queue_lock);
+}
+
+/**
+ * @brief Run complete lines a player has sent, up to SERVER_LINES_PER_WAKEUP,
+ *        writing what happened to out. Bytes read past the last line run stay
+ *        in session->received for the next wakeup.
+ *
+ * @return int 1 to keep the session open, 0 to close it
+ */
+static int Server_runInput(struct Server *server, struct ServerSession *session, FILE *out)
+{
+    int open = 1;
+    unsigned int lines = 0;
+    while (open && lines < SERVER_LINES_PER_WAKEUP) {
+        if (session->received_pos == session->received_len) {
+            ssize_t n = recv(session->fd, session->received, sizeof(session->received), MSG_DONTWAIT);
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+            if (n <= 0) {
+                open = 0;
+                break;
+            }
+            session->received_len = (size_t)n;
+            session->received_pos = 0;
+        }
+
+        while (session->received_pos < session->received_len && lines < SERVER_LINES_PER_WAKEUP && open) {
+            char c = session->received[session->received_pos++];
+            if (c != '\n') {
+                if (session->input_len < SERVER_LINE_MAX - 1) {
+                    session->input[session->input_len++] = c;
+                } else {
+                    session->overlong = 1;
+                }
+                continue;
+            }
+
+            session->input[session->input_len] = '\0';
+            if (session->overlong) {
+                fprintf(out, "That's too long.\n");
+            } else {
+                open = Server_handleLine(server, session, session->input, out);
+            }
+            session->input_len = 0;
+            session->overlong = 0;
+            lines++;
+        }
+    }
+    return open;
+}
+
+/**
+ * @brief Send what a player is owed, run what they sent and queue the output.
+ *        Runs on a worker; the session is not watched while this runs, so no
+ *        other worker can have it. Nothing here blocks on the socket.
+ */
+static void Server_serve(struct Server *server, struct ServerSession *session)
+{
+    int open = Server_flushOutput(session) == 0;
+
+    // A player that isn't reading gets nothing more until it has caught up
+    if (open && Server_pendingOutput(session) < SERVER_OUTPUT_MAX) {
+        char *text = NULL;
+        size_t text_len = 0;
+        FILE *out = open_memstream(&text, &text_len);
+        if (out == NULL) {
+            Server_closeSession(server, session);
+            return;
+        }
+
+        open = Server_runInput(server, session, out);
+        fclose(out);
+        if (Server_queueOutput(session, text, text_len) != 0) { open = 0; }
+        free(text);
+
+        if (Server_flushOutput(session) != 0) { open = 0; }
+    }
+
+    if (!open) {
+        Server_closeSession(server, session);
+        return;
+    }
+
+    if (session->received_pos < session->received_len && Server_pendingOutput(session) < SERVER_OUTPUT_MAX) {
+        // Lines already read are left from the cap; the socket may have
+        // nothing more to say, so go to the back of the queue rather than
+        // wait for it
+        Server_enqueue(server, session);
+        return;
+    }
+    if (Server_watchSession(server, session, EPOLL_CTL_MOD) != 0) {
+        Server_closeSession(server, session);
+    }
+}
+
+static void *Server_worker(void *arg)
+{
+    struct Server *server = arg;
+
+    while (1) {
+        pthread_mutex_lock(&server->queue_lock);
+        while (server->running && server->queue_head == NULL) {
+            pthread_cond_wait(&server->queue_ready, &server->queue_lock);
+        }
+        if (!server->running) {
+            pthread_mutex_unlock(&server->queue_lock);
+            break;
+        }
+        struct ServerSession *session = server->queue_head;
+        server->queue_head = session->queue_next;
+        if (server->queue_head == NULL) { server->queue_tail = NULL; }
+        session->queue_next = NULL;
+        pthread_mutex_unlock(&server->queue_lock);
+
+        Server_serve(server, session);
+    }
+    return NULL;
+}
+
+static void Server_accept(struct Server *server)
+{
+    while (1) {
+        // A player that stops reading must not pin a worker in send
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) { continue; }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { log_err("Failed to accept a player."); }
+            return;
+        }
+        Server_openSession(server, fd);
+    }
+}
+
+/**
+ * @brief Serve players until Server_stop is called. The worker pool lives for
+ *        the length of this call; any sessions still open when it returns are
+ *        closed.
+ *
+ * @param server The server, already listening
+ * @return enum MorkResult
+ */
+enum MorkResult Server_run(struct Server *server)
+{
+    if (server == NULL) { return MORK_ERROR_SERVER_NULL; }
+    if (server->listen_fd < 0) { return MORK_ERROR_SERVER_SOCKET; }
+
+    server->running = 1;
+    server->workers = calloc(server->worker_count, sizeof(pthread_t));
+    if (server->workers == NULL) { return MORK_ERROR_SERVER; }
+
+    unsigned int started = 0;
+    for (; started < server->worker_count; started++) {
+        if (pthread_create(&server->workers[started], NULL, Server_worker, server) != 0) { break; }
+    }
+
+    enum MorkResult res = started > 0 ? MORK_OK : MORK_ERROR_SERVER;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    unsigned char stopping = started == 0;
+    while (!stopping) {
+        int n = epoll_wait(server->epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            res = MORK_ERROR_SERVER;
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == &server->wake_fd) {
+                uint64_t count;
+                if (read(server->wake_fd, &count, sizeof(count)) < 0) { log_err("Failed to read wake fd."); }
+                stopping = 1;
+            } else if (events[i].data.ptr == &server->listen_fd) {
+                Server_accept(server);
+            } else {
+                Server_enqueue(server, events[i].data.ptr);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&server->queue_lock);
+    server->running = 0;
+    server->queue_head = NULL;
+    server->queue_tail = NULL;
+    pthread_cond_broadcast(&server->queue_ready);
+    pthread_mutex_unlock(&server->queue_lock);
+
+    for (unsigned int i = 0; i < started; i++) {
+        pthread_join(server->workers[i], NULL);
+    }
+    free(server->workers);
+    server->workers = NULL;
+
+    while (server->sessions) {
+        Server_closeSession(server, server->sessions);
+    }
+    return res;
+}
+
+/**
+ * @brief Ask Server_run to return. Safe to call from any thread or a signal
+ *        handler.
+ *
+ * @param server The server
+ */
+void Server_stop(struct Server *server)
+{
+    if (server == NULL) { return; }
+
+    uint64_t one = 1;
+    if (write(server->wake_fd, &one, sizeof(one)) < 0) { log_err("Failed to wake server."); }
+}
+
+unsigned int Server_sessionCount(struct Server *server)
+{
+    if (server == NULL) { return 0; }
+
+    pthread_mutex_lock(&server->sessions_lock);
+    unsigned int count = server->session_count;
+    pthread_mutex_unlock(&server->sessions_lock);
+    return count;
+}
@@ -0,0 +1,111 @@
+/*
+Mork: A Zorklike text adventure game influenced by classic late 70s television.
+Copyright (C) 2024 Jacob Triebwasser
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../coredb/db.h"
+#include "../models/game.h"
+#include "../utils/error.h"
+
+#include <pthread.h>
+
+// Hosts many players in one world. One thread waits on every socket with
+// epoll; when a player's socket has input, one worker from the pool reads it,
+// runs up to SERVER_LINES_PER_WAKEUP complete lines through the player's own
+// BaseGame and queues the output on the session. Sockets never block: output
+// the socket won't take yet waits for EPOLLOUT, and a player with more than
+// SERVER_OUTPUT_MAX bytes waiting is not read from until it drains. Each
+// session has its own character, inventory and history, while the world
+// Database and the models loaded from it are shared, so workers take the
+// world lock around every turn.
+//
+// The protocol is plain lines of text: the first line a player sends is the
+// name of their character (created in the start location if it is new), and
+// every line after that is a command.
+
+#define SERVER_LINE_MAX 256
+#define SERVER_READ_SIZE 1024
+#define SERVER_LINES_PER_WAKEUP 16
+#define SERVER_OUTPUT_MAX (64 * 1024)
+#define SERVER_MAX_EVENTS 64
+#define SERVER_DEFAULT_WORKERS 4
+
+struct ServerSession {
+    int fd;
+    struct BaseGame *game; // NULL until the player has named their character
+    ActionParser parser;
+
+    char input[SERVER_LINE_MAX]; // Bytes received that don't yet make a line
+    size_t input_len;
+    unsigned char overlong; // Dropping the rest of a line that didn't fit
+
+    // Read from the socket but not yet looked at, when a wakeup stopped at
+    // its line cap
+    char received[SERVER_READ_SIZE];
+    size_t received_len;
+    size_t received_pos;
+
+    // Output the socket has not taken yet
+    char *output;
+    size_t output_len;
+    size_t output_sent;
+    size_t output_cap;
+
+    struct ServerSession *queue_next;
+    struct ServerSession *prev;
+    struct ServerSession *next;
+};
+
+struct Server {
+    struct Database *db; // Not owned
+    char *start_location;
+
+    int listen_fd;
+    char *socket_path; // Removed again on destroy, for Unix sockets
+    int epoll_fd;
+    int wake_fd; // Written by Server_stop to end Server_run
+
+    // Running a turn holds this, since sessions in one place share models;
+    // committing the turn does not
+    pthread_mutex_t world_lock;
+
+    // Sessions with input waiting, for the workers
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_ready;
+    struct ServerSession *queue_head;
+    struct ServerSession *queue_tail;
+    unsigned char running;
+
+    pthread_t *workers;
+    unsigned int worker_count;
+
+    // Every open session, so they can be closed when the server stops
+    pthread_mutex_t sessions_lock;
+    struct ServerSession *sessions;
+    unsigned int session_count;
+};
+
+struct Server *Server_create(struct Database *db, const char *start_location, unsigned int workers);
+void Server_destroy(struct Server *server);
+
+enum MorkResult Server_listenUnix(struct Server *server, const char *path);
+enum MorkResult Server_listenTcp(struct Server *server, unsigned short port);
+
+enum MorkResult Server_run(struct Server *server);
+void Server_stop(struct Server *server);
+unsigned int Server_sessionCount(struct Server *server);
@@ -61,6 +61,43 @@ void TS_print(struct TerminalSegment *frame)
     printf("%s", frame->rawTextRepresentation->data);
 }
 
+/**
+ * @brief Write the text of a segment without its control codes, e.g. to a log
+ *        or transcript that is not a terminal.
+ *
+ * @param frame The segment
+ * @param out   Where to write it
+ */
+void TS_writePlain(struct TerminalSegment *frame, FILE *out)
+{
+    if (frame == NULL || frame->rawTextRepresentation == NULL || out == NULL) {
+        return;
+    }
+
+    const unsigned char *text = frame->rawTextRepresentation->data;
+    int len = blength(frame->rawTextRepresentation);
+    int start = 0;
+    for (int i = 0; i < len; i++) {
+        if (text[i] != '\033') {
+            continue;
+        }
+        fwrite(text + start, 1, i - start, out);
+
+        // Skip to the final byte of the escape sequence
+        i++;
+        if (i < len && text[i] == '[') {
+            i++;
+            while (i < len && (text[i] < 0x40 || text[i] > 0x7E)) {
+                i++;
+            }
+        }
+        start = i + 1;
+    }
+    if (start < len) {
+        fwrite(text + start, 1, len - start, out);
+    }
+}
+
 struct TerminalSegment *TS_clone(struct TerminalSegment *frame)
 {
     struct TerminalSegment *clone = malloc(sizeof(struct TerminalSegment));
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <lcthw/bstrlib.h>
+#include <stdio.h>
 
 #include "../models/character.h"
 #include "../models/location.h"
@@ -23,6 +24,7 @@ struct TerminalSegment *TS_new();
 struct TerminalSegment *TS_clone(struct TerminalSegment *frame);
 void TS_destroy(struct TerminalSegment *frame);
 void TS_print(struct TerminalSegment *frame);
+void TS_writePlain(struct TerminalSegment *frame, FILE *out);
 struct TerminalSegment *TS_concatText(struct TerminalSegment *frame, const char *text);
 struct TerminalSegment *TS_setBold(struct TerminalSegment *frame);
 struct TerminalSegment *TS_setDim(struct TerminalSegment *frame);
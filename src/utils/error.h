@@ -47,4 +47,9 @@ enum MorkResult {
 
     MORK_ERROR_MODEL_TRANSACTION_NULL, // Transaction is NULL
     MORK_ERROR_MODEL_ACTION_KIND, // Invalid action kind
+
+    // Server Errors
+    MORK_ERROR_SERVER, // Generic server error
+    MORK_ERROR_SERVER_NULL, // Server is NULL
+    MORK_ERROR_SERVER_SOCKET, // Error setting up a socket
 };
\ No newline at end of file
@@ -2,9 +2,17 @@
 #include "test_settings.h"
 
 #include "../src/coredb/db.h"
+#include "../src/coredb/ioengine.h"
+#include "../src/coredb/lz.h"
+#include "../src/coredb/roomgraph.h"
+#include "../src/coredb/wal.h"
 #include "../src/utils/error.h"
 
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 struct Database *db = NULL;
 
@@ -53,6 +61,27 @@ char *test_flush()
     return NULL;
 }
 
+char *test_flush_dirty_only()
+{
+    struct TableMeta *meta = Database_get(db, DESCRIPTION);
+    mu_assert(meta != NULL, "Expected description table.");
+
+    Database_flush(db);
+    mu_assert(meta->dirty_count == 0, "Flush left dirty pages behind.");
+
+    struct DescriptionRecord description = { .id = 2, .description = "Dirty Description" };
+    enum MorkResult result = Database_createDescription(db, &description);
+    mu_assert(result == MORK_OK, "Failed to create description.");
+    mu_assert(meta->dirty_count > 0 && meta->dirty_count <= 2, "Expected only the new row's pages to be dirty.");
+
+    result = Database_flush(db);
+    mu_assert(result == MORK_OK, "Failed to flush database.");
+    mu_assert(meta->dirty_count == 0, "Flush left dirty pages behind.");
+
+    Database_deleteDescription(db, 2);
+    return NULL;
+}
+
 char *test_close()
 {
     Database_close(db);
@@ -268,6 +297,11 @@ char *test_create_inventory()
     mu_assert(retrieved != NULL, "Failed to retrieve inventory.");
     mu_assert(retrieved->owner_id == 1, "Inventory owner mismatch.");
 
+    retrieved = Database_getInventoryByOwner(db, owner.name);
+    mu_assert(retrieved != NULL && retrieved->id == 1, "Failed to find inventory by owner.");
+    result = Database_createInventory(db, "Nobody");
+    mu_assert(result == MORK_ERROR_DB_NOT_FOUND, "Created an inventory for a missing owner.");
+
     return NULL;
 }
 
@@ -295,6 +329,471 @@ char *test_delete_inventory()
     return NULL;
 }
 
+char *test_primary_key_index()
+{
+    struct ItemRecord item = { .id = 42, .name = "Indexed Item" };
+    enum MorkResult result = Database_createItem(db, &item);
+    mu_assert(result == MORK_OK, "Failed to create item.");
+
+    struct TableMeta *meta = Database_get(db, ITEMS);
+    struct ItemRecord *retrieved = Database_getItem(db, 42);
+    mu_assert(retrieved != NULL, "Failed to retrieve item.");
+    mu_assert(meta->indexed == 1, "Lookup should have built the index.");
+
+    result = Database_deleteItem(db, 42);
+    mu_assert(result == MORK_OK, "Failed to delete item.");
+    mu_assert(Database_getItem(db, 42) == NULL, "Deleted item is still indexed.");
+    mu_assert(Database_deleteItem(db, 42) == MORK_ERROR_DB_NOT_FOUND, "Deleting twice should not find the item.");
+
+    // Recreating the id must point the index at the new row
+    strcpy(item.name, "Reindexed Item");
+    result = Database_createItem(db, &item);
+    mu_assert(result == MORK_OK, "Failed to recreate item.");
+    retrieved = Database_getItem(db, 42);
+    mu_assert(retrieved != NULL, "Failed to retrieve recreated item.");
+    mu_assert(strcmp(retrieved->name, "Reindexed Item") == 0, "Item name mismatch.");
+
+    // A rebuilt index must agree with the incrementally maintained one
+    TableMeta_invalidate(meta);
+    mu_assert(Database_getItem(db, 42) == retrieved, "Rebuilt index disagrees.");
+
+    Database_deleteItem(db, 42);
+    return NULL;
+}
+
+char *test_name_index()
+{
+    struct LocationRecord location = { .id = 9, .name = "Old Mill" };
+    enum MorkResult result = Database_createLocation(db, &location);
+    mu_assert(result == MORK_OK, "Failed to create location.");
+
+    struct LocationRecord *retrieved = Database_getLocationByName(db, "Old Mill");
+    mu_assert(retrieved != NULL && retrieved->id == 9, "Failed to retrieve location by name.");
+
+    // Renaming must move the row to its new name
+    strcpy(location.name, "New Mill");
+    result = Database_updateLocation(db, &location);
+    mu_assert(result == MORK_OK, "Failed to update location.");
+    mu_assert(Database_getLocationByName(db, "Old Mill") == NULL, "Old name is still indexed.");
+    retrieved = Database_getLocationByName(db, "New Mill");
+    mu_assert(retrieved != NULL && retrieved->id == 9, "New name is not indexed.");
+
+    TableMeta_invalidate(Database_get(db, LOCATIONS));
+    mu_assert(Database_getLocationByName(db, "New Mill") == retrieved, "Rebuilt name index disagrees.");
+
+    Database_deleteLocation(db, 9);
+    mu_assert(Database_getLocationByName(db, "New Mill") == NULL, "Deleted location is still indexed.");
+
+    return NULL;
+}
+
+char *test_owner_index()
+{
+    struct InventoryTable *table = InventoryTable_create();
+    mu_assert(table != NULL, "Failed to create inventory table.");
+
+    mu_assert(InventoryTable_add(table, 7, 1) == MORK_OK, "Failed to add inventory.");
+    mu_assert(InventoryTable_add(table, 8, 2) == MORK_OK, "Failed to add inventory.");
+
+    struct InventoryRecord *found = InventoryTable_getByOwner(table, 8);
+    mu_assert(found != NULL && found->id == 2, "Failed to find inventory by owner.");
+
+    // Handing the bag to someone else moves it in the index
+    struct InventoryRecord record = *found;
+    record.owner_id = 9;
+    mu_assert(InventoryTable_update(table, &record) == MORK_OK, "Failed to update inventory.");
+    mu_assert(InventoryTable_getByOwner(table, 8) == NULL, "Old owner is still indexed.");
+    found = InventoryTable_getByOwner(table, 9);
+    mu_assert(found != NULL && found->id == 2, "New owner is not indexed.");
+
+    mu_assert(InventoryTable_remove(table, 1) == MORK_OK, "Failed to remove inventory.");
+    mu_assert(InventoryTable_getByOwner(table, 7) == NULL, "Removed inventory is still indexed.");
+
+    TableMeta_invalidate(&table->meta);
+    mu_assert(InventoryTable_getByOwner(table, 9) == found, "Rebuilt owner index disagrees.");
+
+    InventoryTable_destroy(table);
+    return NULL;
+}
+
+char *test_inventory_packed_items()
+{
+    struct InventoryRecord *record = InventoryRecord_create(1, 1);
+    mu_assert(record != NULL, "Failed to create inventory record.");
+
+    InventoryRecord_addItem(record, 10);
+    InventoryRecord_addItem(record, 11);
+    InventoryRecord_addItem(record, 12);
+    mu_assert(InventoryRecord_getItemCount(record) == 3, "Expected three items.");
+
+    // Removing from the middle keeps the rest packed and in order
+    mu_assert(InventoryRecord_removeItem(record, 11) == MORK_OK, "Failed to remove item.");
+    mu_assert(InventoryRecord_getItemCount(record) == 2, "Expected two items.");
+    mu_assert(record->item_ids[0] == 10 && record->item_ids[1] == 12 && record->item_ids[2] == 0,
+              "Item ids are not packed.");
+    mu_assert(InventoryRecord_removeItem(record, 11) == MORK_ERROR_DB_NOT_FOUND, "Removed an item twice.");
+
+    for (int i = InventoryRecord_getItemCount(record); i < MAX_INVENTORY_ITEMS; i++) {
+        mu_assert(InventoryRecord_addItem(record, 100 + i) == MORK_OK, "Failed to fill inventory.");
+    }
+    mu_assert(InventoryRecord_addItem(record, 1) == MORK_ERROR_DB_FIELD_FULL, "Full inventory accepted an item.");
+
+    // A table row shrinks with the record it is updated from
+    struct InventoryTable *table = InventoryTable_create();
+    mu_assert(InventoryTable_add(table, 1, 1) == MORK_OK, "Failed to add inventory.");
+    mu_assert(InventoryTable_update(table, record) == MORK_OK, "Failed to update inventory.");
+    mu_assert(InventoryTable_get(table, 1)->item_count == MAX_INVENTORY_ITEMS, "Row did not take the full list.");
+
+    record->item_count = 1;
+    mu_assert(InventoryTable_update(table, record) == MORK_OK, "Failed to update inventory.");
+    struct InventoryRecord *row = InventoryTable_get(table, 1);
+    mu_assert(row->item_count == 1 && row->item_ids[0] == 10 && row->item_ids[1] == 0,
+              "Row kept ids past its count.");
+
+    InventoryTable_destroy(table);
+    InventoryRecord_destroy(record);
+    return NULL;
+}
+
+char *test_description_prefix_index()
+{
+    struct DescriptionTable *table = DescriptionTable_create();
+    mu_assert(table != NULL, "Failed to create description table.");
+
+    struct DescriptionRecord record = { .id = 1, .description = "A shiny apple." };
+    DescriptionTable_insert(table, &record);
+    record = (struct DescriptionRecord){ .id = 2, .description = "A bruised banana." };
+    DescriptionTable_insert(table, &record);
+    record = (struct DescriptionRecord){ .id = 3, .description = "A shiny apple pie." };
+    DescriptionTable_insert(table, &record);
+
+    struct DescriptionRecord *found = DescriptionTable_get_by_prefix(table, "A shiny");
+    mu_assert(found != NULL && found->id == 1, "Prefix search should return the first row that matches.");
+    unsigned int first = 0;
+    mu_assert(TableMeta_prefixRange(&table->meta, "A shiny", &first) == 2, "Expected two rows with the prefix.");
+
+    // Updates and deletes move rows in and out of the index
+    record = (struct DescriptionRecord){ .id = 2, .description = "A ripe cherry." };
+    mu_assert(DescriptionTable_update(table, &record) == MORK_OK, "Failed to update description.");
+    mu_assert(DescriptionTable_get_by_prefix(table, "A bruised") == NULL, "Old text is still indexed.");
+    found = DescriptionTable_get_by_prefix(table, "A ripe");
+    mu_assert(found != NULL && found->id == 2, "New text is not indexed.");
+
+    mu_assert(DescriptionTable_delete(table, 1) == MORK_OK, "Failed to delete description.");
+    found = DescriptionTable_get_by_prefix(table, "A shiny");
+    mu_assert(found != NULL && found->id == 3, "Deleted description is still indexed.");
+
+    TableMeta_invalidate(&table->meta);
+    mu_assert(DescriptionTable_get_by_prefix(table, "A shiny") == found, "Rebuilt prefix index disagrees.");
+    mu_assert(DescriptionTable_get_by_prefix(table, "A zebra") == NULL, "Found a description that does not exist.");
+
+    // Renaming a row moves only its own entry, and each row knows its place
+    record = (struct DescriptionRecord){ .id = 2, .description = "A zesty lime." };
+    mu_assert(DescriptionTable_update(table, &record) == MORK_OK, "Failed to update description.");
+    found = DescriptionTable_get_by_prefix(table, "A zesty");
+    mu_assert(found != NULL && found->id == 2, "Moved text is not indexed.");
+    for (unsigned int i = 0; i < table->meta.sorted_count; i++) {
+        mu_assert(table->meta.sort_pos[table->meta.sorted[i]] == i + 1, "Row lost its place in the index.");
+    }
+
+    // A bulk load in reverse order would shift the whole index on every
+    // insert, so the index is dropped and sorted once by the next search
+    for (unsigned short id = 300; id >= 100; id--) {
+        record = (struct DescriptionRecord){ .id = id };
+        snprintf(record.description, sizeof(record.description), "Bulk %03u", id);
+        mu_assert(DescriptionTable_insert(table, &record) == MORK_OK, "Failed to insert description.");
+    }
+    mu_assert(!table->meta.sort_built, "A bulk load kept shifting the index.");
+    mu_assert(TableMeta_prefixRange(&table->meta, "Bulk ", &first) == 201, "Expected every bulk row.");
+    for (unsigned int i = 1; i < table->meta.sorted_count; i++) {
+        struct DescriptionRecord *prev = &table->rows[table->meta.sorted[i - 1]];
+        mu_assert(strcmp(prev->description, table->rows[table->meta.sorted[i]].description) <= 0, "Index is out of order.");
+    }
+
+    DescriptionTable_destroy(table);
+    return NULL;
+}
+
+char *test_description_interning()
+{
+    struct DescriptionRecord *pie = Database_getOrCreateDescription(db, "An apple pie.");
+    mu_assert(pie != NULL, "Failed to intern description.");
+    unsigned short pie_id = pie->id;
+
+    // A prefix of existing text is different text and gets its own record
+    struct DescriptionRecord *apple = Database_getOrCreateDescription(db, "An apple");
+    mu_assert(apple != NULL && apple->id != pie_id, "Prefix was deduplicated against longer text.");
+    unsigned short apple_id = apple->id;
+
+    // The same text again is the same record
+    pie = Database_getOrCreateDescription(db, "An apple pie.");
+    mu_assert(pie != NULL && pie->id == pie_id, "Identical text was stored twice.");
+    apple = Database_getDescriptionByText(db, "An apple");
+    mu_assert(apple != NULL && apple->id == apple_id, "Failed to find description by text.");
+    mu_assert(Database_getDescriptionByText(db, "An apple tart.") == NULL, "Found text that was never stored.");
+
+    Database_deleteDescription(db, pie_id);
+    Database_deleteDescription(db, apple_id);
+    mu_assert(Database_getDescriptionByText(db, "An apple pie.") == NULL, "Deleted description is still interned.");
+
+    // A lookup only builds the index it reads, so fetching by id does not
+    // page in every row to sort or hash the text
+    struct TableMeta *meta = Database_get(db, DESCRIPTION);
+    TableMeta_invalidate(meta);
+    Database_getDescription(db, 1);
+    mu_assert(meta->indexed && !meta->sort_built && !meta->names_indexed, "An id lookup built more than the id index.");
+    Database_getDescriptionByPrefix(db, "An");
+    mu_assert(meta->sort_built && !meta->names_indexed, "A prefix search should build only the sorted index.");
+
+    return NULL;
+}
+
+char *test_room_graph()
+{
+    struct DescriptionRecord *hall_desc = Database_getOrCreateDescription(db, "A long hall.");
+    struct DescriptionRecord *yard_desc = Database_getOrCreateDescription(db, "A muddy yard.");
+    mu_assert(hall_desc != NULL && yard_desc != NULL, "Failed to create descriptions.");
+
+    // Exits are stored in [NORTH, SOUTH, EAST, WEST, UP, DOWN] order
+    struct LocationRecord hall = { .id = 20, .name = "Hall", .descriptionID = hall_desc->id };
+    struct LocationRecord yard = { .id = 21, .name = "Yard", .descriptionID = yard_desc->id };
+    hall.exitIDs[0] = 21;
+    yard.exitIDs[1] = 20;
+    mu_assert(Database_createLocation(db, &hall) == MORK_OK, "Failed to create hall.");
+    mu_assert(Database_createLocation(db, &yard) == MORK_OK, "Failed to create yard.");
+
+    struct Room room;
+    mu_assert(Database_copyRoom(db, 20, &room) == MORK_OK && room.id == 20, "Failed to find hall in the room graph.");
+    mu_assert(strcmp(room.description, "A long hall.") == 0, "Hall description mismatch.");
+    mu_assert(room.exits[0] == 21, "Exits should be copied out as location ids.");
+
+    mu_assert(Database_copyRoomExit(db, 20, 0, &room) == MORK_OK && room.id == 21, "North of the hall should be the yard.");
+    mu_assert(strcmp(room.description, "A muddy yard.") == 0, "Yard description mismatch.");
+    mu_assert(Database_copyRoomExit(db, 21, 1, &room) == MORK_OK && room.id == 20, "South of the yard should be the hall.");
+    mu_assert(Database_copyRoomExit(db, 20, 2, &room) == MORK_ERROR_DB_NOT_FOUND, "Found an exit that does not exist.");
+    mu_assert(Database_copyRoom(db, 99, &room) == MORK_ERROR_DB_NOT_FOUND, "Found a location that does not exist.");
+
+    // Writing a location rebuilds the graph on the next lookup
+    hall.exitIDs[0] = 0;
+    hall.exitIDs[5] = 21;
+    mu_assert(Database_updateLocation(db, &hall) == MORK_OK, "Failed to update hall.");
+    mu_assert(Database_copyRoomExit(db, 20, 0, &room) == MORK_ERROR_DB_NOT_FOUND, "Removed exit is still in the graph.");
+    mu_assert(Database_copyRoomExit(db, 20, 5, &room) == MORK_OK && room.id == 21, "New exit is not in the graph.");
+
+    // The copy outlives the graph it came from
+    Database_deleteLocation(db, 21);
+    mu_assert(room.id == 21 && strcmp(room.description, "A muddy yard.") == 0, "Copied room changed with the graph.");
+
+    mu_assert(Database_copyRoomExit(db, 20, 5, &room) == MORK_ERROR_DB_NOT_FOUND, "Exit to a deleted location is still in the graph.");
+
+    Database_deleteLocation(db, 20);
+    Database_deleteDescription(db, hall_desc->id);
+    Database_deleteDescription(db, yard_desc->id);
+    return NULL;
+}
+
+#define CONCURRENT_WRITERS 4
+#define CONCURRENT_READERS 4
+#define CONCURRENT_ROWS 20
+
+struct ConcurrentWork {
+    unsigned int ids[CONCURRENT_ROWS];
+    int failures;
+};
+
+static void *test_concurrent_writer(void *arg)
+{
+    struct ConcurrentWork *work = arg;
+    for (int i = 0; i < CONCURRENT_ROWS; i++) {
+        struct CharacterRecord character = { .health_and_mana = 1 };
+        character.id = work->ids[i] = Database_getNextIndex(db, CHARACTERS);
+        snprintf(character.name, MAX_NAME_LEN, "Worker %u", character.id);
+        if (Database_createCharacter(db, &character) != MORK_OK) { work->failures++; }
+
+        character.health_and_mana = 2;
+        if (Database_updateCharacter(db, &character) != MORK_OK) { work->failures++; }
+    }
+    return NULL;
+}
+
+static void *test_concurrent_reader(void *arg)
+{
+    struct ConcurrentWork *work = arg;
+    for (int i = 0; i < CONCURRENT_ROWS * 10; i++) {
+        struct LocationRecord location;
+        if (Database_copy(db, LOCATIONS, 30, &location) != MORK_OK || strcmp(location.name, "Square") != 0) {
+            work->failures++;
+        }
+        if (Database_getLocationByName(db, "Square") == NULL) { work->failures++; }
+    }
+    return NULL;
+}
+
+char *test_concurrent_access()
+{
+    struct LocationRecord square = { .id = 30, .name = "Square" };
+    mu_assert(Database_createLocation(db, &square) == MORK_OK, "Failed to create square.");
+
+    pthread_t threads[CONCURRENT_WRITERS + CONCURRENT_READERS];
+    struct ConcurrentWork work[CONCURRENT_WRITERS + CONCURRENT_READERS] = { 0 };
+    for (int i = 0; i < CONCURRENT_WRITERS + CONCURRENT_READERS; i++) {
+        void *(*run)(void *) = i < CONCURRENT_WRITERS ? test_concurrent_writer : test_concurrent_reader;
+        mu_assert(pthread_create(&threads[i], NULL, run, &work[i]) == 0, "Failed to start thread.");
+    }
+    for (int i = 0; i < CONCURRENT_WRITERS + CONCURRENT_READERS; i++) {
+        pthread_join(threads[i], NULL);
+        mu_assert(work[i].failures == 0, "A thread saw a failed or torn operation.");
+    }
+
+    // Every id was handed out once, and every row landed
+    for (int w = 0; w < CONCURRENT_WRITERS; w++) {
+        for (int i = 0; i < CONCURRENT_ROWS; i++) {
+            unsigned int id = work[w].ids[i];
+            for (int v = w; v < CONCURRENT_WRITERS; v++) {
+                for (int j = v == w ? i + 1 : 0; j < CONCURRENT_ROWS; j++) {
+                    mu_assert(work[v].ids[j] != id, "The same id was handed out twice.");
+                }
+            }
+
+            struct CharacterRecord copy;
+            mu_assert(Database_copy(db, CHARACTERS, id, &copy) == MORK_OK, "Missing a character written by a thread.");
+            mu_assert(copy.health_and_mana == 2, "Missing an update written by a thread.");
+            Database_deleteCharacter(db, id);
+        }
+    }
+
+    struct CharacterRecord missing;
+    mu_assert(Database_copy(db, CHARACTERS, 9999, &missing) == MORK_ERROR_DB_NOT_FOUND, "Copied a record that does not exist.");
+    mu_assert(Database_copyByName(db, LOCATIONS, "Square", &square) == MORK_OK && square.id == 30, "Failed to copy square by name.");
+
+    Database_deleteLocation(db, 30);
+    return NULL;
+}
+
+char *test_hot_columns()
+{
+    struct LocationTable *locations = LocationTable_create();
+    mu_assert(locations != NULL, "Failed to create location table.");
+    struct LocationRecord cellar = { .id = 8, .name = "Cellar", .descriptionID = 2 };
+    cellar.exitIDs[4] = 9;
+    mu_assert(LocationTable_add(locations, &cellar) == MORK_OK, "Failed to add cellar.");
+
+    // The hot rows line up with the rows, so a row's index finds both
+    const struct LocationHot *places = LocationTable_hotRows(locations);
+    mu_assert(places != NULL, "Failed to get hot rows.");
+    struct LocationRecord *row = LocationTable_get(locations, 8);
+    const struct LocationHot *place = &places[row - locations->locations];
+    mu_assert(place->set == 1 && place->id == 8 && place->descriptionID == 2 && place->exitIDs[4] == 9, "Hot location mismatch.");
+
+    cellar.exitIDs[4] = 10;
+    mu_assert(LocationTable_update(locations, &cellar) == MORK_OK, "Failed to update cellar.");
+    mu_assert(place->exitIDs[4] == 10, "Update did not reach the hot row.");
+    mu_assert(LocationTable_remove(locations, 8) == MORK_OK, "Failed to remove cellar.");
+    mu_assert(place->set == 0, "Remove did not reach the hot row.");
+
+    // Rows changed behind the table's back are picked up after an invalidate
+    row->set = 1;
+    row->descriptionID = 7;
+    TableMeta_invalidate(&locations->meta);
+    places = LocationTable_hotRows(locations);
+    mu_assert(places[row - locations->locations].descriptionID == 7, "Rebuilt hot rows missed a row.");
+    LocationTable_destroy(locations);
+
+    return NULL;
+}
+
+char *test_occupancy_scan()
+{
+    struct ItemTable *table = ItemTable_create();
+    mu_assert(table != NULL, "Failed to create item table.");
+
+    // Rows placed by hand, on word and vector boundaries, then picked up by a rebuild
+    unsigned int rows[] = { 1, 15, 16, 63, 64, 1000, MAX_ROWS_ITEMS - 1 };
+    unsigned int count = sizeof(rows) / sizeof(rows[0]);
+    for (unsigned int r = 0; r < count; r++) {
+        table->rows[rows[r]].id = 100 + r;
+        table->rows[rows[r]].set = 1;
+    }
+    TableMeta_invalidate(&table->meta);
+
+    struct TableMeta *meta = &table->meta;
+    mu_assert(TableMeta_liveCount(meta) == count, "Wrong live row count.");
+    unsigned int seen = 0;
+    for (int i = TableMeta_nextLive(meta, 0); i >= 0; i = TableMeta_nextLive(meta, i + 1)) {
+        mu_assert(seen < count && (unsigned int)i == rows[seen], "Live rows out of order.");
+        seen++;
+    }
+    mu_assert(seen == count, "Missed a live row.");
+
+    // Without the primary key index, lookups scan the packed ids
+    for (unsigned int r = 0; r < count; r++) {
+        mu_assert(TableMeta_scanId(meta, 100 + r) == (int)rows[r], "Scan found the wrong row.");
+        mu_assert(ItemTable_get(table, 100 + r) == &table->rows[rows[r]], "Lookup found the wrong row.");
+    }
+    mu_assert(meta->indexed == 0, "A lookup built the primary key index.");
+    mu_assert(TableMeta_scanId(meta, 99) == -1, "Scan found an id that is not there.");
+
+    mu_assert(ItemTable_delete(table, 104) == MORK_OK, "Failed to delete item.");
+    mu_assert(TableMeta_liveCount(meta) == count - 1, "Delete did not reach the bitmap.");
+    mu_assert(TableMeta_scanId(meta, 104) == -1, "Scan found a deleted row.");
+    mu_assert(TableMeta_nextLive(meta, 64) == 1000, "Deleted row is still live.");
+
+    // Inserts fill the lowest empty row, found from the bitmap
+    struct ItemRecord item = { .id = 200, .name = "Filler" };
+    mu_assert(ItemTable_newRow(table, &item) == MORK_OK, "Failed to add item.");
+    mu_assert(TableMeta_scanId(meta, 200) == 2, "Insert did not take the lowest empty row.");
+
+    ItemTable_destroy(table);
+    return NULL;
+}
+
+char *test_full_table()
+{
+    struct CharacterTable *table = CharacterTable_create();
+    mu_assert(table != NULL, "Failed to create character table.");
+
+    // Row 0 is never handed out, so a table holds one less than its size
+    struct CharacterRecord character = { .name = "Filler" };
+    for (int i = 1; i < MAX_ROWS_CS; i++) {
+        character.id = i;
+        mu_assert(CharacterTable_newRow(table, &character) == MORK_OK, "Failed to fill character table.");
+    }
+
+    character.id = MAX_ROWS_CS;
+    mu_assert(CharacterTable_newRow(table, &character) == MORK_ERROR_DB_TABLE_FULL, "Full table should refuse inserts.");
+    mu_assert(CharacterTable_get(table, 1) != NULL, "Full table evicted a live row.");
+
+    // A freed row is reused by the next insert
+    mu_assert(CharacterTable_delete(table, 7) == MORK_OK, "Failed to delete character.");
+    mu_assert(CharacterTable_newRow(table, &character) == MORK_OK, "Failed to reuse freed row.");
+    mu_assert(CharacterTable_get(table, MAX_ROWS_CS) == &table->rows[7], "Insert did not reuse the freed row.");
+
+    CharacterTable_destroy(table);
+    return NULL;
+}
+
+char *test_lazy_tables()
+{
+    struct Database *lazy = Database_create();
+    mu_assert(lazy != NULL, "Failed to create database.");
+    for (enum Table tbl = 0; tbl < MAX_TABLES; tbl++) {
+        mu_assert(lazy->tables[tbl] == NULL, "Tables should not be allocated up front.");
+    }
+
+    struct CharacterRecord character = { .id = 1, .name = "Lazy Character" };
+    mu_assert(Database_createCharacter(lazy, &character) == MORK_OK, "Failed to create character.");
+    mu_assert(lazy->tables[CHARACTERS] != NULL, "Character table was not created on use.");
+    mu_assert(lazy->tables[DIALOG] == NULL, "Touching characters created the dialog table.");
+
+    // A fresh table builds its indexes without reading its rows
+    struct TableMeta *meta = lazy->tables[CHARACTERS];
+    mu_assert(meta->zeroed == 1 && meta->indexed == 1 && meta->free_built == 1, "Fresh table should be indexed on first change.");
+    mu_assert(Database_getCharacterByName(lazy, "Lazy Character") != NULL, "Failed to retrieve character by name.");
+
+    Database_destroy(lazy);
+    return NULL;
+}
+
 char *test_destroy_and_reopen()
 {
     db = Database_create();
@@ -328,6 +827,424 @@ char *test_destroy_and_reopen()
     return NULL;
 }
 
+char *test_compact_roundtrip()
+{
+    remove(test_db);
+    db = Database_create();
+    Database_createFile(db, test_db);
+    enum MorkResult result = Database_open(db, test_db);
+    mu_assert(result == MORK_OK, "Failed to open database.");
+    mu_assert(db->format == DB_FORMAT_COMPACT, "New files should be compact.");
+
+    struct LocationRecord location = { .id = 5, .name = "Compact Cave", .descriptionID = 12, .exitIDs = { 0, 6, 0, 7 } };
+    result = Database_createLocation(db, &location);
+    mu_assert(result == MORK_OK, "Failed to create location.");
+    struct DescriptionRecord description = { .id = 12, .description = "A small cave.", .next_id = 0 };
+    result = Database_createDescription(db, &description);
+    mu_assert(result == MORK_OK, "Failed to create description.");
+    unsigned int next_index = Database_getNextIndex(db, ITEMS);
+
+    result = Database_flush(db);
+    mu_assert(result == MORK_OK, "Failed to flush database.");
+    fseek(db->file, 0, SEEK_END);
+    mu_assert(ftell(db->file) < 1024, "Compact file should only hold live rows.");
+
+    Database_close(db);
+    Database_destroy(db);
+
+    db = Database_create();
+    result = Database_open(db, test_db);
+    mu_assert(result == MORK_OK, "Failed to reopen database.");
+
+    struct LocationRecord *retrieved = Database_getLocation(db, 5);
+    mu_assert(retrieved != NULL, "Failed to retrieve location after reopening.");
+    mu_assert(strcmp(retrieved->name, "Compact Cave") == 0, "Location name mismatch.");
+    mu_assert(retrieved->descriptionID == 12, "Location description mismatch.");
+    mu_assert(retrieved->exitIDs[1] == 6 && retrieved->exitIDs[3] == 7 && retrieved->exitIDs[5] == 0, "Location exits mismatch.");
+    struct DescriptionRecord *text = Database_getDescription(db, 12);
+    mu_assert(text != NULL && strcmp(text->description, "A small cave.") == 0, "Description mismatch.");
+    mu_assert(Database_getNextIndex(db, ITEMS) == next_index + 1, "Index counters were not kept.");
+
+    Database_close(db);
+    Database_destroy(db);
+    remove(test_db);
+
+    return NULL;
+}
+
+static long file_size(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) { return -1; }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+char *test_mapped_reopen()
+{
+    // Mapping needs the fixed layout, so start from a fresh file
+    remove(test_db);
+    db = Database_create();
+    enum MorkResult result = Database_openMapped(db, test_db);
+    mu_assert(result == MORK_OK, "Failed to map database.");
+    mu_assert(db->map != NULL, "Expected a mapping.");
+
+    struct CharacterRecord character = { .id = 3, .name = "Mapped Character" };
+    result = Database_createCharacter(db, &character);
+    mu_assert(result == MORK_OK, "Failed to create character.");
+
+    struct TableMeta *meta = Database_get(db, CHARACTERS);
+    mu_assert(meta->borrowed == 1, "Mapped table should not own its rows.");
+    result = Database_flush(db);
+    mu_assert(result == MORK_OK, "Failed to flush mapped database.");
+    mu_assert(meta->dirty_count == 0, "Flush left dirty pages behind.");
+
+    Database_close(db);
+    mu_assert(db->map == NULL, "Failed to unmap database.");
+    Database_destroy(db);
+
+    // The mapped writes should be visible to a plain open
+    db = Database_create();
+    result = Database_open(db, test_db);
+    mu_assert(result == MORK_OK, "Failed to reopen database.");
+
+    struct CharacterRecord *retrieved = Database_getCharacter(db, 3);
+    mu_assert(retrieved != NULL, "Failed to retrieve mapped character.");
+    mu_assert(strcmp(retrieved->name, "Mapped Character") == 0, "Character name mismatch after reopening.");
+    mu_assert(db->format == DB_FORMAT_FIXED, "A mapped file should stay in the fixed layout.");
+
+    // Written back in place by the I/O engine
+    struct CharacterRecord renamed = { .id = 3, .name = "Renamed Character" };
+    result = Database_updateCharacter(db, &renamed);
+    mu_assert(result == MORK_OK, "Failed to update character.");
+    Database_close(db);
+    result = Database_open(db, test_db);
+    mu_assert(result == MORK_OK, "Failed to reopen database.");
+    retrieved = Database_getCharacter(db, 3);
+    mu_assert(retrieved != NULL && strcmp(retrieved->name, "Renamed Character") == 0, "Fixed file lost the update.");
+    Database_close(db);
+
+    // A file written when a row was smaller has its tables at other offsets,
+    // so it is refused rather than read, or grown, as this layout
+    long size = file_size(test_db);
+    mu_assert(truncate(test_db, size - 2) == 0, "Failed to shrink file.");
+    result = Database_openMapped(db, test_db);
+    mu_assert(result == MORK_ERROR_DB_INVALID_DATA, "Mapped a file with other row sizes.");
+    mu_assert(file_size(test_db) == size - 2, "Refused file was resized.");
+    result = Database_open(db, test_db);
+    mu_assert(result == MORK_ERROR_DB_INVALID_DATA, "Opened a file with other row sizes.");
+
+    Database_destroy(db);
+    mu_assert(file_size(test_db) == size - 2, "Refused file was written to.");
+    remove(test_db);
+
+    return NULL;
+}
+
+char *test_wal_replay()
+{
+    remove(test_db);
+    db = Database_create();
+    enum MorkResult result = Database_createFile(db, test_db);
+    mu_assert(result == MORK_OK, "Failed to create database file.");
+    result = Database_open(db, test_db);
+    mu_assert(result == MORK_OK, "Failed to open database.");
+
+    struct CharacterRecord character = { .id = 4, .name = "Logged Character" };
+    result = Database_createCharacter(db, &character);
+    mu_assert(result == MORK_OK, "Failed to create character.");
+    result = Database_commit(db);
+    mu_assert(result == MORK_OK, "Failed to commit.");
+    mu_assert(db->wal->size > 0, "Commit should have appended to the log.");
+
+    // Committing sealed batches leaves what came after the seal, such as
+    // another session's half-done turn, for a later commit
+    struct CharacterRecord sealed = { .id = 6, .name = "Sealed Character" };
+    Database_createCharacter(db, &sealed);
+    result = Database_seal(db);
+    mu_assert(result == MORK_OK, "Failed to seal.");
+
+    // Changes that were never committed must not survive a crash
+    struct CharacterRecord uncommitted = { .id = 5, .name = "Lost Character" };
+    Database_createCharacter(db, &uncommitted);
+    result = Database_commitSealed(db);
+    mu_assert(result == MORK_OK, "Failed to commit sealed changes.");
+
+    // A torn batch at the end of the log is ignored
+    char *wal_path = Wal_pathFor(test_db);
+    mu_assert(Wal_syncDir(wal_path) == MORK_OK, "Failed to sync the log's directory.");
+    mu_assert(Wal_syncDir("no/such/dir/db-wal") != MORK_OK, "Synced a directory that does not exist.");
+    FILE *wal_file = fopen(wal_path, "a");
+    mu_assert(wal_file != NULL, "Failed to open log.");
+    fputs("torn", wal_file);
+    fclose(wal_file);
+
+    // Opening the file as it is now, without the first database ever
+    // flushing, stands in for a crash after the commit
+    struct Database *recovered = Database_create();
+    result = Database_open(recovered, test_db);
+    mu_assert(result == MORK_OK, "Failed to open database with a log.");
+
+    struct CharacterRecord *retrieved = Database_getCharacter(recovered, 4);
+    mu_assert(retrieved != NULL, "Committed character was not replayed.");
+    mu_assert(strcmp(retrieved->name, "Logged Character") == 0, "Character name mismatch after replay.");
+    mu_assert(Database_getCharacter(recovered, 6) != NULL, "Sealed character was not replayed.");
+    mu_assert(Database_getCharacter(recovered, 5) == NULL, "Uncommitted character was replayed.");
+    mu_assert(Database_getNextIndex(recovered, CHARACTERS) > 4, "Replayed ids should not be handed out again.");
+
+    // Closing checkpoints into the file and drops the log
+    Database_destroy(recovered);
+    wal_file = fopen(wal_path, "r");
+    mu_assert(wal_file == NULL, "Log should be removed on close.");
+    free(wal_path);
+
+    recovered = Database_create();
+    result = Database_open(recovered, test_db);
+    mu_assert(result == MORK_OK, "Failed to reopen checkpointed database.");
+    mu_assert(Database_getCharacter(recovered, 4) != NULL, "Checkpoint lost the committed character.");
+    Database_destroy(recovered);
+
+    Database_destroy(db);
+    remove(test_db);
+
+    return NULL;
+}
+
+struct FlushNote {
+    int calls;
+    enum MorkResult result;
+};
+
+static void note_flush(void *ctx, enum MorkResult result)
+{
+    struct FlushNote *note = ctx;
+    note->calls++;
+    note->result = result;
+}
+
+static int copy_file(const char *from, const char *to)
+{
+    FILE *in = fopen(from, "rb");
+    FILE *out = fopen(to, "wb");
+    int res = in != NULL && out != NULL ? 0 : -1;
+    char buf[4096];
+    size_t n = 0;
+    while (res == 0 && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (fwrite(buf, 1, n, out) != n) { res = -1; }
+    }
+    if (in) { fclose(in); }
+    if (out) { fclose(out); }
+    return res;
+}
+
+char *test_async_flush()
+{
+    remove(test_db);
+    db = Database_create();
+    enum MorkResult result = Database_createFile(db, test_db);
+    mu_assert(result == MORK_OK, "Failed to create database file.");
+    result = Database_open(db, test_db);
+    mu_assert(result == MORK_OK, "Failed to open database.");
+
+    for (int id = 1; id <= 3; id++) {
+        struct CharacterRecord character = { .id = id, .name = "Flushed Character" };
+        result = Database_createCharacter(db, &character);
+        mu_assert(result == MORK_OK, "Failed to create character.");
+    }
+    Database_deleteCharacter(db, 1);
+    result = Database_commit(db);
+    mu_assert(result == MORK_OK, "Failed to commit.");
+
+    struct FlushNote note = { 0, MORK_ERROR_DB };
+    struct FlushHandle *handle = Database_flushAsync(db, note_flush, &note);
+    mu_assert(handle != NULL, "Failed to start a flush.");
+    // The rows were copied when the flush started; encoding them later must
+    // not pick up a change made since
+    struct CharacterRecord changed = { .id = 2, .name = "Changed Character" };
+    result = Database_updateCharacter(db, &changed);
+    mu_assert(result == MORK_OK, "Failed to update character.");
+    result = FlushHandle_wait(handle);
+    mu_assert(result == MORK_OK, "Background flush failed.");
+    mu_assert(FlushHandle_isDone(handle), "Flush should be done once waited for.");
+    mu_assert(note.calls == 1 && note.result == MORK_OK, "Callback should run once with the result.");
+    FlushHandle_release(handle);
+    mu_assert(db->wal->size == 0, "Flush should drop the log it covers.");
+
+    // Opened from a copy, since closing a second database on the file itself
+    // would checkpoint it and take the log away from the first
+    const char *copy_path = "tests/db_tests_copy.db";
+    mu_assert(copy_file(test_db, copy_path) == 0, "Failed to copy flushed file.");
+    struct Database *flushed = Database_create();
+    result = Database_open(flushed, copy_path);
+    mu_assert(result == MORK_OK, "Failed to open flushed database.");
+    struct CharacterRecord *unchanged = Database_getCharacter(flushed, 2);
+    mu_assert(unchanged != NULL && strcmp(unchanged->name, "Flushed Character") == 0,
+              "Flush wrote a change made after its snapshot.");
+    Database_destroy(flushed);
+    remove(copy_path);
+
+    // Committed after the checkpoint, so only the log has it. The file packs
+    // its rows on load, so this row comes back at a different index.
+    struct CharacterRecord renamed = { .id = 3, .name = "Renamed Character" };
+    result = Database_updateCharacter(db, &renamed);
+    mu_assert(result == MORK_OK, "Failed to update character.");
+    result = Database_commit(db);
+    mu_assert(result == MORK_OK, "Failed to commit.");
+
+    struct Database *recovered = Database_create();
+    result = Database_open(recovered, test_db);
+    mu_assert(result == MORK_OK, "Failed to open database with a log.");
+    struct CharacterRecord *retrieved = Database_getCharacter(recovered, 3);
+    mu_assert(retrieved != NULL, "Committed character was not replayed.");
+    mu_assert(strcmp(retrieved->name, "Renamed Character") == 0, "Replay should update the row with the same id.");
+    mu_assert(TableMeta_liveCount(Database_get(recovered, CHARACTERS)) == 2, "Replay should not duplicate a row.");
+    Database_destroy(recovered);
+
+    // A flush nobody waits for is still finished by close
+    struct CharacterRecord late = { .id = 4, .name = "Late Character" };
+    Database_createCharacter(db, &late);
+    FlushHandle_release(Database_flushAsync(db, NULL, NULL));
+    result = Database_close(db);
+    mu_assert(result == MORK_OK, "Failed to close database.");
+
+    result = Database_open(db, test_db);
+    mu_assert(result == MORK_OK, "Failed to reopen database.");
+    retrieved = Database_getCharacter(db, 4);
+    mu_assert(retrieved != NULL && strcmp(retrieved->name, "Late Character") == 0, "Close should wait for the flush.");
+    mu_assert(Database_getCharacter(db, 1) == NULL, "Deleted character came back.");
+
+    Database_destroy(db);
+    remove(test_db);
+
+    return NULL;
+}
+
+char *test_io_engine()
+{
+    enum IoBackend backends[] = { IO_BACKEND_SYNC, IO_BACKEND_URING };
+
+    for (int b = 0; b < 2; b++) {
+        struct IoEngine *engine = IoEngine_create(backends[b]);
+        mu_assert(engine != NULL, "Failed to create I/O engine.");
+
+        remove(test_db);
+        int fd = open(test_db, O_RDWR | O_CREAT, 0644);
+        mu_assert(fd >= 0, "Failed to open test file.");
+
+        // More requests than the ring holds at once, written out of order
+        static unsigned char out[100][IO_ALIGN];
+        static unsigned char in[100][IO_ALIGN];
+        for (int i = 99; i >= 0; i--) {
+            memset(out[i], i + 1, IO_ALIGN);
+            mu_assert(IoEngine_write(engine, out[i], IO_ALIGN, (off_t)i * IO_ALIGN) == MORK_OK, "Failed to queue write.");
+        }
+        mu_assert(IoEngine_submit(engine, fd) == MORK_OK, "Failed to write batch.");
+        mu_assert(engine->count == 0, "Submit should empty the queue.");
+
+        for (int i = 0; i < 100; i++) {
+            IoEngine_read(engine, in[i], IO_ALIGN, (off_t)i * IO_ALIGN);
+        }
+        mu_assert(IoEngine_submit(engine, fd) == MORK_OK, "Failed to read batch.");
+        mu_assert(memcmp(in, out, sizeof(out)) == 0, "Read back different bytes than were written.");
+
+        // Tables have fixed sizes, so reading past the end is an error
+        IoEngine_read(engine, in[0], IO_ALIGN, 100 * IO_ALIGN);
+        mu_assert(IoEngine_submit(engine, fd) != MORK_OK, "Reading past the end should fail.");
+
+        close(fd);
+        IoEngine_destroy(engine);
+    }
+    remove(test_db);
+
+    return NULL;
+}
+
+char *test_lz_codec()
+{
+    static unsigned char raw[8192];
+    static unsigned char packed[8192 + 8192 / 255 + 16];
+    static unsigned char out[8192];
+    size_t packed_len = 0;
+
+    // Prose repeats itself a lot
+    size_t len = 0;
+    while (len + 64 < sizeof(raw)) {
+        len += snprintf((char *)raw + len, sizeof(raw) - len, "You are in a maze of twisty little passages, %zu. ", len % 7);
+    }
+    mu_assert(Lz_compress(raw, len, packed, Lz_bound(len), &packed_len) == MORK_OK, "Failed to compress prose.");
+    mu_assert(packed_len * 5 < len, "Repetitive prose should compress well.");
+    mu_assert(Lz_decompress(packed, packed_len, out, len) == MORK_OK, "Failed to decompress prose.");
+    mu_assert(memcmp(raw, out, len) == 0, "Prose did not survive the round trip.");
+
+    // Noise does not compress, but must still fit in the bound
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < sizeof(raw); i++) {
+        seed = seed * 1103515245u + 12345u;
+        raw[i] = (unsigned char)(seed >> 16);
+    }
+    mu_assert(Lz_compress(raw, sizeof(raw), packed, Lz_bound(sizeof(raw)), &packed_len) == MORK_OK, "Failed to compress noise.");
+    mu_assert(Lz_decompress(packed, packed_len, out, sizeof(raw)) == MORK_OK, "Failed to decompress noise.");
+    mu_assert(memcmp(raw, out, sizeof(raw)) == 0, "Noise did not survive the round trip.");
+
+    mu_assert(Lz_compress(raw, 0, packed, Lz_bound(0), &packed_len) == MORK_OK, "Failed to compress nothing.");
+    mu_assert(Lz_decompress(packed, packed_len, out, 0) == MORK_OK, "Failed to decompress nothing.");
+
+    // A truncated block, or one that claims the wrong size, is caught
+    memset(raw, 'z', 1000);
+    Lz_compress(raw, 1000, packed, Lz_bound(1000), &packed_len);
+    mu_assert(Lz_decompress(packed, packed_len - 1, out, 1000) != MORK_OK, "Truncated block should fail.");
+    mu_assert(Lz_decompress(packed, packed_len, out, 999) != MORK_OK, "Block longer than expected should fail.");
+
+    return NULL;
+}
+
+char *test_text_compression()
+{
+    remove(test_db);
+    db = Database_create();
+    enum MorkResult result = Database_createFile(db, test_db);
+    mu_assert(result == MORK_OK, "Failed to create database file.");
+    result = Database_open(db, test_db);
+    mu_assert(result == MORK_OK, "Failed to open database.");
+
+    // More rows than one block holds
+    for (int id = 1; id <= 200; id++) {
+        struct DescriptionRecord description = { .id = id };
+        snprintf(description.description, MAX_DESCRIPTION,
+                 "Room %d. You are standing in a dim stone hall. Cold water drips from the ceiling and a "
+                 "narrow passage leads off into the dark. There is a lamp here.", id);
+        mu_assert(Database_createDescription(db, &description) == MORK_OK, "Failed to create description.");
+    }
+    struct DialogRecord dialog = { .id = 1, .text = "Hello, sailor.", .next_id = 0 };
+    mu_assert(Database_createDialog(db, &dialog) == MORK_OK, "Failed to create dialog.");
+
+    db->compress_text = 0;
+    mu_assert(Database_write(db, DESCRIPTION) == MORK_OK, "Failed to write uncompressed file.");
+    long plain = file_size(test_db);
+    db->compress_text = 1;
+    mu_assert(Database_write(db, DESCRIPTION) == MORK_OK, "Failed to write compressed file.");
+    long packed = file_size(test_db);
+    mu_assert(packed > 0 && packed * 3 < plain, "Text tables should be much smaller compressed.");
+    Database_destroy(db);
+
+    db = Database_create();
+    result = Database_open(db, test_db);
+    mu_assert(result == MORK_OK, "Failed to reopen compressed database.");
+    struct DescriptionRecord *retrieved = Database_getDescription(db, 137);
+    mu_assert(retrieved != NULL, "Failed to retrieve description.");
+    mu_assert(strncmp(retrieved->description, "Room 137. You are standing", 26) == 0, "Description mismatch after reopening.");
+    mu_assert(TableMeta_liveCount(Database_get(db, DESCRIPTION)) == 200, "Lost descriptions in the blocks.");
+    struct DialogRecord *line = Database_getDialog(db, 1);
+    mu_assert(line != NULL && strcmp(line->text, "Hello, sailor.") == 0, "Dialog mismatch after reopening.");
+
+    Database_destroy(db);
+    remove(test_db);
+
+    return NULL;
+}
+
 char *all_tests()
 {
     mu_suite_start();
@@ -353,11 +1270,31 @@ char *all_tests()
     mu_run_test(test_create_inventory);
     mu_run_test(test_update_inventory);
     mu_run_test(test_delete_inventory);
+    mu_run_test(test_primary_key_index);
+    mu_run_test(test_name_index);
+    mu_run_test(test_owner_index);
+    mu_run_test(test_inventory_packed_items);
+    mu_run_test(test_description_prefix_index);
+    mu_run_test(test_description_interning);
+    mu_run_test(test_room_graph);
+    mu_run_test(test_concurrent_access);
+    mu_run_test(test_hot_columns);
+    mu_run_test(test_occupancy_scan);
+    mu_run_test(test_full_table);
+    mu_run_test(test_lazy_tables);
     mu_run_test(test_flush);
+    mu_run_test(test_flush_dirty_only);
     mu_run_test(test_close);
     mu_run_test(test_destroy);
     mu_run_test(test_delete_db_file);
     mu_run_test(test_destroy_and_reopen);
+    mu_run_test(test_compact_roundtrip);
+    mu_run_test(test_mapped_reopen);
+    mu_run_test(test_wal_replay);
+    mu_run_test(test_async_flush);
+    mu_run_test(test_io_engine);
+    mu_run_test(test_lz_codec);
+    mu_run_test(test_text_compression);
 
     return NULL;
 }
@@ -10,6 +10,7 @@
 #include "../src/models/item.h"
 #include "../src/models/location.h"
 
+#include <pthread.h>
 #include <stdio.h>
 
 static struct tagbstring north_target = bsStatic("north");
@@ -289,6 +290,83 @@ char *test_create_multiple_different_locations()
     return NULL;
 }
 
+char *test_location_identity_map()
+{
+    // Loading the same room twice hands back the same object
+    struct Location *first = Location_loadByName(db, "Mork's Garden");
+    struct Location *second = Location_loadByName(db, "Mork's Garden");
+    mu_assert(first != NULL && first == second, "Expected the cached location.");
+
+    // Releasing one holder leaves the other's copy intact
+    Location_destroy(second);
+    mu_assert(strcmp(first->name, "Mork's Garden") == 0, "Location was freed while still held.");
+
+    // Saving drops the cached model, so the next load sees the new record
+    Location_setDescription(first, "The overgrown garden of Mork.");
+    mu_assert(Location_save(db, first) == MORK_OK, "Failed to save location.");
+    second = Location_loadByName(db, "Mork's Garden");
+    mu_assert(second != NULL && second != first, "Save did not invalidate the cached location.");
+    mu_assert(strcmp(second->description, "The overgrown garden of Mork.") == 0, "Reloaded a stale description.");
+
+    Location_destroy(first);
+    Location_destroy(second);
+
+    return NULL;
+}
+
+#define SHARED_MODEL_THREADS 4
+#define SHARED_MODEL_ROUNDS 200
+
+struct SharedModelWork {
+    int id;
+    int failures;
+};
+
+static void *load_shared_item(void *arg)
+{
+    struct SharedModelWork *work = arg;
+    for (int i = 0; i < SHARED_MODEL_ROUNDS; i++) {
+        struct Item *item = Item_load(db, work->id);
+        if (item == NULL || strcmp(item->name, "Mork's Egg") != 0) { work->failures++; }
+        Item_destroy(item);
+    }
+    return NULL;
+}
+
+static void *save_shared_item(void *arg)
+{
+    struct SharedModelWork *work = arg;
+    for (int i = 0; i < SHARED_MODEL_ROUNDS; i++) {
+        struct Item *item = Item_load(db, work->id);
+        // Saving evicts the cached item while the loaders hold it
+        if (item == NULL || Item_save(db, item) != work->id) { work->failures++; }
+        Item_destroy(item);
+    }
+    return NULL;
+}
+
+char *test_shared_models_across_threads()
+{
+    struct Item *egg = Item_create("Mork's Egg", "The egg Mork hatched from.");
+    int id = Item_save(db, egg);
+    Item_destroy(egg);
+    mu_assert(id > 0, "Failed to save item.");
+
+    pthread_t threads[SHARED_MODEL_THREADS];
+    struct SharedModelWork work[SHARED_MODEL_THREADS];
+    for (int i = 0; i < SHARED_MODEL_THREADS; i++) {
+        work[i] = (struct SharedModelWork){ .id = id, .failures = 0 };
+        void *(*run)(void *) = i == 0 ? save_shared_item : load_shared_item;
+        mu_assert(pthread_create(&threads[i], NULL, run, &work[i]) == 0, "Failed to start thread.");
+    }
+    for (int i = 0; i < SHARED_MODEL_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        mu_assert(work[i].failures == 0, "A thread lost or tore a shared item.");
+    }
+
+    return NULL;
+}
+
 char *test_add_item_to_location()
 {
     struct Location *location = Location_loadByName(db, "Mork's House");
@@ -515,6 +593,178 @@ char *test_parse_actions()
     return NULL;
 }
 
+char *test_reuse_parser()
+{
+    ActionParser parser;
+    mu_assert(ActionParser_init(&parser, NULL) == MORK_OK, "Failed to initialize parser.");
+    mu_assert(parser.verbs == ActionParser_vocabulary(), "Parser should use the shared vocabulary.");
+
+    const char *inputs[] = { "look north", "move down", "inventory", "look self" };
+    enum ActionKind kinds[] = { ACTION_LOOK, ACTION_MOVE, ACTION_INVENTORY, ACTION_LOOK };
+    enum ActionTargetKind targets[] = { TARGET_NORTH, TARGET_DOWN, TARGET_NONE, TARGET_SELF };
+
+    for (int i = 0; i < 4; i++) {
+        struct Action *action = Action_create(inputs[i]);
+        mu_assert(Action_parseWith(action, &parser) == MORK_OK, "Failed to parse action with a reused parser.");
+        mu_assert(action->kind == kinds[i], "Failed to parse action kind.");
+        mu_assert(action->target_kind == targets[i], "Failed to parse target kind.");
+        Action_destroy(action);
+    }
+
+    // Resetting drops the tokens but not the vocabulary
+    ActionParser_reset(&parser);
+    mu_assert(ActionParser_isLoaded(&parser) == 0, "Reset parser still holds input.");
+    mu_assert(Hashmap_get(parser.verbs, &north_target) == NULL, "Directions are not verbs.");
+
+    struct Action *action = Action_create("look up");
+    mu_assert(Action_parseWith(action, &parser) == MORK_OK, "Failed to parse after reset.");
+    mu_assert(action->target_kind == TARGET_UP, "Failed to parse target kind after reset.");
+    Action_destroy(action);
+
+    ActionParser_reset(&parser);
+    return NULL;
+}
+
+char *test_builtin_vocabulary()
+{
+    mu_assert(ActionParser_builtinVerb("move", 4) == ACTION_MOVE, "Failed to classify move.");
+    mu_assert(ActionParser_builtinVerb("quit", 4) == ACTION_QUIT, "Failed to classify quit.");
+    mu_assert(ActionParser_builtinVerb("inventory", 9) == ACTION_INVENTORY, "Failed to classify inventory.");
+    mu_assert(ActionParser_builtinVerb("mope", 4) == ACTION_NONE, "Classified a word that is not a verb.");
+    mu_assert(ActionParser_builtinVerb("look", 3) == ACTION_NONE, "Classified a truncated verb.");
+
+    mu_assert(ActionParser_builtinNoun(ACTION_MOVE, "north", 5) == TARGET_NORTH, "Failed to classify north.");
+    mu_assert(ActionParser_builtinNoun(ACTION_LOOK, "up", 2) == TARGET_UP, "Failed to classify up.");
+    mu_assert(ActionParser_builtinNoun(ACTION_LOOK, "self", 4) == TARGET_SELF, "Failed to classify self.");
+    mu_assert(ActionParser_builtinNoun(ACTION_MOVE, "room", 4) == TARGET_NONE, "You can't move into the room.");
+    mu_assert(ActionParser_builtinNoun(ACTION_TAKE, "north", 5) == TARGET_NONE, "You can't take a direction.");
+
+    // Anything else falls back to the shared map
+    static struct tagbstring go = bsStatic("go");
+    ActionVerbEntry *entry = ActionVerbEntry_create(ACTION_MOVE);
+    Hashmap_set(ActionParser_vocabulary(), &go, entry);
+
+    struct Action *action = Action_create("go west");
+    mu_assert(Action_parse(action, NULL) == MORK_OK, "Failed to parse a verb from the map.");
+    mu_assert(action->kind == ACTION_MOVE && action->target_kind == TARGET_WEST, "Verb from the map parsed wrong.");
+    Action_destroy(action);
+
+    Hashmap_delete(ActionParser_vocabulary(), &go);
+    ActionVerbEntry_destroy(entry);
+    return NULL;
+}
+
+static int danced = 0;
+
+static struct TerminalSegment *dance(struct Database *db, struct BaseGame *game, struct Action *action)
+{
+    (void)db;
+    (void)game;
+    (void)action;
+    danced++;
+    return TS_concatText(TS_new(), "You dance.");
+}
+
+char *test_register_verb()
+{
+    struct Character *player = Character_create(
+        "Mork",
+        1,                                            // Level
+        (unsigned char[6]){5, 5, 5, 5, 5, 10},        // Stats in enum order
+        6                                             // Number of stats
+    );
+
+    struct BaseGame *game = BaseGame_create(player);
+    mu_assert(game != NULL, "Failed to create game.");
+    BaseGame_setLocation(game, Location_loadByName(db, "Mork's House"));
+
+    mu_assert(BaseGame_registerVerb(game, "peer", ACTION_LOOK) == MORK_OK, "Failed to register a synonym.");
+    mu_assert(BaseGame_registerVerb(game, "look", ACTION_MOVE) != MORK_OK, "Built-in verbs can't be redefined.");
+    mu_assert(BaseGame_registerVerb(game, "boogie", ACTION_CUSTOM) != MORK_OK, "Registered a verb for an unknown action.");
+
+    enum ActionKind kind = BaseGame_registerAction(game, dance);
+    mu_assert(kind == ACTION_CUSTOM, "Expected the first custom action kind.");
+    mu_assert(BaseGame_registerVerb(game, "dance", kind) == MORK_OK, "Failed to register a custom verb.");
+
+    ActionParser parser;
+    mu_assert(BaseGame_initParser(db, game, &parser) == MORK_OK, "Failed to set up parser.");
+
+    struct Action *action = Action_create("peer north");
+    mu_assert(Action_parseWith(action, &parser) == MORK_OK, "Failed to parse a synonym.");
+    mu_assert(action->kind == ACTION_LOOK && action->target_kind == TARGET_NORTH, "Synonym parsed wrong.");
+    Action_destroy(action);
+
+    action = Action_create("dance");
+    mu_assert(Action_parseWith(action, &parser) == MORK_OK, "Failed to parse a custom verb.");
+    mu_assert(action->kind == kind, "Custom verb parsed wrong.");
+    struct TerminalSegment *frame = BaseGame_execute(db, game, action);
+    mu_assert(frame != NULL && danced == 1, "Custom handler was not dispatched.");
+    TS_destroy(frame);
+    Action_destroy(action);
+
+    // The plain parser doesn't know this game's words
+    action = Action_create("dance");
+    mu_assert(Action_parse(action, NULL) != MORK_OK, "Game verb leaked into the shared vocabulary.");
+    Action_destroy(action);
+
+    ActionParser_reset(&parser);
+    BaseGame_destroy(game);
+    return NULL;
+}
+
+char *test_run_commands()
+{
+    struct Character *player = Character_create(
+        "Mork",
+        1,                                            // Level
+        (unsigned char[6]){5, 5, 5, 5, 5, 10},        // Stats in enum order
+        6                                             // Number of stats
+    );
+
+    struct BaseGame *game = BaseGame_create(player);
+    mu_assert(game != NULL, "Failed to create game.");
+    BaseGame_setLocation(game, Location_loadByName(db, "Mork's House"));
+
+    const char *commands[] = { "look self", "# a comment", "", "xyzzy", "quit", "help" };
+    char *out = NULL;
+    size_t out_len = 0;
+    FILE *transcript = open_memstream(&out, &out_len);
+    mu_assert(transcript != NULL, "Failed to open transcript.");
+
+    enum MorkResult res = BaseGame_runCommands(db, game, commands, 6, transcript);
+    fclose(transcript);
+    mu_assert(res == MORK_OK, "Failed to run commands.");
+    mu_assert(strstr(out, "> look self\nYou are in Mork's House\nYou are Mork.") != NULL, "Transcript is missing a command's output.");
+    mu_assert(strchr(out, '\033') == NULL, "Transcript has control codes in it.");
+    mu_assert(strstr(out, "> xyzzy\nI don't understand that.") != NULL, "Transcript is missing a bad command.");
+    mu_assert(strstr(out, "> help") == NULL, "Commands after quit were run.");
+    mu_assert(game->history[0] != NULL && game->history[0]->kind == ACTION_LOOK, "Command was not kept in history.");
+    free(out);
+
+    char script[] = "help\r\n\nlook self\n";
+    FILE *in = fmemopen(script, strlen(script), "r");
+    mu_assert(in != NULL, "Failed to open script.");
+    res = BaseGame_runScript(db, game, in, NULL);
+    fclose(in);
+    mu_assert(res == MORK_OK, "Failed to run script.");
+    mu_assert(game->history[1] != NULL && game->history[1]->kind == ACTION_HELP, "Script commands ran out of order.");
+
+    // Item commands get the item's name, not the parser's string object
+    const char *item_commands[] = { "take Mork's Egg", "drop Mork's Egg" };
+    out = NULL;
+    transcript = open_memstream(&out, &out_len);
+    mu_assert(transcript != NULL, "Failed to open transcript.");
+    res = BaseGame_runCommands(db, game, item_commands, 2, transcript);
+    fclose(transcript);
+    mu_assert(res == MORK_OK, "Failed to run item commands.");
+    mu_assert(strstr(out, "What are you trying to take?") != NULL, "Took an item that is not here.");
+    mu_assert(strstr(out, "I don't think you're holding one of those.") != NULL, "Dropped an item that is not held.");
+    free(out);
+
+    BaseGame_destroy(game);
+    return NULL;
+}
+
 char *test_execute_action()
 {
     struct Character *player = Character_create(
@@ -580,6 +830,8 @@ char *all_tests()
     mu_run_test(test_remove_item_from_inventory);
     mu_run_test(test_create_location);
     mu_run_test(test_create_multiple_different_locations);
+    mu_run_test(test_location_identity_map);
+    mu_run_test(test_shared_models_across_threads);
     mu_run_test(test_add_item_to_location);
     mu_run_test(test_remove_item_from_location);
     mu_run_test(test_update_item_in_location);
@@ -587,6 +839,10 @@ char *all_tests()
     mu_run_test(test_load_basegame);
     mu_run_test(test_create_action);
     mu_run_test(test_parse_actions);
+    mu_run_test(test_reuse_parser);
+    mu_run_test(test_builtin_vocabulary);
+    mu_run_test(test_register_verb);
+    mu_run_test(test_run_commands);
     mu_run_test(test_execute_action);
     mu_run_test(test_destroy_db);
     mu_run_test(test_destroy_db_file);
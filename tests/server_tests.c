@@ -0,0 +1,225 @@
+#include "minunit.h"
+
+#include "../src/coredb/db.h"
+#include "../src/models/game.h"
+#include "../src/models/location.h"
+#include "../src/server/server.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVER_TEST_PLAYERS 16
+#define SERVER_TEST_FLOOD_LINES 20000
+
+static const char *server_db = "tests/server_tests.db";
+static const char *server_socket = "tests/server_tests.sock";
+
+struct Database *db = NULL;
+struct Server *server = NULL;
+pthread_t server_thread;
+int clients[SERVER_TEST_PLAYERS];
+
+static void *run_server(void *arg)
+{
+    Server_run(arg);
+    return NULL;
+}
+
+static int connect_client()
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, server_socket, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) { return -1; }
+
+    struct timeval timeout = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Read from a client until the text shows up; 1 if it did
+static int expect(int fd, const char *text)
+{
+    char buf[4096];
+    size_t len = 0;
+    while (len < sizeof(buf) - 1) {
+        ssize_t n = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+        if (n <= 0) { return 0; }
+        len += (size_t)n;
+        buf[len] = '\0';
+        if (strstr(buf, text) != NULL) { return 1; }
+    }
+    return 0;
+}
+
+// Read from a client until the text has shown up count times; 1 if it did
+static int expect_count(int fd, const char *text, int count)
+{
+    char buf[4096];
+    size_t len = 0;
+    size_t text_len = strlen(text);
+    int seen = 0;
+    while (seen < count) {
+        ssize_t n = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+        if (n <= 0) { return 0; }
+        len += (size_t)n;
+        buf[len] = '\0';
+
+        char *at = buf;
+        char *found = NULL;
+        while ((found = strstr(at, text)) != NULL) {
+            seen++;
+            at = found + text_len;
+        }
+        // Keep a tail that may hold the start of the next match
+        size_t keep = strlen(at) < text_len ? strlen(at) : text_len - 1;
+        memmove(buf, buf + len - keep, keep);
+        len = keep;
+    }
+    return seen == count;
+}
+
+static int say(int fd, const char *text)
+{
+    return send(fd, text, strlen(text), MSG_NOSIGNAL) == (ssize_t)strlen(text);
+}
+
+char *test_start_server()
+{
+    db = Database_create();
+    mu_assert(db != NULL, "Failed to create database.");
+    mu_assert(Database_createFile(db, server_db) == MORK_OK, "Failed to create database file.");
+
+    struct Location *lobby = Location_create("Lobby", "A crowded lobby.");
+    mu_assert(Location_save(db, lobby) == MORK_OK, "Failed to save start location.");
+    Location_destroy(lobby);
+
+    server = Server_create(db, "Lobby", 4);
+    mu_assert(server != NULL, "Failed to create server.");
+    mu_assert(Server_listenUnix(server, server_socket) == MORK_OK, "Failed to listen.");
+    mu_assert(pthread_create(&server_thread, NULL, run_server, server) == 0, "Failed to start server thread.");
+
+    return NULL;
+}
+
+char *test_many_sessions()
+{
+    char line[64];
+
+    // Everyone connects before anyone plays, so the sessions are all open at once
+    for (int i = 0; i < SERVER_TEST_PLAYERS; i++) {
+        clients[i] = connect_client();
+        mu_assert(clients[i] >= 0, "Failed to connect.");
+        mu_assert(expect(clients[i], "What is your name?"), "No greeting.");
+    }
+    mu_assert(Server_sessionCount(server) == SERVER_TEST_PLAYERS, "Expected a session per player.");
+
+    for (int i = 0; i < SERVER_TEST_PLAYERS; i++) {
+        snprintf(line, sizeof(line), "Player%d\n", i);
+        mu_assert(say(clients[i], line), "Failed to send name.");
+    }
+    for (int i = 0; i < SERVER_TEST_PLAYERS; i++) {
+        mu_assert(expect(clients[i], "You are in Lobby."), "Player did not start in the lobby.");
+    }
+
+    // Each session plays its own character
+    for (int i = 0; i < SERVER_TEST_PLAYERS; i++) {
+        mu_assert(say(clients[i], "look self\r\n"), "Failed to send command.");
+    }
+    for (int i = 0; i < SERVER_TEST_PLAYERS; i++) {
+        snprintf(line, sizeof(line), "You are Player%d.", i);
+        mu_assert(expect(clients[i], line), "Session answered for the wrong character.");
+    }
+
+    mu_assert(say(clients[0], "xyzzy\n"), "Failed to send command.");
+    mu_assert(expect(clients[0], "I don't understand that."), "Bad command was not reported.");
+
+    // Quitting closes the one session, not the server
+    mu_assert(say(clients[0], "quit\n"), "Failed to send quit.");
+    mu_assert(expect(clients[0], "Goodbye."), "No goodbye.");
+    char byte;
+    mu_assert(recv(clients[0], &byte, 1, 0) == 0, "Session stayed open after quit.");
+    close(clients[0]);
+
+    // Hanging up works too
+    close(clients[1]);
+
+    mu_assert(say(clients[2], "look self\n"), "Failed to send command after others left.");
+    mu_assert(expect(clients[2], "You are Player2."), "Server stopped answering.");
+
+    mu_assert(Database_getCharacterByName(db, "Player5") != NULL, "New character was not saved.");
+    return NULL;
+}
+
+char *test_slow_and_busy_sessions()
+{
+    // As many players as workers flood the server with commands and never
+    // read the answers. Sockets don't block, so no worker gets stuck on them.
+    char flood[SERVER_TEST_FLOOD_LINES * 6];
+    for (int i = 0; i < SERVER_TEST_FLOOD_LINES; i++) {
+        memcpy(flood + i * 6, "xyzzy\n", 6);
+    }
+    for (int i = 3; i < 3 + 4; i++) {
+        size_t sent = 0;
+        while (sent < sizeof(flood)) {
+            ssize_t n = send(clients[i], flood + sent, sizeof(flood) - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n <= 0) { break; }
+            sent += (size_t)n;
+        }
+        mu_assert(sent > 0, "Failed to flood the server.");
+    }
+
+    mu_assert(say(clients[2], "look self\n"), "Failed to send command.");
+    mu_assert(expect(clients[2], "You are Player2."), "Players that don't read stalled the server.");
+
+    // Many lines at once are all answered, a few per wakeup
+    char burst[40 * 6];
+    for (int i = 0; i < 40; i++) {
+        memcpy(burst + i * 6, "xyzzy\n", 6);
+    }
+    mu_assert(send(clients[8], burst, sizeof(burst), MSG_NOSIGNAL) == (ssize_t)sizeof(burst), "Failed to send burst.");
+    mu_assert(expect_count(clients[8], "I don't understand that.", 40), "Lines from a burst went missing.");
+
+    return NULL;
+}
+
+char *test_stop_server()
+{
+    Server_stop(server);
+    mu_assert(pthread_join(server_thread, NULL) == 0, "Failed to join server thread.");
+    mu_assert(Server_sessionCount(server) == 0, "Sessions left open after stopping.");
+
+    for (int i = 2; i < SERVER_TEST_PLAYERS; i++) {
+        close(clients[i]);
+    }
+    Server_destroy(server);
+    mu_assert(access(server_socket, F_OK) != 0, "Socket file left behind.");
+
+    Database_close(db);
+    Database_destroy(db);
+    return NULL;
+}
+
+char *all_tests()
+{
+    mu_suite_start();
+
+    mu_run_test(test_start_server);
+    mu_run_test(test_many_sessions);
+    mu_run_test(test_slow_and_busy_sessions);
+    mu_run_test(test_stop_server);
+
+    return NULL;
+}
+
+RUN_TESTS(all_tests);